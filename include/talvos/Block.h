@@ -10,12 +10,18 @@
 #define TALVOS_BLOCK_H
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <vector>
+
+#include "talvos/DecodedInstruction.h"
 
 namespace talvos
 {
 
+class Function;
 class Instruction;
+class Type;
 
 /// A block of instructions ending with a termination instruction.
 class Block
@@ -32,16 +38,41 @@ public:
   Block &operator=(const Block &) = delete;
   ///\}
 
+  /// Pre-decode the instructions in this block for execution.
+  /// \p GetType is used to look up the type of operands, and branch targets
+  /// are resolved to blocks within \p Func. Instructions are numbered
+  /// starting from \p Position, which is updated to the position following
+  /// the last instruction in the block.
+  void decode(const Function *Func, uint32_t &Position,
+              const std::function<const Type *(uint32_t)> &GetType);
+
+  /// Returns the first decoded instruction in this block.
+  /// The block must have been decoded first.
+  const DecodedInstruction *getCode() const { return Code.data(); }
+
   /// Returns the ID of this block.
   uint32_t getId() const { return Id; }
 
   /// Returns the label instruction for this block.
   Instruction &getLabel() const { return *Label.get(); }
 
+  /// Returns the number of decoded instructions in this block.
+  size_t getNumInstructions() const { return Code.size(); }
+
+  /// Replace the decoded instructions in this block with a copy of \p Code,
+  /// resolving the branch targets of the terminator to \p Targets.
+  /// The operands of each instruction are copied into this block.
+  void setCode(const std::vector<DecodedInstruction> &Code,
+               const std::vector<const Block *> &Targets);
+
 private:
   uint32_t Id; ///< The unique ID of the block.
 
   std::unique_ptr<Instruction> Label; ///< The label instruction.
+
+  std::vector<DecodedInstruction> Code; ///< The decoded instructions.
+  std::vector<uint32_t> Operands;       ///< Operands for decoded instructions.
+  std::vector<const Block *> Targets;   ///< Branch targets of the terminator.
 };
 
 } // namespace talvos
@@ -9,6 +9,8 @@
 #ifndef TALVOS_COMPUTEPIPELINE_H
 #define TALVOS_COMPUTEPIPELINE_H
 
+#include <memory>
+
 namespace talvos
 {
 
@@ -19,8 +21,9 @@ class ComputePipeline
 {
 public:
   /// Create a compute pipeline from a single pipeline stage.
-  /// Ownership of \p Stage is transferred to the pipeline.
-  ComputePipeline(PipelineStage *Stage) : Stage(Stage){};
+  /// The stage may be shared with other pipelines.
+  ComputePipeline(std::shared_ptr<const PipelineStage> Stage)
+      : Stage(Stage){};
 
   /// Destroy the pipeline.
   ~ComputePipeline();
@@ -32,11 +35,11 @@ public:
   ///\}
 
   /// Returns the pipeline stage.
-  const PipelineStage *getStage() const { return Stage; }
+  const PipelineStage *getStage() const { return Stage.get(); }
 
 private:
   /// The pipeline stage in this pipeline.
-  PipelineStage *Stage;
+  std::shared_ptr<const PipelineStage> Stage;
 };
 
 } // namespace talvos
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 the Talvos developers. All rights reserved.
+//
+// This file is distributed under a three-clause BSD license. For full license
+// terms please see the LICENSE file distributed with this source code.
+
+/// \file DecodedInstruction.h
+/// This file declares the DecodedInstruction class.
+
+#ifndef TALVOS_DECODEDINSTRUCTION_H
+#define TALVOS_DECODEDINSTRUCTION_H
+
+#include <cstdint>
+
+namespace talvos
+{
+
+class Block;
+class DecodedInstruction;
+class Instruction;
+class Invocation;
+class Type;
+
+/// Pointer to the Invocation method that executes a decoded instruction.
+typedef void (Invocation::*InstructionHandler)(const DecodedInstruction *);
+
+/// This class represents an Instruction that has been pre-decoded for
+/// execution.
+///
+/// The handler method (including any specialization for the scalar type of the
+/// operands), the operand slots and the branch targets are all resolved when
+/// the instruction is decoded. Each Block stores its decoded instructions in a
+/// contiguous array, allowing an Invocation to execute them without examining
+/// the original Instruction.
+class DecodedInstruction
+{
+public:
+  /// Returns the instruction that this was decoded from.
+  const Instruction *getInstruction() const { return Inst; }
+
+  /// Returns the number of components in the result of this instruction.
+  uint32_t getNumComponents() const { return NumComponents; }
+
+  /// Returns the number of operands this instruction has.
+  uint16_t getNumOperands() const { return NumOperands; }
+
+  /// Returns the opcode.
+  uint16_t getOpcode() const { return Opcode; }
+
+  /// Returns the position of this instruction within its function.
+  uint32_t getPosition() const { return Position; }
+
+  /// Returns the operand at index \p i;
+  uint32_t getOperand(unsigned i) const { return Operands[i]; }
+
+  /// Returns the operands.
+  const uint32_t *getOperands() const { return Operands; }
+
+  /// Returns the result type of this instruction, or \p nullptr if it does not
+  /// produce a result.
+  const Type *getResultType() const { return ResultType; }
+
+  /// Returns true if this instruction only accesses memory through a pointer
+  /// that is statically known to be within the bounds of its allocation.
+  bool isInBounds() const { return InBounds; }
+
+  /// Returns true if this instruction applies an operation to each component
+  /// of its operands, with no other effects. Such instructions can be executed
+  /// for several invocations with a single dispatch (see
+  /// Invocation::stepLanes()).
+  bool isLanewise() const { return Lanewise; }
+
+  /// Returns the branch target at index \p i.
+  /// Only valid for terminator instructions that have been decoded as part of a
+  /// Block.
+  const Block *getTarget(unsigned i) const { return Targets[i]; }
+
+  InstructionHandler Handler;  ///< The method that executes this instruction.
+  const Instruction *Inst;     ///< The original instruction.
+  const Type *ResultType;      ///< The type of the instruction result.
+  const uint32_t *Operands;    ///< The operand values.
+  const Block *const *Targets; ///< The resolved branch targets.
+  uint32_t NumComponents;      ///< The number of result components.
+  uint32_t Position;           ///< The position within the function.
+  uint16_t Opcode;             ///< The instruction opcode.
+  uint16_t NumOperands;        ///< The number of operands.
+  bool InBounds;               ///< True if memory accesses are in bounds.
+  bool Lanewise;               ///< True if executed component-wise.
+};
+
+} // namespace talvos
+
+#endif
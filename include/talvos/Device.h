@@ -10,17 +10,23 @@
 #define TALVOS_DEVICE_H
 
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <tuple>
 #include <vector>
 
+#include "talvos/Memory.h"
+#include "talvos/PipelineStage.h"
+
 namespace talvos
 {
 
 class Command;
+class EntryPoint;
 class Instruction;
 class Invocation;
-class Memory;
+class Module;
 class PipelineExecutor;
 class Plugin;
 class Workgroup;
@@ -38,12 +44,62 @@ public:
   Device &operator=(const Device &) = delete;
   ///\}
 
+  /// Add the statistics \p Stats from a memory instance with scope \p Scope
+  /// that is being destroyed to the totals for that scope.
+  /// The live counts in \p Stats are ignored, since everything that is still
+  /// allocated is freed along with the instance.
+  void accumulateMemoryStats(MemoryScope Scope, const MemoryStats &Stats);
+
   /// Get the global memory instance associated with this device.
   Memory &getGlobalMemory() { return *GlobalMemory; }
 
+  /// Returns the memory statistics for \p Scope.
+  /// For device scope, these are the statistics for the global memory.
+  /// For workgroup and invocation scopes, these are accumulated from each
+  /// memory instance when it is destroyed, and \p PeakBytes is the highest
+  /// peak of any single instance. Variables in these scopes are not released
+  /// individually, but are all freed when the instance is destroyed, so the
+  /// live counts are always zero.
+  /// The numbers of bytes loaded and stored are only counted if memory
+  /// statistics are enabled, as indicated by \p HasAccessCounts.
+  MemoryStats getMemoryStats(MemoryScope Scope) const;
+
+  /// Returns the pipeline stage for entry point \p EP in module \p M, with the
+  /// specialization constant values in \p SM.
+  /// Pipeline stages are cached while they remain in use, so pipelines that
+  /// are created with the same module, entry point and specialization
+  /// constants share a single stage (and its specialized object table).
+  std::shared_ptr<const PipelineStage>
+  getPipelineStage(std::shared_ptr<const Module> M, const EntryPoint *EP,
+                   const SpecConstantMap &SM = {});
+
   /// Returns the PipelineExecutor for this device.
   PipelineExecutor &getPipelineExecutor() { return *Executor; }
 
+  /// Returns true if any plugins are loaded.
+  /// Plugins are only loaded when the device is created, so callers on hot
+  /// paths can use this to skip the plugin notification functions entirely.
+  bool hasPlugins() const { return !Plugins.empty(); }
+
+  /// Returns true if the interactive debugger is enabled.
+  /// This is enabled by setting the TALVOS_INTERACTIVE environment variable.
+  bool isInteractive() const { return Interactive; }
+
+  /// Returns a module with the same content as \p M, which was loaded from the
+  /// SPIR-V binary \p Binary.
+  /// If a module loaded from an identical binary is already in use on this
+  /// device then that module is returned, so that any code decoded for it is
+  /// shared. Otherwise, \p M is returned and recorded for future lookups,
+  /// holding a reference to \p Binary to compare against.
+  std::shared_ptr<Module>
+  internModule(std::shared_ptr<Module> M,
+               std::shared_ptr<const std::vector<uint32_t>> Binary);
+
+  /// Returns true if memory accesses are counted in the memory statistics.
+  /// This is enabled by setting the TALVOS_MEMORY_STATS environment variable,
+  /// which also prints the statistics when the device is destroyed.
+  bool isMemoryStatsEnabled() const { return MemoryStatsEnabled; }
+
   /// Returns true if all of the loaded plugins are thread-safe.
   bool isThreadSafe() const;
 
@@ -94,9 +150,46 @@ private:
   /// The pipeline executor instance.
   PipelineExecutor *Executor;
 
+  /// True if the interactive debugger is enabled.
+  bool Interactive;
+
   /// The maximum number of errors to report.
   size_t MaxErrors;
 
+  /// True if detailed memory statistics are collected.
+  bool MemoryStatsEnabled;
+
+  /// Accumulated statistics for each memory scope, indexed by MemoryScope.
+  /// The device scope entry is unused (see getMemoryStats()).
+  MemoryStats ScopeStats[3];
+
+  /// A mutex for synchronizing updates to the accumulated memory statistics.
+  mutable std::mutex MemoryStatsMutex;
+
+  /// A module that is in use on this device, and the SPIR-V binary that it
+  /// was loaded from.
+  struct InternedModule
+  {
+    std::shared_ptr<const std::vector<uint32_t>> Binary; ///< The binary.
+    std::weak_ptr<Module> Mod;                           ///< The module.
+  };
+
+  /// Modules that are in use on this device, keyed by content hash.
+  /// Binaries with the same hash are compared in full before sharing a module.
+  std::multimap<uint64_t, InternedModule> Modules;
+
+  /// Key used to identify a pipeline stage.
+  /// This is the module, the entry point, and the specialization constant IDs,
+  /// types, and values.
+  typedef std::tuple<const Module *, const EntryPoint *, std::vector<uint8_t>>
+      PipelineStageKey;
+
+  /// Pipeline stages that are in use on this device.
+  std::map<PipelineStageKey, std::weak_ptr<const PipelineStage>> Stages;
+
+  /// A mutex for synchronizing access to the module and pipeline stage caches.
+  std::mutex CacheMutex;
+
   /// A mutex for synchronizing threads waiting on fence signals.
   mutable std::mutex FenceMutex;
 
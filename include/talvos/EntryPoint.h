@@ -12,30 +12,29 @@
 #include <string>
 #include <vector>
 
+#include "talvos/Module.h"
+
 namespace talvos
 {
 
 class Function;
-class Variable;
-
-/// A list of module scope variables.
-typedef std::vector<const Variable *> VariableList;
 
 /// This class represents a shader entry point.
 class EntryPoint
 {
 public:
-  /// Create an EntryPoint.
+  /// Create an EntryPoint for the function with ID \p Id in module \p Mod.
   EntryPoint(uint32_t Id, std::string Name, uint32_t ExecutionModel,
-             const Function *Func, const VariableList &Variables)
-      : Id(Id), Name(Name), ExecutionModel(ExecutionModel), Func(Func),
+             const Module *Mod, const VariableList &Variables)
+      : Id(Id), Name(Name), ExecutionModel(ExecutionModel), Mod(Mod),
         Variables(Variables){};
 
   /// Returns the shader execution model of this entry point.
   uint32_t getExecutionModel() const { return ExecutionModel; }
 
   /// Returns the function specified by this entry point.
-  const Function *getFunction() const { return Func; }
+  /// The function is built on first use.
+  const Function *getFunction() const { return Mod->getFunction(Id); }
 
   /// Returns the SPIR-V result ID of this entry point.
   uint32_t getId() const { return Id; }
@@ -56,8 +55,8 @@ private:
   /// The shader execution mode.
   uint32_t ExecutionModel;
 
-  /// The function that will be used.
-  const Function *Func;
+  /// The module containing the function that will be used.
+  const Module *Mod;
 
   /// List of input/output variables used.
   VariableList Variables;
@@ -9,6 +9,7 @@
 #ifndef TALVOS_FUNCTION_H
 #define TALVOS_FUNCTION_H
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <vector>
@@ -38,6 +39,15 @@ public:
   /// Add a parameter to this function.
   void addParam(uint32_t Id) { Parameters.push_back(Id); }
 
+  /// Pre-decode every block in this function for execution.
+  /// \p GetType is used to look up the type of each operand. Instructions are
+  /// numbered in the order in which their blocks were added to the function.
+  void decode(const std::function<const Type *(uint32_t)> &GetType);
+
+  /// Returns the blocks in this function, in the order in which they were
+  /// added.
+  const std::vector<Block *> &getBlocks() const { return Layout; }
+
   /// Returns the block with ID \p Id.
   const Block *getBlock(uint32_t Id) const { return Blocks.at(Id).get(); }
 
@@ -56,6 +66,9 @@ public:
   /// Returns the number of parameters in this function.
   size_t getNumParams() const { return Parameters.size(); }
 
+  /// Returns the type of this function.
+  const Type *getType() const { return FunctionType; }
+
   /// Sets the ID of the entry block in this function.
   void setFirstBlock(uint32_t Id) { FirstBlockId = Id; }
 
@@ -68,6 +81,9 @@ private:
   uint32_t FirstBlockId;    ///< The ID of the first block.
   BlockMap Blocks;          ///< The blocks in the function.
 
+  /// The blocks in the function, in the order in which they were added.
+  std::vector<Block *> Layout;
+
   std::vector<uint32_t> Parameters; ///< The function parameter IDs.
 };
 
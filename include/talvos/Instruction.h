@@ -58,6 +58,10 @@ public:
   /// produce a result.
   const Type *getResultType() const { return ResultType; }
 
+  /// Returns true if this instruction only accesses memory through a pointer
+  /// that is statically known to be within the bounds of its allocation.
+  bool isInBounds() const { return InBounds; }
+
   /// Insert this instruction into a sequence, immediately following \p I.
   /// This transfers ownership of this instruction to the containing block.
   void insertAfter(Instruction *I);
@@ -77,6 +81,9 @@ public:
   /// any other instructions printed using this method.
   void print(std::ostream &O, bool Align = true) const;
 
+  /// Mark this instruction as only accessing memory in bounds.
+  void setInBounds() { InBounds = true; }
+
   /// Return the string representation of an instruction opcode.
   static const char *opcodeToString(uint16_t Opcode);
 
@@ -85,6 +92,7 @@ private:
   uint16_t Opcode;        ///< The instruction opcode.
   uint16_t NumOperands;   ///< The number of operands in this instruction.
   uint32_t *Operands;     ///< The operand values.
+  bool InBounds;          ///< True if memory accesses are known in bounds.
 
   std::unique_ptr<Instruction> Next; ///< The next instruction in the block.
 
@@ -9,14 +9,19 @@
 #ifndef TALVOS_INVOCATION_H
 #define TALVOS_INVOCATION_H
 
+#include <cassert>
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include "talvos/DecodedInstruction.h"
 #include "talvos/Dim3.h"
 #include "talvos/Object.h"
 
 namespace talvos
 {
 
+class Block;
 class Device;
 class Function;
 class Instruction;
@@ -29,7 +34,8 @@ class Workgroup;
 ///
 /// Instances of this class have a current instruction, block, and function, as
 /// well as their own Memory object used for private memory allocations. They
-/// also have a set of Objects used to hold instruction results.
+/// also have a set of Objects used to hold instruction results, which overlays
+/// the objects that are shared by all invocations of a pipeline stage.
 class Invocation
 {
 public:
@@ -42,16 +48,22 @@ public:
     FINISHED
   };
 
+  /// List of mappings from result ID to an object specific to an invocation.
+  typedef std::vector<std::pair<uint32_t, Object>> ObjectList;
+
 public:
   /// Create a standalone invocation for a device, with an initial set of
   /// result objects.
   Invocation(Device &Dev, const std::vector<Object> &InitialObjects);
 
   /// Create an invocation for \p Stage on \p Dev. Initial result object values
-  /// are provided in \p InitialObjects, and \p PipelineMemory provides storage
-  /// for input and output memory accesses.
+  /// are shared with \p SharedObjects, which must outlive the invocation.
+  /// Objects that are specific to this invocation are provided in
+  /// \p InvocationObjects, and \p PipelineMemory provides storage for input
+  /// and output memory accesses.
   Invocation(Device &Dev, const PipelineStage &Stage,
-             const std::vector<Object> &InitialObjects,
+             const std::vector<Object> &SharedObjects,
+             const ObjectList &InvocationObjects,
              std::shared_ptr<Memory> PipelineMemory, Workgroup *Group,
              Dim3 GlobalId);
 
@@ -67,18 +79,36 @@ public:
   /// Clear the barrier state, allowing the invocation to continue.
   void clearBarrier() { AtBarrier = false; }
 
+  /// Compare the program counter of this invocation with that of \p Other.
+  /// Program counters are ordered by the position of the call instruction in
+  /// each stack frame, followed by the position of the current instruction.
+  /// Returns a negative value if this invocation is behind \p Other, zero if
+  /// they are at the same instruction, and a positive value otherwise.
+  /// Both invocations must be executing the same entry point.
+  int comparePosition(const Invocation &Other) const;
+
+  /// Decode \p Inst for execution.
+  /// \p GetType is used to look up the type of each operand, which determines
+  /// the specialization of the handler method that is selected.
+  static DecodedInstruction
+  decode(const Instruction *Inst,
+         const std::function<const Type *(uint32_t)> &GetType);
+
   /// Execute \p Inst in this invocation.
   void execute(const Instruction *Inst);
 
   /// Returns the instruction that this invocation is executing.
   const Instruction *getCurrentInstruction() const
   {
-    return CurrentInstruction;
+    return CurrentInstruction ? CurrentInstruction->getInstruction() : nullptr;
   }
 
   /// Returns the global invocation ID.
   Dim3 getGlobalId() const { return GlobalId; }
 
+  /// Returns true if this is a helper invocation (see setHelper()).
+  bool isHelper() const { return Helper; }
+
   /// Returns the object with the specified ID.
   /// Returns a null object if no object with this ID has been defined.
   Object getObject(uint32_t Id) const;
@@ -86,134 +116,218 @@ public:
   /// Returns the state of this invocation.
   State getState() const;
 
+  /// Reset this invocation so that it executes its entry point again from
+  /// the beginning, reusing its objects and memories.
+  /// Results are left undefined, and private variables are re-initialized.
+  /// Input and output variables are not modified.
+  void reset();
+
+  /// Set whether this is a helper invocation.
+  /// A helper invocation executes a fragment shader for a fragment that is not
+  /// covered by the primitive, so that derivatives can be computed for the
+  /// other fragments in its quad. Its writes to buffers and images are skipped.
+  void setHelper(bool Helper) { this->Helper = Helper; }
+
+  /// Set the 2x2 quad of fragment shader invocations that this invocation
+  /// belongs to, which is used to compute derivatives.
+  /// \p Quad holds the invocations for the fragments at (x, y), (x+1, y),
+  /// (x, y+1) and (x+1, y+1), and this invocation is \p Quad[QuadLane].
+  void setQuad(const Invocation *const *Quad, uint32_t QuadLane)
+  {
+    this->Quad = Quad;
+    this->QuadLane = QuadLane;
+  }
+
   /// Step this invocation by executing the next instruction.
   void step();
 
+  /// Step each invocation in \p Lanes by executing their next instruction,
+  /// which must be the same instruction for every invocation.
+  /// If the instruction is lanewise (see DecodedInstruction::isLanewise()),
+  /// it is dispatched once and applied to every invocation, and true is
+  /// returned. Otherwise nothing is executed and false is returned, and each
+  /// invocation must be stepped individually.
+  static bool stepLanes(const std::vector<Invocation *> &Lanes);
+
   /// Returns true if this invocation has been discarded with OpKill.
   bool wasDiscarded() const { return Discarded; }
 
   /// \name Instruction handlers.
   ///@{
-  void executeAccessChain(const Instruction *Inst);
-  void executeAll(const Instruction *Inst);
-  void executeAny(const Instruction *Inst);
-  void executeAtomicCompareExchange(const Instruction *Inst);
-  template <typename T> void executeAtomicOp(const Instruction *Inst);
-  void executeBitcast(const Instruction *Inst);
-  void executeBitwiseAnd(const Instruction *Inst);
-  void executeBitwiseOr(const Instruction *Inst);
-  void executeBitwiseXor(const Instruction *Inst);
-  void executeBranch(const Instruction *Inst);
-  void executeBranchConditional(const Instruction *Inst);
-  void executeCompositeConstruct(const Instruction *Inst);
-  void executeCompositeExtract(const Instruction *Inst);
-  void executeCompositeInsert(const Instruction *Inst);
-  void executeControlBarrier(const Instruction *Inst);
-  void executeConvertFToS(const Instruction *Inst);
-  void executeConvertFToU(const Instruction *Inst);
-  void executeConvertSToF(const Instruction *Inst);
-  void executeConvertUToF(const Instruction *Inst);
-  void executeCopyMemory(const Instruction *Inst);
-  void executeCopyObject(const Instruction *Inst);
-  void executeDot(const Instruction *Inst);
-  void executeExtInst(const Instruction *Inst);
-  void executeFAdd(const Instruction *Inst);
-  void executeFConvert(const Instruction *Inst);
-  void executeFDiv(const Instruction *Inst);
-  void executeFMod(const Instruction *Inst);
-  void executeFMul(const Instruction *Inst);
-  void executeFNegate(const Instruction *Inst);
-  void executeFOrdEqual(const Instruction *Inst);
-  void executeFOrdGreaterThan(const Instruction *Inst);
-  void executeFOrdGreaterThanEqual(const Instruction *Inst);
-  void executeFOrdLessThan(const Instruction *Inst);
-  void executeFOrdLessThanEqual(const Instruction *Inst);
-  void executeFOrdNotEqual(const Instruction *Inst);
-  void executeFRem(const Instruction *Inst);
-  void executeFSub(const Instruction *Inst);
-  void executeFunctionCall(const Instruction *Inst);
-  void executeFUnordEqual(const Instruction *Inst);
-  void executeFUnordGreaterThan(const Instruction *Inst);
-  void executeFUnordGreaterThanEqual(const Instruction *Inst);
-  void executeFUnordLessThan(const Instruction *Inst);
-  void executeFUnordLessThanEqual(const Instruction *Inst);
-  void executeFUnordNotEqual(const Instruction *Inst);
-  void executeIAdd(const Instruction *Inst);
-  void executeIEqual(const Instruction *Inst);
-  void executeImage(const Instruction *Inst);
-  void executeImageQuerySize(const Instruction *Inst);
-  void executeImageRead(const Instruction *Inst);
-  void executeImageSampleExplicitLod(const Instruction *Inst);
-  void executeImageWrite(const Instruction *Inst);
-  void executeIMul(const Instruction *Inst);
-  void executeINotEqual(const Instruction *Inst);
-  void executeIsInf(const Instruction *Inst);
-  void executeIsNan(const Instruction *Inst);
-  void executeISub(const Instruction *Inst);
-  void executeKill(const Instruction *Inst);
-  void executeLoad(const Instruction *Inst);
-  void executeLogicalAnd(const Instruction *Inst);
-  void executeLogicalEqual(const Instruction *Inst);
-  void executeLogicalNot(const Instruction *Inst);
-  void executeLogicalNotEqual(const Instruction *Inst);
-  void executeLogicalOr(const Instruction *Inst);
-  void executeMatrixTimesScalar(const Instruction *Inst);
-  void executeMatrixTimesVector(const Instruction *Inst);
-  void executeNot(const Instruction *Inst);
-  void executePhi(const Instruction *Inst);
-  void executeReturn(const Instruction *Inst);
-  void executeReturnValue(const Instruction *Inst);
-  void executeSampledImage(const Instruction *Inst);
-  void executeSConvert(const Instruction *Inst);
-  void executeSDiv(const Instruction *Inst);
-  void executeSelect(const Instruction *Inst);
-  void executeSGreaterThan(const Instruction *Inst);
-  void executeSGreaterThanEqual(const Instruction *Inst);
-  void executeShiftLeftLogical(const Instruction *Inst);
-  void executeShiftRightArithmetic(const Instruction *Inst);
-  void executeShiftRightLogical(const Instruction *Inst);
-  void executeSLessThan(const Instruction *Inst);
-  void executeSLessThanEqual(const Instruction *Inst);
-  void executeSMod(const Instruction *Inst);
-  void executeSNegate(const Instruction *Inst);
-  void executeSRem(const Instruction *Inst);
-  void executeStore(const Instruction *Inst);
-  void executeSwitch(const Instruction *Inst);
-  void executeUConvert(const Instruction *Inst);
-  void executeUDiv(const Instruction *Inst);
-  void executeUGreaterThan(const Instruction *Inst);
-  void executeUGreaterThanEqual(const Instruction *Inst);
-  void executeULessThan(const Instruction *Inst);
-  void executeULessThanEqual(const Instruction *Inst);
-  void executeUMod(const Instruction *Inst);
-  void executeUndef(const Instruction *Inst);
-  void executeUnreachable(const Instruction *Inst);
-  void executeVariable(const Instruction *Inst);
-  void executeVectorExtractDynamic(const Instruction *Inst);
-  void executeVectorInsertDynamic(const Instruction *Inst);
-  void executeVectorShuffle(const Instruction *Inst);
-  void executeVectorTimesMatrix(const Instruction *Inst);
-  void executeVectorTimesScalar(const Instruction *Inst);
+  void executeAccessChain(const DecodedInstruction *Inst);
+  void executeAll(const DecodedInstruction *Inst);
+  void executeAny(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeAtomicCompareExchange(const DecodedInstruction *Inst);
+  template <typename T> void executeAtomicOp(const DecodedInstruction *Inst);
+  void executeBitcast(const DecodedInstruction *Inst);
+  template <typename T> void executeBitwiseAnd(const DecodedInstruction *Inst);
+  template <typename T> void executeBitwiseOr(const DecodedInstruction *Inst);
+  template <typename T> void executeBitwiseXor(const DecodedInstruction *Inst);
+  void executeBranch(const DecodedInstruction *Inst);
+  void executeBranchConditional(const DecodedInstruction *Inst);
+  void executeCompositeConstruct(const DecodedInstruction *Inst);
+  void executeCompositeExtract(const DecodedInstruction *Inst);
+  void executeCompositeInsert(const DecodedInstruction *Inst);
+  void executeControlBarrier(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeConvertFToS(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeConvertFToU(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeConvertSToF(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeConvertUToF(const DecodedInstruction *Inst);
+  void executeCopyMemory(const DecodedInstruction *Inst);
+  void executeCopyObject(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdx(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdxCoarse(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdxFine(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdy(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdyCoarse(const DecodedInstruction *Inst);
+  template <typename T> void executeDPdyFine(const DecodedInstruction *Inst);
+  template <typename T> void executeDot(const DecodedInstruction *Inst);
+  template <typename T> void executeExtInst(const DecodedInstruction *Inst);
+  template <typename T> void executeFAdd(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeFConvert(const DecodedInstruction *Inst);
+  template <typename T> void executeFDiv(const DecodedInstruction *Inst);
+  template <typename T> void executeFMod(const DecodedInstruction *Inst);
+  template <typename T> void executeFMul(const DecodedInstruction *Inst);
+  template <typename T> void executeFNegate(const DecodedInstruction *Inst);
+  template <typename T> void executeFOrdEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFOrdGreaterThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFOrdGreaterThanEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFOrdLessThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFOrdLessThanEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFOrdNotEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeFRem(const DecodedInstruction *Inst);
+  template <typename T> void executeFSub(const DecodedInstruction *Inst);
+  void executeFunctionCall(const DecodedInstruction *Inst);
+  template <typename T> void executeFUnordEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFUnordGreaterThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFUnordGreaterThanEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFUnordLessThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFUnordLessThanEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFUnordNotEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeFwidth(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeFwidthCoarse(const DecodedInstruction *Inst);
+  template <typename T> void executeFwidthFine(const DecodedInstruction *Inst);
+  template <typename T> void executeIAdd(const DecodedInstruction *Inst);
+  template <typename T> void executeIEqual(const DecodedInstruction *Inst);
+  void executeImage(const DecodedInstruction *Inst);
+  void executeImageQuerySize(const DecodedInstruction *Inst);
+  void executeImageRead(const DecodedInstruction *Inst);
+  void executeImageSampleExplicitLod(const DecodedInstruction *Inst);
+  void executeImageWrite(const DecodedInstruction *Inst);
+  template <typename T> void executeIMul(const DecodedInstruction *Inst);
+  template <typename T> void executeINotEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeIsInf(const DecodedInstruction *Inst);
+  template <typename T> void executeIsNan(const DecodedInstruction *Inst);
+  template <typename T> void executeISub(const DecodedInstruction *Inst);
+  void executeKill(const DecodedInstruction *Inst);
+  void executeLoad(const DecodedInstruction *Inst);
+  void executeLogicalAnd(const DecodedInstruction *Inst);
+  void executeLogicalEqual(const DecodedInstruction *Inst);
+  void executeLogicalNot(const DecodedInstruction *Inst);
+  void executeLogicalNotEqual(const DecodedInstruction *Inst);
+  void executeLogicalOr(const DecodedInstruction *Inst);
+  void executeMatrixTimesScalar(const DecodedInstruction *Inst);
+  void executeMatrixTimesVector(const DecodedInstruction *Inst);
+  void executeNop(const DecodedInstruction *Inst);
+  template <typename T> void executeNot(const DecodedInstruction *Inst);
+  void executePhi(const DecodedInstruction *Inst);
+  void executeReturn(const DecodedInstruction *Inst);
+  void executeReturnValue(const DecodedInstruction *Inst);
+  void executeSampledImage(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeSConvert(const DecodedInstruction *Inst);
+  template <typename T> void executeSDiv(const DecodedInstruction *Inst);
+  void executeSelect(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeSGreaterThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeSGreaterThanEqual(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeShiftLeftLogical(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeShiftRightArithmetic(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeShiftRightLogical(const DecodedInstruction *Inst);
+  template <typename T> void executeSLessThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeSLessThanEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeSMod(const DecodedInstruction *Inst);
+  template <typename T> void executeSNegate(const DecodedInstruction *Inst);
+  template <typename T> void executeSRem(const DecodedInstruction *Inst);
+  void executeStore(const DecodedInstruction *Inst);
+  void executeSwitch(const DecodedInstruction *Inst);
+  template <typename T, typename R>
+  void executeUConvert(const DecodedInstruction *Inst);
+  template <typename T> void executeUDiv(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeUGreaterThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeUGreaterThanEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeULessThan(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeULessThanEqual(const DecodedInstruction *Inst);
+  template <typename T> void executeUMod(const DecodedInstruction *Inst);
+  void executeUndef(const DecodedInstruction *Inst);
+  void executeUnreachable(const DecodedInstruction *Inst);
+  void executeVariable(const DecodedInstruction *Inst);
+  void executeVectorExtractDynamic(const DecodedInstruction *Inst);
+  void executeVectorInsertDynamic(const DecodedInstruction *Inst);
+  void executeVectorShuffle(const DecodedInstruction *Inst);
+  void executeUnimplemented(const DecodedInstruction *Inst);
+  void executeVectorTimesMatrix(const DecodedInstruction *Inst);
+  template <typename T>
+  void executeVectorTimesScalar(const DecodedInstruction *Inst);
   ///@}
 
 private:
   /// The current module.
   std::shared_ptr<const Module> CurrentModule;
 
-  const Function *CurrentFunction;       ///< The current function.
-  const Instruction *CurrentInstruction; ///< The current instruction.
-  uint32_t CurrentBlock;                 ///< The current block.
-  uint32_t PreviousBlock;                ///< The previous block (for OpPhi).
-  bool AtBarrier;                        ///< True when at a barrier.
-  bool Discarded;                        ///< True when fragment was discarded.
+  /// The pipeline stage being executed.
+  const PipelineStage *CurrentStage = nullptr;
+
+  const Function *EntryFunction; ///< The entry point function.
+
+  const Function *CurrentFunction; ///< The current function.
+  uint32_t CurrentBlock;           ///< The current block.
+  uint32_t PreviousBlock;          ///< The previous block (for OpPhi).
+  bool AtBarrier;                  ///< True when at a barrier.
+  bool Discarded;                  ///< True when fragment was discarded.
+  bool Helper = false;             ///< True for a helper invocation.
+
+  /// The quad of fragment shader invocations that this invocation belongs to.
+  const Invocation *const *Quad = nullptr;
+
+  /// The index of this invocation within its quad.
+  uint32_t QuadLane = 0;
+
+  /// The current instruction.
+  const DecodedInstruction *CurrentInstruction;
 
   /// A data structure holding information for a function call.
   struct StackEntry
   {
     // The instruction, block, and function to return to.
-    const Instruction *CallInst; ///< The calling instruction.
-    const Function *CallFunc;    ///< The function containing \p CallInst.
-    uint32_t CallBlock;          ///< The block containing \p CallInst.
+    const DecodedInstruction *CallInst; ///< The calling instruction.
+    const Function *CallFunc; ///< The function containing \p CallInst.
+    uint32_t CallBlock;       ///< The block containing \p CallInst.
 
     /// Function scope allocations within this stack frame.
     std::vector<uint64_t> Allocations;
@@ -221,7 +335,29 @@ private:
 
   std::vector<StackEntry> CallStack; ///< The function call stack.
 
-  std::vector<Object> Objects; ///< Set of result objects.
+  /// Function scope allocations made by the entry point function.
+  std::vector<uint64_t> EntryAllocations;
+
+  /// Objects that are specific to this invocation, such as function scope
+  /// results. Other objects are read from \p SharedObjects.
+  std::vector<Object> Objects;
+
+  /// Result objects that are shared with other invocations, or nullptr if
+  /// every object is held in \p Objects.
+  const Object *SharedObjects = nullptr;
+
+  /// Maps each result ID to one plus the index of its object in \p Objects,
+  /// or to zero if the object is shared.
+  const uint32_t *Slots = nullptr;
+
+  /// The number of result IDs in the module.
+  uint32_t IdBound = 0;
+
+  /// Identity slot table used by standalone invocations.
+  std::vector<uint32_t> OwnSlots;
+
+  /// Storage for the function scope instruction results of this invocation.
+  std::unique_ptr<uint8_t[]> RegisterFile;
 
   Device &Dev;           ///< The device this invocation is executing on.
   Workgroup *Group;      ///< The workgroup this invocation belongs to.
@@ -234,28 +370,58 @@ private:
   /// Temporary OpPhi results to be applied when we reach first non-OpPhi.
   std::vector<std::pair<uint32_t, Object>> PhiTemps;
 
-  /// Helper functions to execute simple instructions that can either operate
+  /// The invocations that the current instruction is being applied to, when
+  /// it is dispatched once for several invocations (see stepLanes()).
+  const std::vector<Invocation *> *Lanes = nullptr;
+
+  /// Helper function to compute the derivative of operand 2 of \p Inst with
+  /// respect to framebuffer x and/or y, using the values of the operand in
+  /// the other invocations in the quad. If both \p X and \p Y are true, the
+  /// result is the sum of their absolute values.
+  /// \p Coarse selects derivatives computed for the quad as a whole, rather
+  /// than for the row and column of this invocation.
+  template <typename T>
+  void executeDerivative(const DecodedInstruction *Inst, bool Coarse, bool X,
+                         bool Y);
+
+  /// Helper function to execute simple instructions that can either operate
   /// on scalars or component-wise for vectors.
+  /// If the instruction is being dispatched for several invocations (see
+  /// stepLanes()), it is applied to each of them.
   /// \p OpTy is the C++ scalar type of each operand.
   /// \p N is the number of operands.
   /// \p Offset is the operand offset of the first value.
   /// \p Op is a lambda that takes \p N operand values and returns a result.
-  ///@{
   template <typename OpTy, unsigned N, unsigned Offset = 2, typename F>
-  void executeOp(const Instruction *Inst, const F &Op);
-  template <unsigned N, unsigned Offset = 2, typename F>
-  void executeOpFP(const Instruction *Inst, const F &&Op);
-  template <unsigned N, unsigned Offset = 2, typename F>
-  void executeOpSInt(const Instruction *Inst, const F &&Op);
-  template <unsigned N, unsigned Offset = 2, typename F>
-  void executeOpUInt(const Instruction *Inst, const F &&Op);
-  ///@}
+  void executeOp(const DecodedInstruction *Inst, const F &Op);
+
+  /// Returns the object that is specific to this invocation for result ID
+  /// \p Id, which can be modified.
+  Object &getLocal(uint32_t Id)
+  {
+    assert(Id < IdBound && Slots[Id] && "Object is not invocation specific");
+    return Objects[Slots[Id] - 1];
+  }
 
   /// Returns the memory instance associated with \p StorageClass.
   Memory &getMemory(uint32_t StorageClass);
 
+  /// Returns the value of the object with result ID \p Id.
+  const Object &getValue(uint32_t Id) const
+  {
+    uint32_t Slot = Slots[Id];
+    return Slot ? Objects[Slot - 1] : SharedObjects[Id];
+  }
+
   /// Move this invocation to the block with ID \p Id.
   void moveToBlock(uint32_t Id);
+
+  /// Move this invocation to the block \p B.
+  void moveToBlock(const Block *B);
+
+  /// Returns true if a write to memory in storage class \p StorageClass must be
+  /// skipped because this is a helper invocation.
+  bool skipHelperWrite(uint32_t StorageClass) const;
 };
 
 } // namespace talvos
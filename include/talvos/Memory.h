@@ -9,8 +9,10 @@
 #ifndef TALVOS_MEMORY_H
 #define TALVOS_MEMORY_H
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -27,6 +29,22 @@ enum class MemoryScope
   Invocation
 };
 
+/// Statistics describing the allocations and accesses made in memory.
+struct MemoryStats
+{
+  uint64_t LiveBytes = 0;      ///< Number of bytes currently allocated.
+  uint64_t PeakBytes = 0;      ///< Highest number of bytes allocated at once.
+  uint64_t LiveBuffers = 0;    ///< Number of buffers currently allocated.
+  uint64_t NumAllocations = 0; ///< Total number of buffers allocated.
+  uint64_t NumReused = 0;      ///< Allocations that reused a released buffer.
+  uint64_t LoadBytes = 0;      ///< Total number of bytes loaded.
+  uint64_t StoreBytes = 0;     ///< Total number of bytes stored.
+
+  /// True if \p LoadBytes and \p StoreBytes were collected. Otherwise they
+  /// are zero, whether or not any memory was accessed.
+  bool HasAccessCounts = false;
+};
+
 /// This class represents an address space in the virtual device.
 ///
 /// This class provides methods to allocate and release buffers and access their
@@ -34,6 +52,20 @@ enum class MemoryScope
 /// addresses for buffers are unique within an instance of this class, but not
 /// across separate instances. It is therefore the responsibility of the caller
 /// to route load/store calls to the correct Memory object.
+///
+/// Buffers are recorded in a table that is never relocated, so that load,
+/// store and map operations can look up buffers without taking a lock while
+/// other threads allocate and release buffers.
+///
+/// Workgroup and invocation scope memory instances allocate buffers from an
+/// arena, by bumping a pointer into a slab of memory. Buffers released in the
+/// reverse order of allocation return their space to the arena, and all of the
+/// slabs are released at once (and cached for reuse by the same thread) when
+/// the memory instance is destroyed. Allocations and releases in an arena must
+/// not be performed concurrently.
+///
+/// Large device scope buffers are mapped directly from the operating system
+/// where possible, so that their pages are only committed when first touched.
 class Memory
 {
 public:
@@ -52,17 +84,23 @@ public:
   /// \returns the virtual base address of the allocation.
   uint64_t allocate(uint64_t NumBytes);
 
+  /// Returns the number of bytes of the allocation with base address
+  /// \p Address that are currently backed by physical memory.
+  uint64_t getCommitment(uint64_t Address) const;
+
   /// Atomically apply operation defined by \p Opcode to \p Address.
+  /// \p T must be a 32-bit or 64-bit integer type.
   /// \returns the original value of the memory location.
   template <typename T>
   T atomic(uint64_t Address, uint32_t Opcode, uint32_t Scope,
            uint32_t Semantics, T Value = 0);
 
   /// Perform an atomic compare-exchange operation at \p Address.
+  /// \p T must be a 32-bit or 64-bit integer type.
   /// \returns the original value of the memory location.
-  uint32_t atomicCmpXchg(uint64_t Address, uint32_t Scope,
-                         uint32_t EqualSemantics, uint32_t UnequalSemantics,
-                         uint32_t Value, uint32_t Comparator);
+  template <typename T>
+  T atomicCmpXchg(uint64_t Address, uint32_t Scope, uint32_t EqualSemantics,
+                  uint32_t UnequalSemantics, T Value, T Comparator);
 
   /// Dump the entire contents of this memory to stdout.
   void dump() const;
@@ -70,12 +108,30 @@ public:
   /// Dump the contents of the buffer with base address \p Address to stdout.
   void dump(uint64_t Address) const;
 
+  /// Returns the allocation and access statistics for this memory instance.
+  /// Allocation statistics are always collected, but the numbers of bytes
+  /// loaded and stored are only counted if memory statistics have been enabled
+  /// for the device (see Device::isMemoryStatsEnabled()).
+  MemoryStats getStats() const;
+
   /// Get the scope of this memory instance.
   MemoryScope getScope() const { return Scope; }
 
+  /// Create a buffer backed by \p NumBytes of existing host memory at \p Data,
+  /// without copying it. The host memory is not owned by this Memory instance,
+  /// and must remain valid until the buffer is released.
+  /// Only valid for device scope memory.
+  /// \returns the virtual base address of the buffer.
+  uint64_t import(uint8_t *Data, uint64_t NumBytes);
+
   /// Load \p NumBytes of data from \p Address into \p Result.
   void load(uint8_t *Result, uint64_t Address, uint64_t NumBytes) const;
 
+  /// Load \p NumBytes of data from \p Address into \p Result, without
+  /// checking the access against the bounds of the allocation.
+  /// The caller must guarantee that the access is in bounds.
+  void loadInBounds(uint8_t *Result, uint64_t Address, uint64_t NumBytes) const;
+
   /// Map a region of memory and return a pointer to it.
   uint8_t *map(uint64_t Base, uint64_t Offset, uint64_t NumBytes);
 
@@ -85,6 +141,11 @@ public:
   /// Store \p NumBytes of data from \p Data to \p Address.
   void store(uint64_t Address, uint64_t NumBytes, const uint8_t *Data);
 
+  /// Store \p NumBytes of data from \p Data to \p Address, without checking
+  /// the access against the bounds of the allocation.
+  /// The caller must guarantee that the access is in bounds.
+  void storeInBounds(uint64_t Address, uint64_t NumBytes, const uint8_t *Data);
+
   /// Unmap a previously mapped region of memory.
   void unmap(uint64_t Base);
 
@@ -114,25 +175,119 @@ private:
 
   MemoryScope Scope; ///< The scope of this memory instance.
 
-  std::mutex Mutex; ///< Mutex for guarding allocate/release operations.
+  /// The number of address bits used for the buffer ID, which depends on the
+  /// scope of this memory instance. The remaining bits hold the offset.
+  unsigned BufferBits;
 
-  /// Number of mutexes to use for synchronizing atomic operations.
+  std::mutex Mutex; ///< Mutex for guarding the list of free buffers.
+
+  /// Number of mutexes to use for synchronizing atomic operations that cannot
+  /// use native atomic instructions.
   static const uint32_t NUM_ATOMIC_MUTEXES = 100;
 
   /// Set of mutexes for synchronizing atomic operations.
   std::mutex AtomicMutexes[NUM_ATOMIC_MUTEXES];
 
   /// An allocation within this memory instance.
+  /// \p NumBytes is written before \p Data is published, and is valid
+  /// whenever \p Data is not nullptr.
   struct Buffer
   {
-    uint64_t NumBytes; ///< The size of the allocation in bytes.
-    uint8_t *Data;     ///< The raw data backing the allocation.
+    uint64_t NumBytes;           ///< The size of the allocation in bytes.
+    std::atomic<uint8_t *> Data; ///< The raw data backing the allocation.
+    bool Mapped;                 ///< True if the data was mapped with mmap.
+    bool Imported;               ///< True if the data is application owned.
   };
-  std::vector<Buffer> Buffers;       ///< List of allocations.
-  std::vector<uint64_t> FreeBuffers; ///< Base addresses available for reuse.
 
-  /// Check whether an access resides in an allocated region of memory.
-  bool isAccessValid(uint64_t Address, uint64_t NumBytes) const;
+  /// The maximum number of chunks in the buffer table.
+  static const unsigned MAX_BUFFER_CHUNKS = 64;
+
+  /// The buffer table, as an array of pointers to chunks of buffer entries
+  /// that double in size (see getChunkIndex()). Chunks are created on demand
+  /// and never moved or released until this memory instance is destroyed.
+  std::atomic<Buffer *> BufferChunks[MAX_BUFFER_CHUNKS];
+
+  /// The number of buffer identifiers that have been handed out.
+  std::atomic<uint64_t> NumBuffers;
+
+  std::vector<uint64_t> FreeBuffers; ///< Buffer IDs available for reuse.
+
+  /// The number of entries in FreeBuffers, which can be read without a lock.
+  std::atomic<size_t> NumFreeBuffers;
+
+  /// True if buffers are allocated from an arena.
+  bool Arena;
+
+  /// True if the numbers of bytes loaded and stored are counted.
+  bool CountAccesses;
+
+  /// Allocation and access counters, which can be updated concurrently.
+  ///\{
+  std::atomic<uint64_t> LiveBytes;
+  std::atomic<uint64_t> PeakBytes;
+  std::atomic<uint64_t> LiveBuffers;
+  std::atomic<uint64_t> NumAllocations;
+  std::atomic<uint64_t> NumReused;
+  mutable std::atomic<uint64_t> LoadBytes;
+  std::atomic<uint64_t> StoreBytes;
+  ///\}
+
+  /// A slab of memory used for arena allocations.
+  struct ArenaSlab
+  {
+    std::unique_ptr<uint8_t[]> Data; ///< The memory in the slab.
+    uint64_t Size;                   ///< The size of the slab in bytes.
+  };
+
+  std::vector<ArenaSlab> Slabs; ///< The slabs owned by this arena.
+  size_t CurrentSlab = 0;       ///< The slab used for the next allocation.
+  uint64_t SlabOffset = 0;      ///< The offset of the next allocation.
+
+  /// The slab index and offset at which each arena allocation starts, indexed
+  /// by buffer ID minus one.
+  std::vector<std::pair<size_t, uint64_t>> ArenaStack;
+
+  /// Arena slabs released by memory instances on the current thread.
+  static thread_local std::vector<ArenaSlab> SlabCache;
+
+  /// Allocate \p NumBytes from the arena.
+  uint8_t *allocateFromArena(uint64_t NumBytes);
+
+  /// Returns the buffer table entry for the buffer with ID \p Id, creating
+  /// the chunk that holds it if necessary.
+  Buffer &createBuffer(uint64_t Id);
+
+  /// Returns the buffer table entry for the buffer with ID \p Id, or nullptr
+  /// if it has never been allocated.
+  Buffer *getBuffer(uint64_t Id) const;
+
+  /// Get the buffer table chunk \p ChunkIndex that holds the buffer with ID
+  /// \p Id, and the \p Index of its entry within that chunk.
+  static void getChunkIndex(uint64_t Id, unsigned &ChunkIndex,
+                            uint64_t &Index);
+
+  /// Get an identifier for a new buffer of size \p NumBytes.
+  /// \returns the buffer identifier, or 0 if the allocation failed.
+  uint64_t createBufferId(uint64_t NumBytes);
+
+  /// Allocate \p NumBytes of data for a device scope buffer.
+  /// Sets \p Mapped to true if the data is mapped from the operating system
+  /// and must be released with freeData().
+  static uint8_t *allocateData(uint64_t NumBytes, bool &Mapped);
+
+  /// Release \p NumBytes of data allocated with allocateData().
+  static void freeData(uint8_t *Data, uint64_t NumBytes, bool Mapped);
+
+  /// Returns the number of entries in buffer table chunk \p ChunkIndex.
+  static uint64_t getChunkSize(unsigned ChunkIndex);
+
+  /// Returns a pointer to the data at \p Address, or nullptr if the access of
+  /// \p NumBytes bytes does not reside in an allocated region of memory.
+  uint8_t *getPointer(uint64_t Address, uint64_t NumBytes) const;
+
+  /// Returns a pointer to the data at \p Address, for an access of
+  /// \p NumBytes bytes that is known to be in bounds.
+  uint8_t *getPointerInBounds(uint64_t Address, uint64_t NumBytes) const;
 };
 
 } // namespace talvos
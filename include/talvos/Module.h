@@ -9,8 +9,11 @@
 #ifndef TALVOS_MODULE_H
 #define TALVOS_MODULE_H
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
@@ -22,6 +25,7 @@ namespace talvos
 
 class EntryPoint;
 class Function;
+struct FunctionContext;
 class Instruction;
 class Type;
 class Variable;
@@ -29,6 +33,9 @@ class Variable;
 /// A list of module scope variables.
 typedef std::vector<const Variable *> VariableList;
 
+/// A list of result IDs and their byte offsets within a register file.
+typedef std::vector<std::pair<uint32_t, size_t>> RegisterList;
+
 /// This class represents a SPIR-V module.
 ///
 /// This class contains types, functions, global variables, and constant
@@ -37,6 +44,11 @@ typedef std::vector<const Variable *> VariableList;
 class Module
 {
 public:
+  /// Version of the format produced by serialize().
+  /// This must be incremented whenever the format or the way that modules are
+  /// built from parsed instructions changes.
+  static const uint32_t SERIALIZED_VERSION = 3;
+
   /// Create an empty module.
   Module(uint32_t IdBound);
 
@@ -54,8 +66,12 @@ public:
   /// Transfers ownership of \p EP to the module.
   void addEntryPoint(EntryPoint *EP);
 
-  /// Add a function to this module.
-  void addFunction(std::unique_ptr<Function> Func);
+  /// Add a function with ID \p Id to this module.
+  /// The function is built from its serialized instruction records \p Records
+  /// the first time that it is used. \p Callees lists the IDs of the functions
+  /// that it calls.
+  void addFunction(uint32_t Id, std::vector<uint32_t> &&Records,
+                   std::vector<uint32_t> &&Callees);
 
   /// Add a local size execution mode to an entry point.
   void addLocalSize(uint32_t Entry, Dim3 LocalSize);
@@ -63,6 +79,10 @@ public:
   /// Add an object to this module.
   void addObject(uint32_t Id, const Object &Obj);
 
+  /// Allocate a slot in the register file for the result with ID \p Id.
+  /// Results with a zero-sized type \p Ty are not assigned a register.
+  void addRegister(uint32_t Id, const Type *Ty);
+
   /// Add a specialization constant ID mapping.
   void addSpecConstant(uint32_t SpecId, uint32_t ResultId);
 
@@ -83,11 +103,19 @@ public:
                                   uint32_t ExecutionModel) const;
 
   /// Returns the function with the specified ID.
+  /// The function is built from its instructions on first use.
   const Function *getFunction(uint32_t Id) const;
 
+  /// Returns the hash of the SPIR-V binary that this module was loaded from.
+  uint64_t getHash() const { return Hash; }
+
   /// Returns the ID bound of the results in this module.
   uint32_t getIdBound() const { return IdBound; }
 
+  /// Returns true if any function in this module contains a derivative
+  /// instruction (e.g. OpDPdx).
+  bool hasDerivatives() const { return HasDerivatives; }
+
   /// Returns the LocalSize execution mode for an entry point.
   /// This will return (1,1,1) if it has not been explicitly set for \p Entry.
   Dim3 getLocalSize(uint32_t Entry) const;
@@ -99,6 +127,13 @@ public:
   /// Returns a list of all result objects in this module.
   const std::vector<Object> &getObjects() const;
 
+  /// Returns the list of function scope results that have a register, along
+  /// with the offset of each register within the register file.
+  const RegisterList &getRegisters() const { return Registers; }
+
+  /// Returns the size in bytes of the register file needed by an invocation.
+  size_t getRegisterFileSize() const { return RegisterFileSize; }
+
   /// Returns the result ID for the given specialization constant ID.
   /// Returns 0 if no specialization constants with this ID are present.
   uint32_t getSpecConstant(uint32_t SpecId) const;
@@ -109,6 +144,10 @@ public:
   /// Returns the type with the specified ID.
   const Type *getType(uint32_t Id) const;
 
+  /// Returns the IDs of the function with ID \p Id and every function that it
+  /// may call, excluding those that have already been built.
+  std::vector<uint32_t> getUnbuiltFunctions(uint32_t Id) const;
+
   /// Returns the list of module scope variables.
   const VariableList &getVariables() const { return Variables; }
 
@@ -116,10 +155,40 @@ public:
   /// Returns 0 if no object has been decorated with WorkgroupSize.
   uint32_t getWorkgroupSizeId() const { return WorkgroupSizeId; }
 
+  /// Returns a compact binary serialization of this module, which can be
+  /// loaded with deserialize() without validating or parsing the SPIR-V.
+  /// The serialized records of each function are released once it has been
+  /// built, after which this returns an empty vector.
+  std::vector<uint8_t> serialize() const;
+
+  /// Record that a function in this module contains a derivative instruction.
+  void setHasDerivatives() { HasDerivatives = true; }
+
+  /// Set the information needed to build functions in this module.
+  void setFunctionContext(std::unique_ptr<FunctionContext> Context);
+
+  /// Set the hash of the SPIR-V binary that this module was loaded from, and
+  /// the serialized header and module scope records \p Data.
+  void setSerializedData(uint64_t Hash, std::vector<uint32_t> &&Data);
+
   /// Set the ID of the object decorated with WorkgroupSize.
   void setWorkgroupSizeId(uint32_t Id) { WorkgroupSizeId = Id; }
 
+  /// Create a new module from data produced by serialize(), for the SPIR-V
+  /// binary \p Words that the data was serialized from.
+  /// Returns nullptr if \p Data is not a valid serialized module, or if its
+  /// header does not match the length, hash and digest of \p Words.
+  static std::shared_ptr<Module> deserialize(const uint8_t *Data,
+                                             size_t NumBytes,
+                                             const uint32_t *Words,
+                                             size_t NumWords);
+
+  /// Returns a hash of \p NumWords words of SPIR-V binary data.
+  static uint64_t hash(const uint32_t *Words, size_t NumWords);
+
   /// Create a new module from the supplied SPIR-V binary data.
+  /// If the TALVOS_CACHE_DIR environment variable is set, serialized modules
+  /// are stored in and loaded from that directory, keyed by hash().
   /// Returns nullptr on failure.
   static std::shared_ptr<Module> load(const uint32_t *Words, size_t NumWords);
 
@@ -131,17 +200,42 @@ private:
   /// Map from SPIR-V result ID to talvos::Type.
   typedef std::map<uint32_t, std::unique_ptr<Type>> TypeMap;
 
+  /// A function that is built on first use.
+  struct LazyFunction
+  {
+    std::vector<uint32_t> Records;    ///< Serialized records, until built.
+    std::vector<uint32_t> Callees;    ///< IDs of the functions it calls.
+    std::once_flag Built;             ///< Used to build the function once.
+    std::atomic<bool> IsBuilt{false}; ///< True once the function is built.
+    std::unique_ptr<Function> Func;   ///< The function, once it has been built.
+  };
+
   /// Map from SPIR-V result ID to talvos::Function.
-  typedef std::map<uint32_t, std::unique_ptr<Function>> FunctionMap;
+  typedef std::map<uint32_t, std::unique_ptr<LazyFunction>> FunctionMap;
+
+  /// Build a function from its serialized instruction records \p Records.
+  std::unique_ptr<Function>
+  buildFunction(const std::vector<uint32_t> &Records) const;
+
+  /// Release the serialized records of \p LF once it has been built, along
+  /// with the module scope records.
+  void releaseRecords(LazyFunction &LF) const;
 
   uint32_t IdBound;            ///< The ID bound of the module.
   std::vector<Object> Objects; ///< Constant instruction results.
   TypeMap Types;               ///< Type mapping.
 
   FunctionMap Functions;                 ///< Function mapping.
+  std::vector<uint32_t> FunctionOrder;   ///< Function IDs in module order.
   std::vector<EntryPoint *> EntryPoints; ///< List of entry points.
   std::map<uint32_t, Dim3> LocalSizes;   ///< LocalSize execution modes.
 
+  /// Register file slots for function scope instruction results.
+  RegisterList Registers;
+
+  /// The total size in bytes of the register file.
+  size_t RegisterFileSize;
+
   /// Map specialization constant IDs to result IDs.
   std::map<uint32_t, uint32_t> SpecConstants;
 
@@ -151,8 +245,28 @@ private:
   /// The ID of the object decorated with WorkgroupSize.
   uint32_t WorkgroupSizeId;
 
+  /// True if any function contains a derivative instruction.
+  bool HasDerivatives;
+
   /// Module scope variables.
   VariableList Variables;
+
+  /// The hash of the SPIR-V binary that this module was loaded from.
+  uint64_t Hash;
+
+  /// The serialized header and module scope records (see serialize()).
+  /// This is empty once any function has been built.
+  mutable std::vector<uint32_t> SerializedData;
+
+  /// Information needed to build functions from their serialized records.
+  mutable std::unique_ptr<FunctionContext> Context;
+
+  /// The number of functions that have not been built yet.
+  mutable std::atomic<size_t> NumUnbuilt;
+
+  /// A mutex for synchronizing the release of the serialized records with
+  /// other threads that are reading them.
+  mutable std::shared_mutex RecordsMutex;
 };
 
 } // namespace talvos
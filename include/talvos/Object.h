@@ -48,11 +48,22 @@ struct DescriptorElement
 /// This class represents an instruction result.
 ///
 /// Instances of this class have a Type and a backing data store.
+///
+/// An object normally owns its data store. An object can instead be bound to
+/// external storage (such as a slot in an Invocation register file), in which
+/// case values assigned to it are copied into that storage in place.
+/// Finally, an object can share the data store of another object without
+/// copying it (see share()). Shared data is never modified: assigning to a
+/// shared object gives it a data store of its own (copy-on-write).
 class Object
 {
 public:
   /// Create an empty, uninitialized object.
-  Object() { Data = nullptr; }
+  Object()
+  {
+    Ty = nullptr;
+    Data = nullptr;
+  }
 
   /// Allocate an object with type \p Ty.
   /// If \p Data is nullptr, the object data will be left uninitialized.
@@ -67,6 +78,7 @@ public:
   ~Object();
 
   /// Copy-construct a new object, cloning the data from \p Src.
+  /// If \p Src is a shared object, the new object shares the same data.
   Object(const Object &Src);
 
   /// Copy-assign to this object, cloning the data from \p Src.
@@ -75,6 +87,12 @@ public:
   /// Move-construct an object, taking the data from \p Src.
   Object(Object &&Src) noexcept;
 
+  /// Bind this object to the external data store \p Storage, which must be
+  /// large enough to hold any value later assigned to the object.
+  /// The object is left undefined, and does not take ownership of \p Storage.
+  /// Any data store previously owned by the object is released.
+  void bind(uint8_t *Storage);
+
   /// Extract an element from a composite object.
   /// \returns a new object with the type and data of the target element.
   Object extract(const std::vector<uint32_t> &Indices) const;
@@ -103,18 +121,36 @@ public:
   /// Insert the value of \p Element into a composite object.
   void insert(const std::vector<uint32_t> &Indices, const Object &Element);
 
+  /// Load a value of type \p Ty from memory at the address in \p Pointer into
+  /// this object, reusing its data store where possible (see reset()).
+  /// The object remains undefined until the load has completed.
+  /// If \p InBounds is true, \p Pointer must be statically known to be within
+  /// the bounds of its allocation, and the load is not bounds checked.
+  void loadFrom(const Type *Ty, const Memory &Mem, const Object &Pointer,
+                bool InBounds = false);
+
   /// Returns true if this object has been allocated.
-  operator bool() const { return Data ? true : false; }
+  operator bool() const { return Ty && Data; }
 
   /// Allow an Object to be inserted into an output stream.
   /// Converts the value of this object to a human readable format.
   friend std::ostream &operator<<(std::ostream &Stream, const Object &O);
 
+  /// Redefine this object with type \p Ty, leaving its data uninitialized.
+  /// The existing data store is reused if the object is bound to external
+  /// storage, or if the size of the data store already matches \p Ty.
+  void reset(const Type *Ty);
+
   /// Set the value of this object to a scalar of type \p T.
   /// The type of this object must be either a scalar or a vector, and the size
   /// of the scalar type must match \p sizeof(T).
   template <typename T> void set(T Value, uint32_t Element = 0);
 
+  /// Returns an object that shares the data store of this object, without
+  /// copying it. This object must outlive the returned object and any copies
+  /// of it, and its data must not be modified while they exist.
+  Object share() const;
+
   /// Set the descriptor array elements for this object.
   /// Only valid for objects that are pointers to arrays.
   void setDescriptorElements(const DescriptorElement *DAE);
@@ -127,7 +163,9 @@ public:
   void store(Memory &Mem, uint64_t Address) const;
 
   /// Store the value of this object to memory at the address in \p Pointer.
-  void store(Memory &Mem, const Object &Pointer) const;
+  /// If \p InBounds is true, \p Pointer must be statically known to be within
+  /// the bounds of its allocation, and the store is not bounds checked.
+  void store(Memory &Mem, const Object &Pointer, bool InBounds = false) const;
 
   /// Set all of the value bits in this object to zero.
   void zero();
@@ -142,6 +180,14 @@ private:
   const Type *Ty; ///< The type of this object.
   uint8_t *Data;  ///< The raw data backing this object.
 
+  /// Specifies how this object relates to its data store.
+  enum
+  {
+    OWNED,  ///< The data store is owned by this object.
+    BOUND,  ///< The data store is external, and updated in place.
+    SHARED  ///< The data store belongs to another object, and is read-only.
+  } Ownership = OWNED;
+
   /// The memory layout of a matrix that this object points to.
   /// Only valid for objects that are pointers to matrix or vector types.
   PtrMatrixLayout MatrixLayout;
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include "talvos/Dim3.h"
+#include "talvos/Module.h"
 #include "talvos/Object.h"
 
 namespace talvos
@@ -21,7 +22,8 @@ namespace talvos
 
 class Device;
 class EntryPoint;
-class Module;
+class Function;
+class Invocation;
 
 /// Mapping from specialization constant ID to Object values.
 typedef std::map<uint32_t, Object> SpecConstantMap;
@@ -41,6 +43,9 @@ public:
   PipelineStage(Device &D, std::shared_ptr<const Module> M,
                 const EntryPoint *EP, const SpecConstantMap &SM = {});
 
+  /// Destroy the pipeline stage.
+  ~PipelineStage();
+
   // Do not allow PipelineStage objects to be copied.
   ///\{
   PipelineStage(const PipelineStage &) = delete;
@@ -50,15 +55,32 @@ public:
   /// Return the entry point this pipeline stage will invoke.
   const EntryPoint *getEntryPoint() const { return EP; }
 
+  /// Returns the function with ID \p Id, as optimized for this stage.
+  const Function *getFunction(uint32_t Id) const;
+
   /// Return the workgroup size.
   Dim3 getGroupSize() const { return GroupSize; }
 
   /// Return the module this pipeline stage is using.
   std::shared_ptr<const Module> getModule() const { return Mod; }
 
+  /// Returns the IDs of the objects that each invocation of this stage holds
+  /// a copy of: function scope results, and variables whose pointer values are
+  /// specific to an invocation.
+  const std::vector<uint32_t> &getLocalIds() const { return LocalIds; }
+
+  /// Returns a table that maps each result ID to one plus its index in
+  /// getLocalIds(), or to zero if its object is shared by all invocations.
+  const std::vector<uint32_t> &getLocalSlots() const { return LocalSlots; }
+
   /// Returns a list of all result objects in this pipeline stage.
   const std::vector<Object> &getObjects() const { return Objects; };
 
+  /// Returns the list of function scope results that have a register, along
+  /// with the offset of each register within the register file.
+  /// Results that have been folded to constants are not included.
+  const RegisterList &getRegisters() const { return Registers; }
+
 private:
   /// The module containing the entry point to invoke.
   std::shared_ptr<const Module> Mod;
@@ -68,6 +90,29 @@ private:
 
   /// The result objects in this pipeline stage, after specialization.
   std::vector<Object> Objects;
+
+  /// Function scope results that have a register in this pipeline stage.
+  RegisterList Registers;
+
+  /// IDs of the objects that are specific to each invocation.
+  std::vector<uint32_t> LocalIds;
+
+  /// Maps result IDs to one plus their index in LocalIds, or zero if shared.
+  std::vector<uint32_t> LocalSlots;
+
+  /// Functions that have been optimized for this pipeline stage.
+  std::map<uint32_t, std::unique_ptr<Function>> Functions;
+
+  /// Optimize the entry point function and the functions that it calls,
+  /// using \p I to evaluate instructions that have constant operands.
+  void optimize(Invocation &I);
+
+  /// Returns a copy of \p Func that has been optimized for this stage.
+  /// Instructions with constant operands are folded and evaluated with \p I,
+  /// branches with constant conditions are replaced with unconditional
+  /// branches, unreachable blocks are removed, and instructions that have no
+  /// effect are dropped.
+  std::unique_ptr<Function> optimize(const Function *Func, Invocation &I);
 };
 
 } // namespace talvos
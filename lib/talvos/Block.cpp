@@ -7,7 +7,9 @@
 /// This file defines the Block class.
 
 #include "talvos/Block.h"
+#include "talvos/Function.h"
 #include "talvos/Instruction.h"
+#include "talvos/Invocation.h"
 
 #include <spirv/unified1/spirv.h>
 
@@ -22,4 +24,70 @@ Block::Block(uint32_t Id)
 
 Block::~Block() {}
 
+void Block::decode(const Function *Func, uint32_t &Position,
+                   const std::function<const Type *(uint32_t)> &GetType)
+{
+  Code.clear();
+  Operands.clear();
+  Targets.clear();
+
+  // Decode each instruction, gathering operands into a contiguous array.
+  std::vector<size_t> OperandOffsets;
+  for (const Instruction *I = Label->next(); I; I = I->next())
+  {
+    OperandOffsets.push_back(Operands.size());
+    Operands.insert(Operands.end(), I->getOperands(),
+                    I->getOperands() + I->getNumOperands());
+    Code.push_back(Invocation::decode(I, GetType));
+    Code.back().Position = Position++;
+
+    // Resolve branch targets.
+    switch (I->getOpcode())
+    {
+    case SpvOpBranch:
+      Targets.push_back(Func->getBlock(I->getOperand(0)));
+      break;
+    case SpvOpBranchConditional:
+      Targets.push_back(Func->getBlock(I->getOperand(1)));
+      Targets.push_back(Func->getBlock(I->getOperand(2)));
+      break;
+    case SpvOpSwitch:
+      Targets.push_back(Func->getBlock(I->getOperand(1)));
+      for (uint32_t i = 3; i < I->getNumOperands(); i += 2)
+        Targets.push_back(Func->getBlock(I->getOperand(i)));
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Set operand and target pointers now that the arrays will not be resized.
+  for (size_t i = 0; i < Code.size(); i++)
+    Code[i].Operands = Operands.data() + OperandOffsets[i];
+  if (!Code.empty())
+    Code.back().Targets = Targets.data();
+}
+
+void Block::setCode(const std::vector<DecodedInstruction> &Code,
+                    const std::vector<const Block *> &Targets)
+{
+  this->Code = Code;
+  this->Targets = Targets;
+  Operands.clear();
+
+  // Gather operands into a contiguous array.
+  std::vector<size_t> OperandOffsets;
+  for (const DecodedInstruction &DI : Code)
+  {
+    OperandOffsets.push_back(Operands.size());
+    Operands.insert(Operands.end(), DI.Operands, DI.Operands + DI.NumOperands);
+  }
+
+  // Set operand and target pointers now that the arrays will not be resized.
+  for (size_t i = 0; i < this->Code.size(); i++)
+    this->Code[i].Operands = Operands.data() + OperandOffsets[i];
+  if (!this->Code.empty())
+    this->Code.back().Targets = this->Targets.data();
+}
+
 } // namespace talvos
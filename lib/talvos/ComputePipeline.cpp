@@ -12,6 +12,6 @@
 namespace talvos
 {
 
-ComputePipeline::~ComputePipeline() { delete Stage; }
+ComputePipeline::~ComputePipeline() {}
 
 } // namespace talvos
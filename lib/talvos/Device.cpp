@@ -6,6 +6,7 @@
 /// \file Device.cpp
 /// This file defines the Device class.
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <chrono>
@@ -34,6 +35,7 @@
 #include "talvos/Module.h"
 #include "talvos/PipelineStage.h"
 #include "talvos/Plugin.h"
+#include "talvos/Type.h"
 #include "talvos/Workgroup.h"
 
 namespace talvos
@@ -47,6 +49,7 @@ static std::atomic<size_t> NumErrors;
 
 Device::Device()
 {
+  MemoryStatsEnabled = checkEnv("TALVOS_MEMORY_STATS", false);
   GlobalMemory = new Memory(*this, MemoryScope::Device);
 
   // Load plugins from dynamic libraries.
@@ -101,6 +104,7 @@ Device::Device()
     }
   }
 
+  Interactive = checkEnv("TALVOS_INTERACTIVE", false);
   Executor = new PipelineExecutor(PipelineExecutorKey(), *this);
 
   NumErrors = 0;
@@ -126,9 +130,144 @@ Device::~Device()
   }
 
   delete Executor;
+
+  if (MemoryStatsEnabled)
+  {
+    std::cerr << "Talvos memory statistics:" << std::endl;
+    for (MemoryScope Scope : {MemoryScope::Device, MemoryScope::Workgroup,
+                              MemoryScope::Invocation})
+    {
+      MemoryStats Stats = getMemoryStats(Scope);
+      std::cerr << "  " << Memory::scopeToString(Scope) << " scope:"
+                << std::endl;
+
+      // Only device scope buffers can outlive the memory that holds them.
+      if (Scope == MemoryScope::Device)
+        std::cerr << "    Live bytes:   " << Stats.LiveBytes << std::endl
+                  << "    Live buffers: " << Stats.LiveBuffers << std::endl;
+
+      std::cerr << "    Peak bytes:   " << Stats.PeakBytes << std::endl
+                << "    Allocations:  " << Stats.NumAllocations << " ("
+                << Stats.NumReused << " reused)" << std::endl
+                << "    Bytes loaded: " << Stats.LoadBytes << std::endl
+                << "    Bytes stored: " << Stats.StoreBytes << std::endl;
+    }
+  }
+
   delete GlobalMemory;
 }
 
+void Device::accumulateMemoryStats(MemoryScope Scope, const MemoryStats &Stats)
+{
+  std::lock_guard<std::mutex> Lock(MemoryStatsMutex);
+  MemoryStats &Total = ScopeStats[(unsigned)Scope];
+  Total.PeakBytes = std::max(Total.PeakBytes, Stats.PeakBytes);
+  Total.NumAllocations += Stats.NumAllocations;
+  Total.NumReused += Stats.NumReused;
+  Total.LoadBytes += Stats.LoadBytes;
+  Total.StoreBytes += Stats.StoreBytes;
+}
+
+MemoryStats Device::getMemoryStats(MemoryScope Scope) const
+{
+  if (Scope == MemoryScope::Device)
+    return GlobalMemory->getStats();
+
+  std::lock_guard<std::mutex> Lock(MemoryStatsMutex);
+  MemoryStats Stats = ScopeStats[(unsigned)Scope];
+  Stats.HasAccessCounts = MemoryStatsEnabled;
+  return Stats;
+}
+
+std::shared_ptr<const PipelineStage>
+Device::getPipelineStage(std::shared_ptr<const Module> M, const EntryPoint *EP,
+                         const SpecConstantMap &SM)
+{
+  // Build key from the specialization constant IDs, types, and values.
+  PipelineStageKey Key(M.get(), EP, {});
+  std::vector<uint8_t> &SpecData = std::get<2>(Key);
+  for (auto &SE : SM)
+  {
+    const Type *Ty = SE.second.getType();
+    const uint8_t *Id = (const uint8_t *)&SE.first;
+    const uint8_t *TyPtr = (const uint8_t *)&Ty;
+    SpecData.insert(SpecData.end(), Id, Id + sizeof(SE.first));
+    SpecData.insert(SpecData.end(), TyPtr, TyPtr + sizeof(Ty));
+    SpecData.insert(SpecData.end(), SE.second.getData(),
+                    SE.second.getData() + Ty->getSize());
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(CacheMutex);
+    auto Itr = Stages.find(Key);
+    if (Itr != Stages.end())
+    {
+      if (std::shared_ptr<const PipelineStage> Stage = Itr->second.lock())
+        return Stage;
+    }
+  }
+
+  // Create the stage without holding the lock, since this builds and
+  // optimizes its functions.
+  std::shared_ptr<const PipelineStage> Stage =
+      std::make_shared<PipelineStage>(*this, M, EP, SM);
+
+  std::lock_guard<std::mutex> Lock(CacheMutex);
+
+  // Use the stage created by another thread in the meantime, if there is one.
+  auto Itr = Stages.find(Key);
+  if (Itr != Stages.end())
+  {
+    if (std::shared_ptr<const PipelineStage> Existing = Itr->second.lock())
+      return Existing;
+  }
+
+  // Remove stages that are no longer in use.
+  for (auto I = Stages.begin(); I != Stages.end();)
+  {
+    if (I->second.expired())
+      I = Stages.erase(I);
+    else
+      ++I;
+  }
+
+  Stages[Key] = Stage;
+  return Stage;
+}
+
+std::shared_ptr<Module>
+Device::internModule(std::shared_ptr<Module> M,
+                     std::shared_ptr<const std::vector<uint32_t>> Binary)
+{
+  if (!M)
+    return M;
+
+  std::lock_guard<std::mutex> Lock(CacheMutex);
+
+  // Look for a module loaded from the same binary. The hash only narrows down
+  // the candidates, which are then compared in full.
+  auto Range = Modules.equal_range(M->getHash());
+  for (auto Itr = Range.first; Itr != Range.second; ++Itr)
+  {
+    if (*Itr->second.Binary != *Binary)
+      continue;
+    if (std::shared_ptr<Module> Existing = Itr->second.Mod.lock())
+      return Existing;
+  }
+
+  // Remove modules that are no longer in use.
+  for (auto I = Modules.begin(); I != Modules.end();)
+  {
+    if (I->second.Mod.expired())
+      I = Modules.erase(I);
+    else
+      ++I;
+  }
+
+  Modules.insert({M->getHash(), {Binary, M}});
+  return M;
+}
+
 bool Device::isThreadSafe() const
 {
   for (auto P : Plugins)
@@ -24,7 +24,15 @@ Function::Function(uint32_t Id, const Type *FuncType)
 void Function::addBlock(std::unique_ptr<Block> B)
 {
   assert(Blocks.count(B->getId()) == 0);
+  Layout.push_back(B.get());
   Blocks[B->getId()] = std::move(B);
 }
 
+void Function::decode(const std::function<const Type *(uint32_t)> &GetType)
+{
+  uint32_t Position = 0;
+  for (Block *B : Layout)
+    B->decode(this, Position, GetType);
+}
+
 } // namespace talvos
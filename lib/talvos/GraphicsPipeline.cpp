@@ -12,10 +12,6 @@
 namespace talvos
 {
 
-GraphicsPipeline::~GraphicsPipeline()
-{
-  delete VertexStage;
-  delete FragmentStage;
-}
+GraphicsPipeline::~GraphicsPipeline() {}
 
 } // namespace talvos
@@ -22,6 +22,7 @@ Instruction::Instruction(uint16_t Opcode, uint16_t NumOperands,
   this->Opcode = Opcode;
   this->NumOperands = NumOperands;
   this->ResultType = ResultType;
+  this->InBounds = false;
   this->Next = nullptr;
   this->Previous = nullptr;
 
@@ -6,15 +6,18 @@
 /// \file Invocation.cpp
 /// This file defines the Invocation class.
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #include <spirv/unified1/GLSL.std.450.h>
 #include <spirv/unified1/spirv.h>
 
+#include "Utils.h"
 #include "talvos/Block.h"
 #include "talvos/Device.h"
 #include "talvos/EntryPoint.h"
@@ -30,22 +33,55 @@
 #include "talvos/Workgroup.h"
 
 /// Get scalar operand at index \p Index with type \p Type.
-#define OP(Index, Type) Objects[Inst->getOperand(Index)].get<Type>()
+#define OP(Index, Type) getValue(Inst->getOperand(Index)).get<Type>()
+
+// Lane kernels are additionally compiled for AVX2 on x86-64, and selected at
+// runtime when the host CPU supports it. Other targets (including AArch64,
+// where NEON is always available) use the baseline instruction set.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define TALVOS_HAVE_AVX2_KERNELS 1
+#define TALVOS_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define TALVOS_HAVE_AVX2_KERNELS 0
+#define TALVOS_ALWAYS_INLINE inline
+#endif
 
 namespace talvos
 {
 
+/// True if lanewise instructions dispatched for several invocations are
+/// applied with lane kernels, rather than to one invocation at a time.
+/// This is disabled by setting TALVOS_VECTORIZE=0.
+static const bool UseLaneKernels = checkEnv("TALVOS_VECTORIZE", true);
+
+#if TALVOS_HAVE_AVX2_KERNELS
+/// True if the host CPU supports AVX2 instructions.
+static const bool HasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+/// The number of operand components that are gathered from a group of
+/// invocations for each call to a lane kernel.
+static const uint32_t LANE_KERNEL_SIZE = 256;
+
 Invocation::Invocation(Device &Dev, const std::vector<Object> &InitialObjects)
     : Dev(Dev)
 {
   CurrentInstruction = nullptr;
   PrivateMemory = nullptr;
   PipelineMemory = nullptr;
+
+  // Every object is specific to a standalone invocation.
   Objects = InitialObjects;
+  IdBound = (uint32_t)Objects.size();
+  OwnSlots.resize(IdBound);
+  for (uint32_t Id = 0; Id < IdBound; Id++)
+    OwnSlots[Id] = Id + 1;
+  Slots = OwnSlots.data();
 }
 
 Invocation::Invocation(Device &Dev, const PipelineStage &Stage,
-                       const std::vector<Object> &InitialObjects,
+                       const std::vector<Object> &SharedObjects,
+                       const ObjectList &InvocationObjects,
                        std::shared_ptr<Memory> PipelineMemory, Workgroup *Group,
                        Dim3 GlobalId)
     : Dev(Dev), Group(Group), GlobalId(GlobalId), PipelineMemory(PipelineMemory)
@@ -55,17 +91,36 @@ Invocation::Invocation(Device &Dev, const PipelineStage &Stage,
   AtBarrier = false;
   Discarded = false;
   CurrentModule = Stage.getModule();
-  CurrentFunction = Stage.getEntryPoint()->getFunction();
+  CurrentStage = &Stage;
+  EntryFunction = Stage.getFunction(Stage.getEntryPoint()->getId());
+  CurrentFunction = EntryFunction;
   moveToBlock(CurrentFunction->getFirstBlockId());
 
-  // Clone initial object values.
-  Objects = InitialObjects;
+  // Objects that are not specific to this invocation are read directly from
+  // the shared object table. The initial values of the others are shared with
+  // it until they are first assigned.
+  assert(SharedObjects.size() == Stage.getLocalSlots().size());
+  this->SharedObjects = SharedObjects.data();
+  Slots = Stage.getLocalSlots().data();
+  IdBound = (uint32_t)SharedObjects.size();
+  Objects.reserve(Stage.getLocalIds().size());
+  for (uint32_t Id : Stage.getLocalIds())
+    Objects.push_back(SharedObjects[Id].share());
+
+  // Add objects that are specific to this invocation.
+  for (auto &O : InvocationObjects)
+    getLocal(O.first) = O.second;
+
+  // Bind function scope results to their slots in the register file.
+  RegisterFile.reset(new uint8_t[CurrentModule->getRegisterFileSize()]);
+  for (auto &R : Stage.getRegisters())
+    getLocal(R.first).bind(RegisterFile.get() + R.second);
 
   // Copy workgroup variable pointer values.
   if (Group)
   {
     for (auto V : Group->getVariables())
-      Objects[V.first] = V.second;
+      getLocal(V.first) = V.second;
   }
 
   // Set up private variables.
@@ -78,9 +133,9 @@ Invocation::Invocation(Device &Dev, const PipelineStage &Stage,
     // Allocate and initialize variable in private memory.
     uint64_t NumBytes = Ty->getElementType()->getSize();
     uint64_t Address = PrivateMemory->allocate(NumBytes);
-    Objects[V->getId()] = Object(Ty, Address);
+    getLocal(V->getId()) = Object(Ty, Address);
     if (V->getInitializer())
-      Objects[V->getInitializer()].store(*PrivateMemory, Address);
+      getValue(V->getInitializer()).store(*PrivateMemory, Address);
   }
 
   Dev.reportInvocationBegin(this);
@@ -88,79 +143,302 @@ Invocation::Invocation(Device &Dev, const PipelineStage &Stage,
 
 Invocation::~Invocation() { delete PrivateMemory; }
 
-void Invocation::execute(const talvos::Instruction *Inst)
+/// Returns the handler \p Get(T()) for the floating point type T with bit
+/// width \p Width.
+template <typename F> static InstructionHandler selectFP(uint32_t Width, F Get)
+{
+  switch (Width)
+  {
+  case 32:
+    return Get(float());
+  case 64:
+    return Get(double());
+  default:
+    return &Invocation::executeUnimplemented;
+  }
+}
+
+/// Returns the handler \p Get(T()) for the signed integer type T with bit
+/// width \p Width.
+template <typename F>
+static InstructionHandler selectSInt(uint32_t Width, F Get)
+{
+  switch (Width)
+  {
+  case 8:
+    return Get(int8_t());
+  case 16:
+    return Get(int16_t());
+  case 32:
+    return Get(int32_t());
+  case 64:
+    return Get(int64_t());
+  default:
+    return &Invocation::executeUnimplemented;
+  }
+}
+
+/// Returns the handler \p Get(T()) for the unsigned integer type T with bit
+/// width \p Width.
+template <typename F>
+static InstructionHandler selectUInt(uint32_t Width, F Get)
+{
+  switch (Width)
+  {
+  case 8:
+    return Get(uint8_t());
+  case 16:
+    return Get(uint16_t());
+  case 32:
+    return Get(uint32_t());
+  case 64:
+    return Get(uint64_t());
+  default:
+    return &Invocation::executeUnimplemented;
+  }
+}
+
+/// Returns true if \p Opcode is executed by a handler that only applies an
+/// operation to each component of its operands with executeOp(), which can be
+/// applied to several invocations with a single dispatch.
+/// OpVectorTimesScalar is excluded, since its handler reads the scalar operand
+/// of the invocation that it is dispatched to. Shifts and conversions to
+/// integers are excluded, since vector instructions can produce different
+/// results to scalar instructions for out of range operands.
+static bool isLanewise(uint16_t Opcode)
 {
-  // Dispatch instruction to handler method.
-  uint16_t Opcode = Inst->getOpcode();
   switch (Opcode)
   {
+  case SpvOpBitwiseAnd:
+  case SpvOpBitwiseOr:
+  case SpvOpBitwiseXor:
+  case SpvOpConvertSToF:
+  case SpvOpConvertUToF:
+  case SpvOpFAdd:
+  case SpvOpFConvert:
+  case SpvOpFDiv:
+  case SpvOpFMul:
+  case SpvOpFNegate:
+  case SpvOpFOrdEqual:
+  case SpvOpFOrdGreaterThan:
+  case SpvOpFOrdGreaterThanEqual:
+  case SpvOpFOrdLessThan:
+  case SpvOpFOrdLessThanEqual:
+  case SpvOpFOrdNotEqual:
+  case SpvOpFSub:
+  case SpvOpFUnordEqual:
+  case SpvOpFUnordGreaterThan:
+  case SpvOpFUnordGreaterThanEqual:
+  case SpvOpFUnordLessThan:
+  case SpvOpFUnordLessThanEqual:
+  case SpvOpFUnordNotEqual:
+  case SpvOpIAdd:
+  case SpvOpIEqual:
+  case SpvOpIMul:
+  case SpvOpINotEqual:
+  case SpvOpIsInf:
+  case SpvOpIsNan:
+  case SpvOpISub:
+  case SpvOpLogicalAnd:
+  case SpvOpLogicalEqual:
+  case SpvOpLogicalNot:
+  case SpvOpLogicalNotEqual:
+  case SpvOpLogicalOr:
+  case SpvOpNot:
+  case SpvOpSConvert:
+  case SpvOpSGreaterThan:
+  case SpvOpSGreaterThanEqual:
+  case SpvOpSLessThan:
+  case SpvOpSLessThanEqual:
+  case SpvOpSNegate:
+  case SpvOpUConvert:
+  case SpvOpUGreaterThan:
+  case SpvOpUGreaterThanEqual:
+  case SpvOpULessThan:
+  case SpvOpULessThanEqual:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int Invocation::comparePosition(const Invocation &Other) const
+{
+  assert(CurrentInstruction && Other.CurrentInstruction);
+
+  // Returns the relative order of two instructions in the same function.
+  auto compare = [](const DecodedInstruction *A, const DecodedInstruction *B) {
+    return (int)A->getPosition() - (int)B->getPosition();
+  };
+
+  // Compare call sites in the stack frames that both invocations have.
+  size_t Depth = std::min(CallStack.size(), Other.CallStack.size());
+  for (size_t i = 0; i < Depth; i++)
+  {
+    if (int Order = compare(CallStack[i].CallInst, Other.CallStack[i].CallInst))
+      return Order;
+  }
+
+  // An invocation inside a function call is ahead of an invocation that has
+  // not yet executed the call instruction.
+  if (CallStack.size() > Depth)
+    return compare(CallStack[Depth].CallInst, Other.CurrentInstruction) < 0
+               ? -1
+               : 1;
+  if (Other.CallStack.size() > Depth)
+    return compare(CurrentInstruction, Other.CallStack[Depth].CallInst) <= 0
+               ? -1
+               : 1;
+
+  return compare(CurrentInstruction, Other.CurrentInstruction);
+}
+
+DecodedInstruction
+Invocation::decode(const Instruction *Inst,
+                   const std::function<const Type *(uint32_t)> &GetType)
+{
+  DecodedInstruction Decoded;
+  Decoded.Inst = Inst;
+  Decoded.ResultType = Inst->getResultType();
+  Decoded.Operands = Inst->getOperands();
+  Decoded.Targets = nullptr;
+  Decoded.Position = 0;
+  Decoded.NumComponents =
+      Decoded.ResultType ? Decoded.ResultType->getElementCount() : 0;
+  Decoded.Opcode = Inst->getOpcode();
+  Decoded.NumOperands = Inst->getNumOperands();
+  Decoded.InBounds = Inst->isInBounds();
+  Decoded.Lanewise = isLanewise(Inst->getOpcode());
+
+  // Returns the bit width of the scalar type of Ty, or 0 if not numeric.
+  auto getScalarWidth = [](const Type *Ty) -> uint32_t {
+    if (Ty && Ty->isVector())
+      Ty = Ty->getElementType();
+    if (!Ty || !(Ty->isInt() || Ty->isFloat()))
+      return 0;
+    return Ty->getBitWidth();
+  };
+
+  // Returns the scalar bit width of the operand at index Index.
+  auto getWidth = [&](unsigned Index) -> uint32_t {
+    if (Index >= Inst->getNumOperands())
+      return 0;
+    return getScalarWidth(GetType(Inst->getOperand(Index)));
+  };
+
+  // Scalar bit width of the result.
+  uint32_t ResultWidth = getScalarWidth(Decoded.ResultType);
+
+  // Bit width of the memory location accessed by an atomic instruction.
+  uint32_t AtomicWidth =
+      Inst->getOpcode() == SpvOpAtomicStore ? getWidth(3) : ResultWidth;
+
+  // Select handler method, specializing for operand and result types if
+  // necessary.
+  InstructionHandler &Handler = Decoded.Handler;
+  switch (Inst->getOpcode())
+  {
 #define DISPATCH(Op, Func)                                                     \
   case Op:                                                                     \
-    execute##Func(Inst);                                                       \
+    Handler = &Invocation::execute##Func;                                      \
+    break
+#define DISPATCH_TYPED(Op, Func, Select, Index)                                \
+  case Op:                                                                     \
+    Handler = select##Select(getWidth(Index), [](auto T) {                     \
+      return &Invocation::execute##Func<decltype(T)>;                          \
+    });                                                                        \
+    break
+#define DISPATCH_FP(Op, Func) DISPATCH_TYPED(Op, Func, FP, 2)
+#define DISPATCH_SINT(Op, Func) DISPATCH_TYPED(Op, Func, SInt, 2)
+#define DISPATCH_UINT(Op, Func) DISPATCH_TYPED(Op, Func, UInt, 2)
+#define DISPATCH_EXTINST(Op, Func) DISPATCH_TYPED(Op, Func, FP, 4)
+#define DISPATCH_CONVERT(Op, Func, SelectOp, SelectResult)                     \
+  case Op:                                                                     \
+    Handler = select##SelectOp(getWidth(2), [&](auto T) {                      \
+      return select##SelectResult(ResultWidth, [](auto R) {                    \
+        return &Invocation::execute##Func<decltype(T), decltype(R)>;           \
+      });                                                                      \
+    });                                                                        \
+    break
+#define DISPATCH_ATOMIC(Op, Func, T32, T64)                                    \
+  case Op:                                                                     \
+    Handler = AtomicWidth == 64 ? &Invocation::execute##Func<T64>              \
+                                : &Invocation::execute##Func<T32>;             \
     break
 #define NOP(Op)                                                                \
   case Op:                                                                     \
+    Handler = &Invocation::executeNop;                                         \
     break
 
     DISPATCH(SpvOpAccessChain, AccessChain);
     DISPATCH(SpvOpAll, All);
     DISPATCH(SpvOpAny, Any);
-    DISPATCH(SpvOpAtomicAnd, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicCompareExchange, AtomicCompareExchange);
-    DISPATCH(SpvOpAtomicExchange, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicIAdd, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicIDecrement, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicIIncrement, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicISub, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicLoad, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicOr, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicSMax, AtomicOp<int32_t>);
-    DISPATCH(SpvOpAtomicSMin, AtomicOp<int32_t>);
-    DISPATCH(SpvOpAtomicStore, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicUMax, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicUMin, AtomicOp<uint32_t>);
-    DISPATCH(SpvOpAtomicXor, AtomicOp<uint32_t>);
+    DISPATCH_ATOMIC(SpvOpAtomicAnd, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicCompareExchange, AtomicCompareExchange,
+                    uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicExchange, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicIAdd, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicIDecrement, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicIIncrement, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicISub, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicLoad, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicOr, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicSMax, AtomicOp, int32_t, int64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicSMin, AtomicOp, int32_t, int64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicStore, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicUMax, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicUMin, AtomicOp, uint32_t, uint64_t);
+    DISPATCH_ATOMIC(SpvOpAtomicXor, AtomicOp, uint32_t, uint64_t);
     DISPATCH(SpvOpBitcast, Bitcast);
-    DISPATCH(SpvOpBitwiseAnd, BitwiseAnd);
-    DISPATCH(SpvOpBitwiseOr, BitwiseOr);
-    DISPATCH(SpvOpBitwiseXor, BitwiseXor);
+    DISPATCH_UINT(SpvOpBitwiseAnd, BitwiseAnd);
+    DISPATCH_UINT(SpvOpBitwiseOr, BitwiseOr);
+    DISPATCH_UINT(SpvOpBitwiseXor, BitwiseXor);
     DISPATCH(SpvOpBranch, Branch);
     DISPATCH(SpvOpBranchConditional, BranchConditional);
     DISPATCH(SpvOpCompositeConstruct, CompositeConstruct);
     DISPATCH(SpvOpCompositeExtract, CompositeExtract);
     DISPATCH(SpvOpCompositeInsert, CompositeInsert);
     DISPATCH(SpvOpControlBarrier, ControlBarrier);
-    DISPATCH(SpvOpConvertFToS, ConvertFToS);
-    DISPATCH(SpvOpConvertFToU, ConvertFToU);
-    DISPATCH(SpvOpConvertSToF, ConvertSToF);
-    DISPATCH(SpvOpConvertUToF, ConvertUToF);
+    DISPATCH_CONVERT(SpvOpConvertFToS, ConvertFToS, FP, SInt);
+    DISPATCH_CONVERT(SpvOpConvertFToU, ConvertFToU, FP, UInt);
+    DISPATCH_CONVERT(SpvOpConvertSToF, ConvertSToF, SInt, FP);
+    DISPATCH_CONVERT(SpvOpConvertUToF, ConvertUToF, UInt, FP);
     DISPATCH(SpvOpCopyMemory, CopyMemory);
     DISPATCH(SpvOpCopyObject, CopyObject);
-    DISPATCH(SpvOpDot, Dot);
-    DISPATCH(SpvOpExtInst, ExtInst);
-    DISPATCH(SpvOpFAdd, FAdd);
-    DISPATCH(SpvOpFConvert, FConvert);
-    DISPATCH(SpvOpFDiv, FDiv);
-    DISPATCH(SpvOpFMod, FMod);
-    DISPATCH(SpvOpFMul, FMul);
-    DISPATCH(SpvOpFNegate, FNegate);
-    DISPATCH(SpvOpFOrdEqual, FOrdEqual);
-    DISPATCH(SpvOpFOrdGreaterThan, FOrdGreaterThan);
-    DISPATCH(SpvOpFOrdGreaterThanEqual, FOrdGreaterThanEqual);
-    DISPATCH(SpvOpFOrdLessThan, FOrdLessThan);
-    DISPATCH(SpvOpFOrdLessThanEqual, FOrdLessThanEqual);
-    DISPATCH(SpvOpFOrdNotEqual, FOrdNotEqual);
-    DISPATCH(SpvOpFRem, FRem);
-    DISPATCH(SpvOpFSub, FSub);
+    DISPATCH_FP(SpvOpDPdx, DPdx);
+    DISPATCH_FP(SpvOpDPdxCoarse, DPdxCoarse);
+    DISPATCH_FP(SpvOpDPdxFine, DPdxFine);
+    DISPATCH_FP(SpvOpDPdy, DPdy);
+    DISPATCH_FP(SpvOpDPdyCoarse, DPdyCoarse);
+    DISPATCH_FP(SpvOpDPdyFine, DPdyFine);
+    DISPATCH_FP(SpvOpDot, Dot);
+    DISPATCH_EXTINST(SpvOpExtInst, ExtInst);
+    DISPATCH_FP(SpvOpFAdd, FAdd);
+    DISPATCH_CONVERT(SpvOpFConvert, FConvert, FP, FP);
+    DISPATCH_FP(SpvOpFDiv, FDiv);
+    DISPATCH_FP(SpvOpFMod, FMod);
+    DISPATCH_FP(SpvOpFMul, FMul);
+    DISPATCH_FP(SpvOpFNegate, FNegate);
+    DISPATCH_FP(SpvOpFOrdEqual, FOrdEqual);
+    DISPATCH_FP(SpvOpFOrdGreaterThan, FOrdGreaterThan);
+    DISPATCH_FP(SpvOpFOrdGreaterThanEqual, FOrdGreaterThanEqual);
+    DISPATCH_FP(SpvOpFOrdLessThan, FOrdLessThan);
+    DISPATCH_FP(SpvOpFOrdLessThanEqual, FOrdLessThanEqual);
+    DISPATCH_FP(SpvOpFOrdNotEqual, FOrdNotEqual);
+    DISPATCH_FP(SpvOpFRem, FRem);
+    DISPATCH_FP(SpvOpFSub, FSub);
     DISPATCH(SpvOpFunctionCall, FunctionCall);
-    DISPATCH(SpvOpFUnordEqual, FUnordEqual);
-    DISPATCH(SpvOpFUnordGreaterThan, FUnordGreaterThan);
-    DISPATCH(SpvOpFUnordGreaterThanEqual, FUnordGreaterThanEqual);
-    DISPATCH(SpvOpFUnordLessThan, FUnordLessThan);
-    DISPATCH(SpvOpFUnordLessThanEqual, FUnordLessThanEqual);
-    DISPATCH(SpvOpFUnordNotEqual, FUnordNotEqual);
-    DISPATCH(SpvOpIAdd, IAdd);
-    DISPATCH(SpvOpIEqual, IEqual);
+    DISPATCH_FP(SpvOpFUnordEqual, FUnordEqual);
+    DISPATCH_FP(SpvOpFUnordGreaterThan, FUnordGreaterThan);
+    DISPATCH_FP(SpvOpFUnordGreaterThanEqual, FUnordGreaterThanEqual);
+    DISPATCH_FP(SpvOpFUnordLessThan, FUnordLessThan);
+    DISPATCH_FP(SpvOpFUnordLessThanEqual, FUnordLessThanEqual);
+    DISPATCH_FP(SpvOpFUnordNotEqual, FUnordNotEqual);
+    DISPATCH_FP(SpvOpFwidth, Fwidth);
+    DISPATCH_FP(SpvOpFwidthCoarse, FwidthCoarse);
+    DISPATCH_FP(SpvOpFwidthFine, FwidthFine);
+    DISPATCH_UINT(SpvOpIAdd, IAdd);
+    DISPATCH_UINT(SpvOpIEqual, IEqual);
     DISPATCH(SpvOpImage, Image);
     DISPATCH(SpvOpImageFetch, ImageRead);
     DISPATCH(SpvOpImageQuerySize, ImageQuerySize);
@@ -168,12 +446,12 @@ void Invocation::execute(const talvos::Instruction *Inst)
     DISPATCH(SpvOpImageRead, ImageRead);
     DISPATCH(SpvOpImageSampleExplicitLod, ImageSampleExplicitLod);
     DISPATCH(SpvOpImageWrite, ImageWrite);
-    DISPATCH(SpvOpIMul, IMul);
+    DISPATCH_UINT(SpvOpIMul, IMul);
     DISPATCH(SpvOpInBoundsAccessChain, AccessChain);
-    DISPATCH(SpvOpINotEqual, INotEqual);
-    DISPATCH(SpvOpIsInf, IsInf);
-    DISPATCH(SpvOpIsNan, IsNan);
-    DISPATCH(SpvOpISub, ISub);
+    DISPATCH_UINT(SpvOpINotEqual, INotEqual);
+    DISPATCH_FP(SpvOpIsInf, IsInf);
+    DISPATCH_FP(SpvOpIsNan, IsNan);
+    DISPATCH_UINT(SpvOpISub, ISub);
     DISPATCH(SpvOpKill, Kill);
     DISPATCH(SpvOpLoad, Load);
     DISPATCH(SpvOpLogicalEqual, LogicalEqual);
@@ -183,34 +461,34 @@ void Invocation::execute(const talvos::Instruction *Inst)
     DISPATCH(SpvOpLogicalNot, LogicalNot);
     DISPATCH(SpvOpMatrixTimesScalar, MatrixTimesScalar);
     DISPATCH(SpvOpMatrixTimesVector, MatrixTimesVector);
-    DISPATCH(SpvOpNot, Not);
+    DISPATCH_UINT(SpvOpNot, Not);
     DISPATCH(SpvOpPhi, Phi);
     DISPATCH(SpvOpPtrAccessChain, AccessChain);
     DISPATCH(SpvOpReturn, Return);
     DISPATCH(SpvOpReturnValue, ReturnValue);
     DISPATCH(SpvOpSampledImage, SampledImage);
-    DISPATCH(SpvOpSConvert, SConvert);
-    DISPATCH(SpvOpSDiv, SDiv);
+    DISPATCH_CONVERT(SpvOpSConvert, SConvert, SInt, SInt);
+    DISPATCH_SINT(SpvOpSDiv, SDiv);
     DISPATCH(SpvOpSelect, Select);
-    DISPATCH(SpvOpSGreaterThan, SGreaterThan);
-    DISPATCH(SpvOpSGreaterThanEqual, SGreaterThanEqual);
-    DISPATCH(SpvOpShiftLeftLogical, ShiftLeftLogical);
-    DISPATCH(SpvOpShiftRightArithmetic, ShiftRightArithmetic);
-    DISPATCH(SpvOpShiftRightLogical, ShiftRightLogical);
-    DISPATCH(SpvOpSLessThan, SLessThan);
-    DISPATCH(SpvOpSLessThanEqual, SLessThanEqual);
-    DISPATCH(SpvOpSMod, SMod);
-    DISPATCH(SpvOpSNegate, SNegate);
-    DISPATCH(SpvOpSRem, SRem);
+    DISPATCH_SINT(SpvOpSGreaterThan, SGreaterThan);
+    DISPATCH_SINT(SpvOpSGreaterThanEqual, SGreaterThanEqual);
+    DISPATCH_UINT(SpvOpShiftLeftLogical, ShiftLeftLogical);
+    DISPATCH_SINT(SpvOpShiftRightArithmetic, ShiftRightArithmetic);
+    DISPATCH_UINT(SpvOpShiftRightLogical, ShiftRightLogical);
+    DISPATCH_SINT(SpvOpSLessThan, SLessThan);
+    DISPATCH_SINT(SpvOpSLessThanEqual, SLessThanEqual);
+    DISPATCH_SINT(SpvOpSMod, SMod);
+    DISPATCH_SINT(SpvOpSNegate, SNegate);
+    DISPATCH_SINT(SpvOpSRem, SRem);
     DISPATCH(SpvOpStore, Store);
     DISPATCH(SpvOpSwitch, Switch);
-    DISPATCH(SpvOpUConvert, UConvert);
-    DISPATCH(SpvOpUDiv, UDiv);
-    DISPATCH(SpvOpUGreaterThan, UGreaterThan);
-    DISPATCH(SpvOpUGreaterThanEqual, UGreaterThanEqual);
-    DISPATCH(SpvOpULessThan, ULessThan);
-    DISPATCH(SpvOpULessThanEqual, ULessThanEqual);
-    DISPATCH(SpvOpUMod, UMod);
+    DISPATCH_CONVERT(SpvOpUConvert, UConvert, UInt, UInt);
+    DISPATCH_UINT(SpvOpUDiv, UDiv);
+    DISPATCH_UINT(SpvOpUGreaterThan, UGreaterThan);
+    DISPATCH_UINT(SpvOpUGreaterThanEqual, UGreaterThanEqual);
+    DISPATCH_UINT(SpvOpULessThan, ULessThan);
+    DISPATCH_UINT(SpvOpULessThanEqual, ULessThanEqual);
+    DISPATCH_UINT(SpvOpUMod, UMod);
     DISPATCH(SpvOpUndef, Undef);
     DISPATCH(SpvOpUnreachable, Unreachable);
     DISPATCH(SpvOpVariable, Variable);
@@ -218,8 +496,7 @@ void Invocation::execute(const talvos::Instruction *Inst)
     DISPATCH(SpvOpVectorInsertDynamic, VectorInsertDynamic);
     DISPATCH(SpvOpVectorShuffle, VectorShuffle);
     DISPATCH(SpvOpVectorTimesMatrix, VectorTimesMatrix);
-    DISPATCH(SpvOpVectorTimesScalar, VectorTimesScalar);
-
+    DISPATCH_FP(SpvOpVectorTimesScalar, VectorTimesScalar);
     NOP(SpvOpNop);
     NOP(SpvOpLine);
     NOP(SpvOpLoopMerge);
@@ -228,18 +505,34 @@ void Invocation::execute(const talvos::Instruction *Inst)
     NOP(SpvOpSelectionMerge);
 
 #undef DISPATCH
+#undef DISPATCH_TYPED
+#undef DISPATCH_FP
+#undef DISPATCH_SINT
+#undef DISPATCH_UINT
+#undef DISPATCH_EXTINST
+#undef DISPATCH_CONVERT
 #undef NOP
 
   default:
-    Dev.reportError("Unimplemented instruction", true);
+    Handler = &Invocation::executeUnimplemented;
   }
+
+  return Decoded;
+}
+
+void Invocation::execute(const talvos::Instruction *Inst)
+{
+  // Decode instruction, using the current objects to resolve operand types.
+  DecodedInstruction Decoded =
+      decode(Inst, [this](uint32_t Id) { return getValue(Id).getType(); });
+  (this->*Decoded.Handler)(&Decoded);
 }
 
-void Invocation::executeAccessChain(const Instruction *Inst)
+void Invocation::executeAccessChain(const DecodedInstruction *Inst)
 {
   // Base pointer.
   uint32_t Id = Inst->getOperand(1);
-  Object &Base = Objects[Inst->getOperand(2)];
+  const Object &Base = getValue(Inst->getOperand(2));
 
   // Ensure base pointer is valid.
   if (!Base)
@@ -264,7 +557,7 @@ void Invocation::executeAccessChain(const Instruction *Inst)
         }
 
         // Set result pointer to null.
-        Objects[Id] = Object(Inst->getResultType(), (uint64_t)0);
+        getLocal(Id) = Object(Inst->getResultType(), (uint64_t)0);
         return;
       }
     }
@@ -289,7 +582,7 @@ void Invocation::executeAccessChain(const Instruction *Inst)
     assert(!Base.getDescriptorElements());
 
     FirstIndexOperand = 4;
-    switch (Objects[Inst->getOperand(3)].getType()->getSize())
+    switch (getValue(Inst->getOperand(3)).getType()->getSize())
     {
     case 2:
       Result += Base.getType()->getElementOffset(OP(3, uint16_t));
@@ -310,7 +603,7 @@ void Invocation::executeAccessChain(const Instruction *Inst)
   for (uint32_t i = FirstIndexOperand; i < Inst->getNumOperands(); i++)
   {
     uint64_t Index;
-    const Object &IndexObj = Objects[Inst->getOperand(i)];
+    const Object &IndexObj = getValue(Inst->getOperand(i));
     switch (IndexObj.getType()->getSize())
     {
     case 2:
@@ -386,18 +679,19 @@ void Invocation::executeAccessChain(const Instruction *Inst)
     Ty = ElemTy;
   }
 
-  Objects[Id] = Object(Inst->getResultType(), Result);
+  getLocal(Id).reset(Inst->getResultType());
+  getLocal(Id).set(Result);
 
   // Set matrix layout for result pointer if necessary.
   if (MatrixLayout && (Ty->isVector() || Ty->isMatrix()))
-    Objects[Id].setMatrixLayout(MatrixLayout);
+    getLocal(Id).setMatrixLayout(MatrixLayout);
 }
 
-void Invocation::executeAll(const Instruction *Inst)
+void Invocation::executeAll(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   Object Result(Inst->getResultType(), true);
-  const Object &Vector = Objects[Inst->getOperand(2)];
+  const Object &Vector = getValue(Inst->getOperand(2));
   for (uint32_t i = 0; i < Vector.getType()->getElementCount(); i++)
   {
     if (!Vector.get<bool>(i))
@@ -406,14 +700,14 @@ void Invocation::executeAll(const Instruction *Inst)
       break;
     }
   }
-  Objects[Id] = Result;
+  getLocal(Id) = Result;
 }
 
-void Invocation::executeAny(const Instruction *Inst)
+void Invocation::executeAny(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   Object Result(Inst->getResultType(), false);
-  const Object &Vector = Objects[Inst->getOperand(2)];
+  const Object &Vector = getValue(Inst->getOperand(2));
   for (uint32_t i = 0; i < Vector.getType()->getElementCount(); i++)
   {
     if (Vector.get<bool>(i))
@@ -422,202 +716,183 @@ void Invocation::executeAny(const Instruction *Inst)
       break;
     }
   }
-  Objects[Id] = Result;
+  getLocal(Id) = Result;
 }
 
-template <typename T> void Invocation::executeAtomicOp(const Instruction *Inst)
+template <typename T>
+void Invocation::executeAtomicOp(const DecodedInstruction *Inst)
 {
   assert(Inst->getOpcode() != SpvOpAtomicCompareExchange);
 
   // Get index of pointer operand.
   uint32_t PtrOp = (Inst->getOpcode() == SpvOpAtomicStore) ? 0 : 2;
 
-  Object Pointer = Objects[Inst->getOperand(PtrOp)];
-  uint32_t Scope = Objects[Inst->getOperand(PtrOp + 1)].get<uint32_t>();
-  uint32_t Semantics = Objects[Inst->getOperand(PtrOp + 2)].get<uint32_t>();
+  Object Pointer = getValue(Inst->getOperand(PtrOp));
+  uint32_t Scope = getValue(Inst->getOperand(PtrOp + 1)).get<uint32_t>();
+  uint32_t Semantics = getValue(Inst->getOperand(PtrOp + 2)).get<uint32_t>();
 
   // Get value operand if present.
   T Value = 0;
   if (Inst->getNumOperands() > (PtrOp + 3))
-    Value = Objects[Inst->getOperand(PtrOp + 3)].get<T>();
+    Value = getValue(Inst->getOperand(PtrOp + 3)).get<T>();
+
+  // Helper invocations only observe the current value.
+  uint32_t Opcode = Inst->getOpcode();
+  if (skipHelperWrite(Pointer.getType()->getStorageClass()))
+  {
+    if (Opcode == SpvOpAtomicStore)
+      return;
+    Opcode = SpvOpAtomicLoad;
+  }
 
   // Perform atomic operation.
   Memory &Mem = getMemory(Pointer.getType()->getStorageClass());
-  T Result = Mem.atomic<T>(Pointer.get<uint64_t>(), Inst->getOpcode(), Scope,
-                           Semantics, Value);
+  T Result =
+      Mem.atomic<T>(Pointer.get<uint64_t>(), Opcode, Scope, Semantics, Value);
 
   // Create result if necessary.
   if (PtrOp == 2)
-    Objects[Inst->getOperand(1)] = Object(Inst->getResultType(), Result);
+  {
+    getLocal(Inst->getOperand(1)).reset(Inst->getResultType());
+    getLocal(Inst->getOperand(1)).set(Result);
+  }
 }
 
-void Invocation::executeAtomicCompareExchange(const Instruction *Inst)
+template <typename T>
+void Invocation::executeAtomicCompareExchange(const DecodedInstruction *Inst)
 {
-  Object Pointer = Objects[Inst->getOperand(2)];
-  uint32_t Scope = Objects[Inst->getOperand(3)].get<uint32_t>();
-  uint32_t EqualSemantics = Objects[Inst->getOperand(4)].get<uint32_t>();
-  uint32_t UnequalSemantics = Objects[Inst->getOperand(5)].get<uint32_t>();
-  uint32_t Value = Objects[Inst->getOperand(6)].get<uint32_t>();
-  uint32_t Comparator = Objects[Inst->getOperand(7)].get<uint32_t>();
+  Object Pointer = getValue(Inst->getOperand(2));
+  uint32_t Scope = getValue(Inst->getOperand(3)).get<uint32_t>();
+  uint32_t EqualSemantics = getValue(Inst->getOperand(4)).get<uint32_t>();
+  uint32_t UnequalSemantics = getValue(Inst->getOperand(5)).get<uint32_t>();
+  T Value = getValue(Inst->getOperand(6)).get<T>();
+  T Comparator = getValue(Inst->getOperand(7)).get<T>();
 
   Memory &Mem = getMemory(Pointer.getType()->getStorageClass());
-  uint32_t Result =
-      Mem.atomicCmpXchg(Pointer.get<uint64_t>(), Scope, EqualSemantics,
-                        UnequalSemantics, Value, Comparator);
-  Objects[Inst->getOperand(1)] = Object(Inst->getResultType(), Result);
+  T Result;
+  if (skipHelperWrite(Pointer.getType()->getStorageClass()))
+    Result = Mem.atomic<T>(Pointer.get<uint64_t>(), SpvOpAtomicLoad, Scope,
+                           UnequalSemantics);
+  else
+    Result = Mem.atomicCmpXchg<T>(Pointer.get<uint64_t>(), Scope,
+                                  EqualSemantics, UnequalSemantics, Value,
+                                  Comparator);
+  getLocal(Inst->getOperand(1)).reset(Inst->getResultType());
+  getLocal(Inst->getOperand(1)).set(Result);
 }
 
-void Invocation::executeBitcast(const Instruction *Inst)
+void Invocation::executeBitcast(const DecodedInstruction *Inst)
 {
-  const Object &Source = Objects[Inst->getOperand(2)];
-  Object Result = Object(Inst->getResultType(), Source.getData());
-  Objects[Inst->getOperand(1)] = Result;
+  const Object &Source = getValue(Inst->getOperand(2));
+  Object &Result = getLocal(Inst->getOperand(1));
+  Result.reset(Inst->getResultType());
+  memcpy(Result.getData(), Source.getData(), Inst->getResultType()->getSize());
 }
 
-void Invocation::executeBitwiseAnd(const Instruction *Inst)
+template <typename T>
+void Invocation::executeBitwiseAnd(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A & B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A & B; });
 }
 
-void Invocation::executeBitwiseOr(const Instruction *Inst)
+template <typename T>
+void Invocation::executeBitwiseOr(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A | B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A | B; });
 }
 
-void Invocation::executeBitwiseXor(const Instruction *Inst)
+template <typename T>
+void Invocation::executeBitwiseXor(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A ^ B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A ^ B; });
 }
 
-void Invocation::executeBranch(const Instruction *Inst)
+void Invocation::executeBranch(const DecodedInstruction *Inst)
 {
-  moveToBlock(Inst->getOperand(0));
+  moveToBlock(Inst->getTarget(0));
 }
 
-void Invocation::executeBranchConditional(const Instruction *Inst)
+void Invocation::executeBranchConditional(const DecodedInstruction *Inst)
 {
   bool Condition = OP(0, bool);
-  moveToBlock(Inst->getOperand(Condition ? 1 : 2));
+  moveToBlock(Inst->getTarget(Condition ? 0 : 1));
 }
 
-void Invocation::executeCompositeConstruct(const Instruction *Inst)
+void Invocation::executeCompositeConstruct(const DecodedInstruction *Inst)
 {
-  uint32_t Id = Inst->getOperand(1);
-
-  Object Result = Object(Inst->getResultType());
+  Object &Result = getLocal(Inst->getOperand(1));
+  Result.reset(Inst->getResultType());
 
   // Set constituent values.
   for (uint32_t i = 2; i < Inst->getNumOperands(); i++)
   {
     uint32_t Id = Inst->getOperand(i);
-    Result.insert({i - 2}, Objects[Id]);
+    Result.insert({i - 2}, getValue(Id));
   }
-
-  Objects[Id] = Result;
 }
 
-void Invocation::executeCompositeExtract(const Instruction *Inst)
+void Invocation::executeCompositeExtract(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   // TODO: Handle indices of different sizes.
   std::vector<uint32_t> Indices(Inst->getOperands() + 3,
                                 Inst->getOperands() + Inst->getNumOperands());
-  Objects[Id] = Objects[Inst->getOperand(2)].extract(Indices);
+  getLocal(Id) = getValue(Inst->getOperand(2)).extract(Indices);
 }
 
-void Invocation::executeCompositeInsert(const Instruction *Inst)
+void Invocation::executeCompositeInsert(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
-  Object &Element = Objects[Inst->getOperand(2)];
+  const Object &Element = getValue(Inst->getOperand(2));
   // TODO: Handle indices of different sizes.
   std::vector<uint32_t> Indices(Inst->getOperands() + 4,
                                 Inst->getOperands() + Inst->getNumOperands());
-  assert(Objects[Inst->getOperand(3)].getType()->isComposite());
-  Objects[Id] = Objects[Inst->getOperand(3)];
-  Objects[Id].insert(Indices, Element);
+  assert(getValue(Inst->getOperand(3)).getType()->isComposite());
+  getLocal(Id) = getValue(Inst->getOperand(3));
+  getLocal(Id).insert(Indices, Element);
 }
 
-void Invocation::executeControlBarrier(const Instruction *Inst)
+void Invocation::executeControlBarrier(const DecodedInstruction *Inst)
 {
   // TODO: Handle other execution scopes
-  assert(Objects[Inst->getOperand(0)].get<uint32_t>() == SpvScopeWorkgroup);
+  assert(getValue(Inst->getOperand(0)).get<uint32_t>() == SpvScopeWorkgroup);
   AtBarrier = true;
 }
 
-void Invocation::executeConvertFToS(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeConvertFToS(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getScalarType()->getBitWidth())
-  {
-  case 16:
-    executeOpFP<1>(Inst, [](auto A) -> int16_t { return (int16_t)A; });
-    break;
-  case 32:
-    executeOpFP<1>(Inst, [](auto A) -> int32_t { return (int32_t)A; });
-    break;
-  case 64:
-    executeOpFP<1>(Inst, [](auto A) -> int64_t { return (int64_t)A; });
-    break;
-  default:
-    assert(false && "Unhandled integer size for OpConvertFToS");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeConvertFToU(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeConvertFToU(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getScalarType()->getBitWidth())
-  {
-  case 16:
-    executeOpFP<1>(Inst, [](auto A) -> uint16_t { return (uint16_t)A; });
-    break;
-  case 32:
-    executeOpFP<1>(Inst, [](auto A) -> uint32_t { return (uint32_t)A; });
-    break;
-  case 64:
-    executeOpFP<1>(Inst, [](auto A) -> uint64_t { return (uint64_t)A; });
-    break;
-  default:
-    assert(false && "Unhandled integer size for OpConvertFToU");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeConvertSToF(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeConvertSToF(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getScalarType()->getBitWidth())
-  {
-  case 32:
-    executeOpSInt<1>(Inst, [](auto A) -> float { return (float)A; });
-    break;
-  case 64:
-    executeOpSInt<1>(Inst, [](auto A) -> double { return (double)A; });
-    break;
-  default:
-    assert(false && "Unhandled floating point size for OpConvertUToF");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeConvertUToF(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeConvertUToF(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getScalarType()->getBitWidth())
-  {
-  case 32:
-    executeOpUInt<1>(Inst, [](auto A) -> float { return (float)A; });
-    break;
-  case 64:
-    executeOpUInt<1>(Inst, [](auto A) -> double { return (double)A; });
-    break;
-  default:
-    assert(false && "Unhandled floating point size for OpConvertUToF");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeCopyMemory(const Instruction *Inst)
+void Invocation::executeCopyMemory(const DecodedInstruction *Inst)
 {
-  const Object &Dst = Objects[Inst->getOperand(0)];
-  const Object &Src = Objects[Inst->getOperand(1)];
+  const Object &Dst = getValue(Inst->getOperand(0));
+  const Object &Src = getValue(Inst->getOperand(1));
 
   const Type *DstType = Dst.getType();
   const Type *SrcType = Src.getType();
   assert(DstType->getElementType() == SrcType->getElementType());
+  if (skipHelperWrite(DstType->getStorageClass()))
+    return;
 
   Memory &DstMem = getMemory(DstType->getStorageClass());
   Memory &SrcMem = getMemory(SrcType->getStorageClass());
@@ -628,226 +903,252 @@ void Invocation::executeCopyMemory(const Instruction *Inst)
   Memory::copy(DstAddress, DstMem, SrcAddress, SrcMem, NumBytes);
 }
 
-void Invocation::executeCopyObject(const Instruction *Inst)
+void Invocation::executeCopyObject(const DecodedInstruction *Inst)
 {
-  Objects[Inst->getOperand(1)] = Objects[Inst->getOperand(2)];
+  getLocal(Inst->getOperand(1)) = getValue(Inst->getOperand(2));
 }
 
-void Invocation::executeDot(const Instruction *Inst)
+template <typename T>
+void Invocation::executeDPdx(const DecodedInstruction *Inst)
 {
-  Object &A = Objects[Inst->getOperand(2)];
-  Object &B = Objects[Inst->getOperand(3)];
-  switch (Inst->getResultType()->getBitWidth())
-  {
-  case 32:
-  {
-    float Result = 0.f;
-    for (uint32_t i = 0; i < A.getType()->getElementCount(); i++)
-      Result += A.get<float>(i) * B.get<float>(i);
-    Objects[Inst->getOperand(1)] = Object(Inst->getResultType(), Result);
-    break;
-  }
-  case 64:
-  {
-    double Result = 0.0;
-    for (uint32_t i = 0; i < A.getType()->getElementCount(); i++)
-      Result += A.get<double>(i) * B.get<double>(i);
-    Objects[Inst->getOperand(1)] = Object(Inst->getResultType(), Result);
-    break;
-  }
-  default:
-    assert(false && "Unhandled floating point size for OpDot");
-  }
+  executeDerivative<T>(Inst, false, true, false);
+}
+
+template <typename T>
+void Invocation::executeDPdxCoarse(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, true, true, false);
+}
+
+template <typename T>
+void Invocation::executeDPdxFine(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, false, true, false);
+}
+
+template <typename T>
+void Invocation::executeDPdy(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, false, false, true);
+}
+
+template <typename T>
+void Invocation::executeDPdyCoarse(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, true, false, true);
+}
+
+template <typename T>
+void Invocation::executeDPdyFine(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, false, false, true);
 }
 
-void Invocation::executeExtInst(const Instruction *Inst)
+template <typename T>
+void Invocation::executeDot(const DecodedInstruction *Inst)
+{
+  const Object &A = getValue(Inst->getOperand(2));
+  const Object &B = getValue(Inst->getOperand(3));
+  T Result = 0;
+  for (uint32_t i = 0; i < A.getType()->getElementCount(); i++)
+    Result += A.get<T>(i) * B.get<T>(i);
+  getLocal(Inst->getOperand(1)).reset(Inst->getResultType());
+  getLocal(Inst->getOperand(1)).set(Result);
+}
+
+template <typename T>
+void Invocation::executeExtInst(const DecodedInstruction *Inst)
 {
   // TODO: Currently assumes extended instruction set is GLSL.std.450
   uint32_t ExtInst = Inst->getOperand(3);
   switch (ExtInst)
   {
   case GLSLstd450Acos:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return acos(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return acos(X); });
     break;
   case GLSLstd450Acosh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return acosh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return acosh(X); });
     break;
   case GLSLstd450Asin:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return asin(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return asin(X); });
     break;
   case GLSLstd450Asinh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return asinh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return asinh(X); });
     break;
   case GLSLstd450Atan:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return atan(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return atan(X); });
     break;
   case GLSLstd450Atanh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return atanh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return atanh(X); });
     break;
   case GLSLstd450Atan2:
-    executeOpFP<2, 4>(
+    executeOp<T, 2, 4>(
         Inst, [](auto Y, auto X) -> decltype(X) { return atan2(Y, X); });
     break;
   case GLSLstd450Cos:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return cos(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return cos(X); });
     break;
   case GLSLstd450Cosh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return cosh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return cosh(X); });
     break;
   case GLSLstd450FAbs:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return fabs(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return fabs(X); });
     break;
   case GLSLstd450Fma:
   {
-    executeOpFP<3, 4>(
+    executeOp<T, 3, 4>(
         Inst, [](auto A, auto B, auto C) -> decltype(A) { return A * B + C; });
     break;
   }
   case GLSLstd450Floor:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return floor(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return floor(X); });
     break;
   case GLSLstd450InverseSqrt:
-    executeOpFP<1, 4>(Inst,
+    executeOp<T, 1, 4>(Inst,
                       [](auto X) -> decltype(X) { return 1.f / sqrt(X); });
     break;
   case GLSLstd450NClamp:
-    executeOpFP<3, 4>(Inst, [](auto X, auto Min, auto Max) -> decltype(X) {
+    executeOp<T, 3, 4>(Inst, [](auto X, auto Min, auto Max) -> decltype(X) {
       return fmin(fmax(X, Min), Max);
     });
     break;
   case GLSLstd450FMax:
   case GLSLstd450NMax:
-    executeOpFP<2, 4>(Inst,
+    executeOp<T, 2, 4>(Inst,
                       [](auto X, auto Y) -> decltype(X) { return fmax(X, Y); });
     break;
   case GLSLstd450FMin:
   case GLSLstd450NMin:
-    executeOpFP<2, 4>(Inst,
+    executeOp<T, 2, 4>(Inst,
                       [](auto X, auto Y) -> decltype(X) { return fmin(X, Y); });
     break;
   case GLSLstd450Sin:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return sin(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return sin(X); });
     break;
   case GLSLstd450Sinh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return sinh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return sinh(X); });
     break;
   case GLSLstd450Sqrt:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return sqrt(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return sqrt(X); });
     break;
   case GLSLstd450Tan:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return tan(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return tan(X); });
     break;
   case GLSLstd450Tanh:
-    executeOpFP<1, 4>(Inst, [](auto X) -> decltype(X) { return tanh(X); });
+    executeOp<T, 1, 4>(Inst, [](auto X) -> decltype(X) { return tanh(X); });
     break;
   default:
     Dev.reportError("Unimplemented GLSL.std.450 extended instruction", true);
   }
 }
 
-void Invocation::executeFAdd(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFAdd(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> decltype(A) { return A + B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A + B; });
 }
 
-void Invocation::executeFConvert(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeFConvert(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getBitWidth())
-  {
-  case 32:
-    executeOpFP<1>(Inst, [](auto A) -> float { return (float)A; });
-    break;
-  case 64:
-    executeOpFP<1>(Inst, [](auto A) -> double { return (double)A; });
-    break;
-  default:
-    assert(false && "Unhandled floating point size for OpFConvert");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeFDiv(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFDiv(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
 }
 
-void Invocation::executeFMod(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFMod(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> decltype(A) {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) {
     return A - (B * floor(A / B));
   });
 }
 
-void Invocation::executeFMul(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFMul(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> decltype(A) { return A * B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A * B; });
 }
 
-void Invocation::executeFNegate(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFNegate(const DecodedInstruction *Inst)
 {
-  executeOpFP<1>(Inst, [](auto A) -> decltype(A) { return -A; });
+  executeOp<T, 1>(Inst, [](auto A) -> decltype(A) { return -A; });
 }
 
-void Invocation::executeFOrdEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A == B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFOrdGreaterThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdGreaterThan(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A > B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFOrdGreaterThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdGreaterThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A >= B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFOrdLessThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdLessThan(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A < B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFOrdLessThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdLessThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A <= B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFOrdNotEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFOrdNotEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A != B && !std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFRem(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFRem(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst,
+  executeOp<T, 2>(Inst,
                  [](auto A, auto B) -> decltype(A) { return fmod(A, B); });
 }
 
-void Invocation::executeFSub(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFSub(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> decltype(A) { return A - B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A - B; });
 }
 
-void Invocation::executeFunctionCall(const Instruction *Inst)
+void Invocation::executeFunctionCall(const DecodedInstruction *Inst)
 {
-  const Function *Func = CurrentModule->getFunction(Inst->getOperand(2));
+  const Function *Func = CurrentStage->getFunction(Inst->getOperand(2));
 
   // Copy function parameters.
   assert(Inst->getNumOperands() == Func->getNumParams() + 3);
   for (int i = 3; i < Inst->getNumOperands(); i++)
-    Objects[Func->getParamId(i - 3)] = Objects[Inst->getOperand(i)];
+    getLocal(Func->getParamId(i - 3)) = getValue(Inst->getOperand(i));
 
   // Create call stack entry.
   StackEntry SE;
@@ -861,72 +1162,98 @@ void Invocation::executeFunctionCall(const Instruction *Inst)
   moveToBlock(CurrentFunction->getFirstBlockId());
 }
 
-void Invocation::executeFUnordEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A == B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFUnordGreaterThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordGreaterThan(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A > B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFUnordGreaterThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordGreaterThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A >= B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFUnordLessThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordLessThan(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A < B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFUnordLessThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordLessThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A <= B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeFUnordNotEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFUnordNotEqual(const DecodedInstruction *Inst)
 {
-  executeOpFP<2>(Inst, [](auto A, auto B) -> bool {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool {
     return A != B || std::isunordered(A, B);
   });
 }
 
-void Invocation::executeIAdd(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFwidth(const DecodedInstruction *Inst)
+{
+  executeDerivative<T>(Inst, false, true, true);
+}
+
+template <typename T>
+void Invocation::executeFwidthCoarse(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A + B; });
+  executeDerivative<T>(Inst, true, true, true);
 }
 
-void Invocation::executeIEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeFwidthFine(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A == B; });
+  executeDerivative<T>(Inst, false, true, true);
 }
 
-void Invocation::executeImage(const Instruction *Inst)
+template <typename T>
+void Invocation::executeIAdd(const DecodedInstruction *Inst)
+{
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A + B; });
+}
+
+template <typename T>
+void Invocation::executeIEqual(const DecodedInstruction *Inst)
+{
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A == B; });
+}
+
+void Invocation::executeImage(const DecodedInstruction *Inst)
 {
   // Extract image object from a sampled image.
-  const Object &SampledImageObj = Objects[Inst->getOperand(2)];
+  const Object &SampledImageObj = getValue(Inst->getOperand(2));
   const SampledImage *SI = (const SampledImage *)(SampledImageObj.getData());
-  Objects[Inst->getOperand(1)] =
+  getLocal(Inst->getOperand(1)) =
       Object(SampledImageObj.getType()->getElementType(),
              (const uint8_t *)&(SI->Image));
 }
 
-void Invocation::executeImageQuerySize(const Instruction *Inst)
+void Invocation::executeImageQuerySize(const DecodedInstruction *Inst)
 {
   // Get image view object.
-  const Object &ImageObj = Objects[Inst->getOperand(2)];
+  const Object &ImageObj = getValue(Inst->getOperand(2));
   const ImageView *Image = *(const ImageView **)(ImageObj.getData());
 
   Object Result(Inst->getResultType());
@@ -935,7 +1262,7 @@ void Invocation::executeImageQuerySize(const Instruction *Inst)
   // Get mip level (if explicit).
   uint32_t Level = 0;
   if (Inst->getOpcode() == SpvOpImageQuerySizeLod)
-    Level = Objects[Inst->getOperand(3)].get<uint32_t>();
+    Level = getValue(Inst->getOperand(3)).get<uint32_t>();
 
   // Get size in each dimension.
   uint32_t ArraySizeIndex;
@@ -973,20 +1300,20 @@ void Invocation::executeImageQuerySize(const Instruction *Inst)
       Result.set<uint32_t>(Image->getNumArrayLayers(), ArraySizeIndex);
   }
 
-  Objects[Inst->getOperand(1)] = Result;
+  getLocal(Inst->getOperand(1)) = Result;
 }
 
-void Invocation::executeImageRead(const Instruction *Inst)
+void Invocation::executeImageRead(const DecodedInstruction *Inst)
 {
   // Get image view object.
-  const Object &ImageObj = Objects[Inst->getOperand(2)];
+  const Object &ImageObj = getValue(Inst->getOperand(2));
   const ImageView *Image = *(const ImageView **)(ImageObj.getData());
 
   // TODO: Handle subpass data dimensionality
   assert(ImageObj.getType()->getDimensionality() != SpvDimSubpassData);
 
   // Get coordinate operand.
-  const Object &Coord = Objects[Inst->getOperand(3)];
+  const Object &Coord = getValue(Inst->getOperand(3));
   const Type *CoordType = Coord.getType();
   uint32_t NumCoords = CoordType->getElementCount();
   assert(NumCoords <= 3);
@@ -1011,7 +1338,7 @@ void Invocation::executeImageRead(const Instruction *Inst)
 
     if (OperandMask & SpvImageOperandsLodMask)
     {
-      Level = Objects[Inst->getOperand(OpIdx++)].get<uint32_t>();
+      Level = getValue(Inst->getOperand(OpIdx++)).get<uint32_t>();
       OperandMask ^= SpvImageOperandsLodMask;
     }
 
@@ -1024,20 +1351,20 @@ void Invocation::executeImageRead(const Instruction *Inst)
   // Read texel from image.
   Image::Texel T;
   Image->read(T, X, Y, Z, Layer, Level);
-  Objects[Inst->getOperand(1)] = T.toObject(Inst->getResultType());
+  getLocal(Inst->getOperand(1)) = T.toObject(Inst->getResultType());
 }
 
-void Invocation::executeImageSampleExplicitLod(const Instruction *Inst)
+void Invocation::executeImageSampleExplicitLod(const DecodedInstruction *Inst)
 {
   // Get sampler and image view objects.
-  const Object &SampledImageObj = Objects[Inst->getOperand(2)];
+  const Object &SampledImageObj = getValue(Inst->getOperand(2));
   const SampledImage *SI = (const SampledImage *)(SampledImageObj.getData());
   const ImageView *Image = SI->Image;
   const Sampler *Sampler = SI->Sampler;
   const Type *ImageType = SampledImageObj.getType()->getElementType();
 
   // Get coordinate operand.
-  const Object &Coord = Objects[Inst->getOperand(3)];
+  const Object &Coord = getValue(Inst->getOperand(3));
   const Type *CoordType = Coord.getType();
   uint32_t NumCoords = CoordType->getElementCount();
   assert(CoordType->getScalarType()->isFloat());
@@ -1058,25 +1385,29 @@ void Invocation::executeImageSampleExplicitLod(const Instruction *Inst)
   // TODO: Handle Lod properly
   assert(Inst->getNumOperands() == 6);
   assert(Inst->getOperand(4) == SpvImageOperandsLodMask);
-  assert(Objects[Inst->getOperand(5)].get<float>() == 0);
+  assert(getValue(Inst->getOperand(5)).get<float>() == 0);
 
   // Sample texel from image.
   Image::Texel Texel;
   Sampler->sample(Image, Texel, X, Y, Z, Layer);
-  Objects[Inst->getOperand(1)] = Texel.toObject(Inst->getResultType());
+  getLocal(Inst->getOperand(1)) = Texel.toObject(Inst->getResultType());
 }
 
-void Invocation::executeImageWrite(const Instruction *Inst)
+void Invocation::executeImageWrite(const DecodedInstruction *Inst)
 {
+  // Helper invocations must not write to images.
+  if (Helper)
+    return;
+
   // Get image view object.
-  const Object &ImageObj = Objects[Inst->getOperand(0)];
+  const Object &ImageObj = getValue(Inst->getOperand(0));
   const ImageView *Image = *(const ImageView **)(ImageObj.getData());
 
   // TODO: Handle additional operands
   assert(Inst->getNumOperands() == 3);
 
   // Get coordinate operand.
-  const Object &Coord = Objects[Inst->getOperand(1)];
+  const Object &Coord = getValue(Inst->getOperand(1));
   const Type *CoordType = Coord.getType();
   uint32_t NumCoords = CoordType->getElementCount();
   assert(NumCoords <= 3);
@@ -1093,78 +1424,83 @@ void Invocation::executeImageWrite(const Instruction *Inst)
   uint32_t Z = (NumCoords > 2) ? Coord.get<uint32_t>(2) : 0;
 
   // Write texel to image.
-  const Object &Texel = Objects[Inst->getOperand(2)];
+  const Object &Texel = getValue(Inst->getOperand(2));
   Image->write(Texel, X, Y, Z, Layer);
 }
 
-void Invocation::executeIMul(const Instruction *Inst)
+template <typename T>
+void Invocation::executeIMul(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A * B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A * B; });
 }
 
-void Invocation::executeINotEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeINotEqual(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A != B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A != B; });
 }
 
-void Invocation::executeIsInf(const Instruction *Inst)
+template <typename T>
+void Invocation::executeIsInf(const DecodedInstruction *Inst)
 {
-  executeOpFP<1>(Inst, [](auto A) -> bool { return std::isinf(A); });
+  executeOp<T, 1>(Inst, [](auto A) -> bool { return std::isinf(A); });
 }
 
-void Invocation::executeIsNan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeIsNan(const DecodedInstruction *Inst)
 {
-  executeOpFP<1>(Inst, [](auto A) -> bool { return std::isnan(A); });
+  executeOp<T, 1>(Inst, [](auto A) -> bool { return std::isnan(A); });
 }
 
-void Invocation::executeISub(const Instruction *Inst)
+template <typename T>
+void Invocation::executeISub(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A - B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A - B; });
 }
 
-void Invocation::executeKill(const Instruction *Inst)
+void Invocation::executeKill(const DecodedInstruction *Inst)
 {
   Discarded = true;
   CurrentInstruction = nullptr;
 }
 
-void Invocation::executeLoad(const Instruction *Inst)
+void Invocation::executeLoad(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
-  const Object &Src = Objects[Inst->getOperand(2)];
+  const Object &Src = getValue(Inst->getOperand(2));
   Memory &Mem = getMemory(Src.getType()->getStorageClass());
-  Objects[Id] = Object::load(Inst->getResultType(), Mem, Src);
+  getLocal(Id).loadFrom(Inst->getResultType(), Mem, Src, Inst->isInBounds());
 }
 
-void Invocation::executeLogicalAnd(const Instruction *Inst)
+void Invocation::executeLogicalAnd(const DecodedInstruction *Inst)
 {
   executeOp<bool, 2>(Inst, [](bool A, bool B) { return A && B; });
 }
 
-void Invocation::executeLogicalEqual(const Instruction *Inst)
+void Invocation::executeLogicalEqual(const DecodedInstruction *Inst)
 {
   executeOp<bool, 2>(Inst, [](bool A, bool B) { return A == B; });
 }
 
-void Invocation::executeLogicalNot(const Instruction *Inst)
+void Invocation::executeLogicalNot(const DecodedInstruction *Inst)
 {
   executeOp<bool, 1>(Inst, [](bool A) { return !A; });
 }
 
-void Invocation::executeLogicalNotEqual(const Instruction *Inst)
+void Invocation::executeLogicalNotEqual(const DecodedInstruction *Inst)
 {
   executeOp<bool, 2>(Inst, [](bool A, bool B) { return A != B; });
 }
 
-void Invocation::executeLogicalOr(const Instruction *Inst)
+void Invocation::executeLogicalOr(const DecodedInstruction *Inst)
 {
   executeOp<bool, 2>(Inst, [](bool A, bool B) { return A || B; });
 }
 
-void Invocation::executeMatrixTimesScalar(const Instruction *Inst)
+void Invocation::executeMatrixTimesScalar(const DecodedInstruction *Inst)
 {
-  Object Matrix = Objects[Inst->getOperand(2)];
-  Object Scalar = Objects[Inst->getOperand(3)];
+  Object Matrix = getValue(Inst->getOperand(2));
+  Object Scalar = getValue(Inst->getOperand(3));
   const Type *MatrixType = Matrix.getType();
   const Type *VectorType = MatrixType->getElementType();
   const Type *ScalarType = VectorType->getElementType();
@@ -1191,13 +1527,13 @@ void Invocation::executeMatrixTimesScalar(const Instruction *Inst)
     }
   }
 
-  Objects[Inst->getOperand(1)] = Matrix;
+  getLocal(Inst->getOperand(1)) = Matrix;
 }
 
-void Invocation::executeMatrixTimesVector(const Instruction *Inst)
+void Invocation::executeMatrixTimesVector(const DecodedInstruction *Inst)
 {
-  Object Matrix = Objects[Inst->getOperand(2)];
-  Object Vector = Objects[Inst->getOperand(3)];
+  Object Matrix = getValue(Inst->getOperand(2));
+  Object Vector = getValue(Inst->getOperand(3));
   const Type *MatrixType = Matrix.getType();
   const Type *ColumnType = MatrixType->getElementType();
   const Type *ScalarType = Inst->getResultType()->getElementType();
@@ -1229,15 +1565,18 @@ void Invocation::executeMatrixTimesVector(const Instruction *Inst)
       break;
     }
   }
-  Objects[Inst->getOperand(1)] = Result;
+  getLocal(Inst->getOperand(1)) = Result;
 }
 
-void Invocation::executeNot(const Instruction *Inst)
+void Invocation::executeNop(const DecodedInstruction *Inst) {}
+
+template <typename T>
+void Invocation::executeNot(const DecodedInstruction *Inst)
 {
-  executeOpUInt<1>(Inst, [](auto A) -> decltype(A) { return ~A; });
+  executeOp<T, 1>(Inst, [](auto A) -> decltype(A) { return ~A; });
 }
 
-void Invocation::executePhi(const Instruction *Inst)
+void Invocation::executePhi(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
 
@@ -1247,18 +1586,21 @@ void Invocation::executePhi(const Instruction *Inst)
     assert(i + 1 < Inst->getNumOperands());
     if (Inst->getOperand(i + 1) == PreviousBlock)
     {
-      PhiTemps.push_back({Id, Objects[Inst->getOperand(i)]});
+      PhiTemps.push_back({Id, getValue(Inst->getOperand(i))});
       return;
     }
   }
   assert(false && "no matching predecessor block for OpPhi");
 }
 
-void Invocation::executeReturn(const Instruction *Inst)
+void Invocation::executeReturn(const DecodedInstruction *Inst)
 {
-  // If this is the entry function, do nothing.
+  // If this is the entry function, the invocation has finished.
   if (CallStack.empty())
+  {
+    CurrentInstruction = nullptr;
     return;
+  }
 
   StackEntry SE = CallStack.back();
   CallStack.pop_back();
@@ -1270,10 +1612,10 @@ void Invocation::executeReturn(const Instruction *Inst)
   // Return to calling function.
   CurrentFunction = SE.CallFunc;
   CurrentBlock = SE.CallBlock;
-  CurrentInstruction = SE.CallInst->next();
+  CurrentInstruction = SE.CallInst + 1;
 }
 
-void Invocation::executeReturnValue(const Instruction *Inst)
+void Invocation::executeReturnValue(const DecodedInstruction *Inst)
 {
   assert(!CallStack.empty());
 
@@ -1281,7 +1623,7 @@ void Invocation::executeReturnValue(const Instruction *Inst)
   CallStack.pop_back();
 
   // Set return value.
-  Objects[SE.CallInst->getOperand(1)] = Objects[Inst->getOperand(0)];
+  getLocal(SE.CallInst->getOperand(1)) = getValue(Inst->getOperand(0));
 
   // Release function scope allocations.
   for (uint64_t Address : SE.Allocations)
@@ -1290,59 +1632,48 @@ void Invocation::executeReturnValue(const Instruction *Inst)
   // Return to calling function.
   CurrentFunction = SE.CallFunc;
   CurrentBlock = SE.CallBlock;
-  CurrentInstruction = SE.CallInst->next();
+  CurrentInstruction = SE.CallInst + 1;
 }
 
-void Invocation::executeSampledImage(const Instruction *Inst)
+void Invocation::executeSampledImage(const DecodedInstruction *Inst)
 {
   // Get image view object.
-  const Object &ImageObj = Objects[Inst->getOperand(2)];
+  const Object &ImageObj = getValue(Inst->getOperand(2));
   const ImageView *Image = *(const ImageView **)(ImageObj.getData());
 
   // Get sampler object.
-  const Object &SamplerObj = Objects[Inst->getOperand(3)];
+  const Object &SamplerObj = getValue(Inst->getOperand(3));
   const Sampler *Sampler = *(const talvos::Sampler **)(SamplerObj.getData());
 
   // Create and populate SampledImage structure.
   Object Result(Inst->getResultType());
   ((SampledImage *)(Result.getData()))->Image = Image;
   ((SampledImage *)(Result.getData()))->Sampler = Sampler;
-  Objects[Inst->getOperand(1)] = Result;
+  getLocal(Inst->getOperand(1)) = Result;
 }
 
-void Invocation::executeSConvert(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeSConvert(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getBitWidth())
-  {
-  case 16:
-    executeOpSInt<1>(Inst, [](auto A) -> int16_t { return (int16_t)A; });
-    break;
-  case 32:
-    executeOpSInt<1>(Inst, [](auto A) -> int32_t { return (int32_t)A; });
-    break;
-  case 64:
-    executeOpSInt<1>(Inst, [](auto A) -> int64_t { return (int64_t)A; });
-    break;
-  default:
-    assert(false && "Unhandled integer size for OpSConvert");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeSDiv(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSDiv(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
 }
 
-void Invocation::executeSelect(const Instruction *Inst)
+void Invocation::executeSelect(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
-  const Object &Condition = Objects[Inst->getOperand(2)];
-  const Object &Object1 = Objects[Inst->getOperand(3)];
-  const Object &Object2 = Objects[Inst->getOperand(4)];
+  const Object &Condition = getValue(Inst->getOperand(2));
+  const Object &Object1 = getValue(Inst->getOperand(3));
+  const Object &Object2 = getValue(Inst->getOperand(4));
 
   if (Condition.getType()->isScalar())
   {
-    Objects[Id] = Condition.get<bool>() ? Object1 : Object2;
+    getLocal(Id) = Condition.get<bool>() ? Object1 : Object2;
   }
   else
   {
@@ -1352,73 +1683,85 @@ void Invocation::executeSelect(const Instruction *Inst)
       Result.insert({i}, Condition.get<bool>(i) ? Object1.extract({i})
                                                 : Object2.extract({i}));
     }
-    Objects[Id] = Result;
+    getLocal(Id) = Result;
   }
 }
 
-void Invocation::executeSGreaterThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSGreaterThan(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> bool { return A > B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A > B; });
 }
 
-void Invocation::executeSGreaterThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSGreaterThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> bool { return A >= B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A >= B; });
 }
 
-void Invocation::executeShiftLeftLogical(const Instruction *Inst)
+template <typename T>
+void Invocation::executeShiftLeftLogical(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A << B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A << B; });
 }
 
-void Invocation::executeShiftRightArithmetic(const Instruction *Inst)
+template <typename T>
+void Invocation::executeShiftRightArithmetic(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A >> B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A >> B; });
 }
 
-void Invocation::executeShiftRightLogical(const Instruction *Inst)
+template <typename T>
+void Invocation::executeShiftRightLogical(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A >> B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A >> B; });
 }
 
-void Invocation::executeSLessThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSLessThan(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> bool { return A < B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A < B; });
 }
 
-void Invocation::executeSLessThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSLessThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> bool { return A <= B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A <= B; });
 }
 
-void Invocation::executeSMod(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSMod(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> decltype(A) {
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) {
     return (std::abs(A) % B) * (B < 0 ? -1 : 1);
   });
 }
 
-void Invocation::executeSNegate(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSNegate(const DecodedInstruction *Inst)
 {
-  executeOpSInt<1>(Inst, [](auto A) -> decltype(A) { return -A; });
+  executeOp<T, 1>(Inst, [](auto A) -> decltype(A) { return -A; });
 }
 
-void Invocation::executeSRem(const Instruction *Inst)
+template <typename T>
+void Invocation::executeSRem(const DecodedInstruction *Inst)
 {
-  executeOpSInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A % B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A % B; });
 }
 
-void Invocation::executeStore(const Instruction *Inst)
+void Invocation::executeStore(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
-  const Object &Dest = Objects[Inst->getOperand(0)];
+  const Object &Dest = getValue(Inst->getOperand(0));
+  if (skipHelperWrite(Dest.getType()->getStorageClass()))
+    return;
   Memory &Mem = getMemory(Dest.getType()->getStorageClass());
-  Objects[Id].store(Mem, Dest);
+  getValue(Id).store(Mem, Dest, Inst->isInBounds());
 }
 
-void Invocation::executeSwitch(const Instruction *Inst)
+void Invocation::executeSwitch(const DecodedInstruction *Inst)
 {
-  const Object &Selector = Objects[Inst->getOperand(0)];
+  const Object &Selector = getValue(Inst->getOperand(0));
 
   // TODO: Handle other selector sizes
   if (Selector.getType()->getBitWidth() != 32)
@@ -1428,94 +1771,97 @@ void Invocation::executeSwitch(const Instruction *Inst)
   {
     if (Selector.get<uint32_t>() == Inst->getOperand(i))
     {
-      moveToBlock(Inst->getOperand(i + 1));
+      moveToBlock(Inst->getTarget(i / 2));
       return;
     }
   }
-  moveToBlock(Inst->getOperand(1));
+  moveToBlock(Inst->getTarget(0));
 }
 
-void Invocation::executeUConvert(const Instruction *Inst)
+template <typename T, typename R>
+void Invocation::executeUConvert(const DecodedInstruction *Inst)
 {
-  switch (Inst->getResultType()->getBitWidth())
-  {
-  case 16:
-    executeOpUInt<1>(Inst, [](auto A) -> uint16_t { return (uint16_t)A; });
-    break;
-  case 32:
-    executeOpUInt<1>(Inst, [](auto A) -> uint32_t { return (uint32_t)A; });
-    break;
-  case 64:
-    executeOpUInt<1>(Inst, [](auto A) -> uint64_t { return (uint64_t)A; });
-    break;
-  default:
-    assert(false && "Unhandled integer size for OpUConvert");
-  }
+  executeOp<T, 1>(Inst, [](T A) -> R { return (R)A; });
 }
 
-void Invocation::executeUDiv(const Instruction *Inst)
+template <typename T>
+void Invocation::executeUDiv(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A / B; });
 }
 
-void Invocation::executeUGreaterThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeUGreaterThan(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A > B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A > B; });
 }
 
-void Invocation::executeUGreaterThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeUGreaterThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A >= B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A >= B; });
 }
 
-void Invocation::executeULessThan(const Instruction *Inst)
+template <typename T>
+void Invocation::executeULessThan(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A < B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A < B; });
 }
 
-void Invocation::executeULessThanEqual(const Instruction *Inst)
+template <typename T>
+void Invocation::executeULessThanEqual(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> bool { return A <= B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> bool { return A <= B; });
 }
 
-void Invocation::executeUndef(const Instruction *Inst)
+void Invocation::executeUndef(const DecodedInstruction *Inst)
 {
-  Objects[Inst->getOperand(1)] = Object(Inst->getResultType());
+  getLocal(Inst->getOperand(1)).reset(Inst->getResultType());
 }
 
-void Invocation::executeUnreachable(const Instruction *Inst)
+void Invocation::executeUnimplemented(const DecodedInstruction *Inst)
+{
+  Dev.reportError("Unimplemented instruction", true);
+}
+
+void Invocation::executeUnreachable(const DecodedInstruction *Inst)
 {
   Dev.reportError("OpUnreachable instruction executed", true);
+  CurrentInstruction = nullptr;
 }
 
-void Invocation::executeUMod(const Instruction *Inst)
+template <typename T>
+void Invocation::executeUMod(const DecodedInstruction *Inst)
 {
-  executeOpUInt<2>(Inst, [](auto A, auto B) -> decltype(A) { return A % B; });
+  executeOp<T, 2>(Inst, [](auto A, auto B) -> decltype(A) { return A % B; });
 }
 
-void Invocation::executeVariable(const Instruction *Inst)
+void Invocation::executeVariable(const DecodedInstruction *Inst)
 {
   assert(Inst->getOperand(2) == SpvStorageClassFunction);
 
   uint32_t Id = Inst->getOperand(1);
   size_t AllocSize = Inst->getResultType()->getElementType()->getSize();
   uint64_t Address = PrivateMemory->allocate(AllocSize);
-  Objects[Id] = Object(Inst->getResultType(), Address);
+  getLocal(Id).reset(Inst->getResultType());
+  getLocal(Id).set(Address);
 
   // Initialize if necessary.
   if (Inst->getNumOperands() > 3)
-    Objects[Inst->getOperand(3)].store(*PrivateMemory, Address);
+    getValue(Inst->getOperand(3)).store(*PrivateMemory, Address);
 
   // Track function scope allocations.
   if (!CallStack.empty())
     CallStack.back().Allocations.push_back(Address);
+  else
+    EntryAllocations.push_back(Address);
 }
 
-void Invocation::executeVectorExtractDynamic(const Instruction *Inst)
+void Invocation::executeVectorExtractDynamic(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   uint16_t Index = 0;
-  switch (Objects[Inst->getOperand(3)].getType()->getSize())
+  switch (getValue(Inst->getOperand(3)).getType()->getSize())
   {
   case 2:
     Index = OP(3, uint16_t);
@@ -1530,17 +1876,17 @@ void Invocation::executeVectorExtractDynamic(const Instruction *Inst)
     assert(false && "Unhandled index size in OpVectorExtractDynamic");
   }
 
-  const Object &Vector = Objects[Inst->getOperand(2)];
+  const Object &Vector = getValue(Inst->getOperand(2));
   if (Index >= Vector.getType()->getElementCount())
     Dev.reportError("Vector index out of range");
-  Objects[Id] = Vector.extract({Index});
+  getLocal(Id) = Vector.extract({Index});
 }
 
-void Invocation::executeVectorInsertDynamic(const Instruction *Inst)
+void Invocation::executeVectorInsertDynamic(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   uint16_t Index = 0;
-  switch (Objects[Inst->getOperand(4)].getType()->getSize())
+  switch (getValue(Inst->getOperand(4)).getType()->getSize())
   {
   case 2:
     Index = OP(4, uint16_t);
@@ -1555,21 +1901,21 @@ void Invocation::executeVectorInsertDynamic(const Instruction *Inst)
     assert(false && "Unhandled index size in OpVectorInsertDynamic");
   }
 
-  const Object &Vector = Objects[Inst->getOperand(2)];
-  const Object &Component = Objects[Inst->getOperand(3)];
+  const Object &Vector = getValue(Inst->getOperand(2));
+  const Object &Component = getValue(Inst->getOperand(3));
   if (Index >= Vector.getType()->getElementCount())
     Dev.reportError("Vector index out of range");
-  Objects[Id] = Vector;
-  Objects[Id].insert({Index}, Component);
+  getLocal(Id) = Vector;
+  getLocal(Id).insert({Index}, Component);
 }
 
-void Invocation::executeVectorShuffle(const Instruction *Inst)
+void Invocation::executeVectorShuffle(const DecodedInstruction *Inst)
 {
   uint32_t Id = Inst->getOperand(1);
   Object Result(Inst->getResultType());
 
-  const Object &Vec1 = Objects[Inst->getOperand(2)];
-  const Object &Vec2 = Objects[Inst->getOperand(3)];
+  const Object &Vec1 = getValue(Inst->getOperand(2));
+  const Object &Vec2 = getValue(Inst->getOperand(3));
   uint32_t Vec1Length = Vec1.getType()->getElementCount();
 
   for (uint32_t i = 0; i < Inst->getResultType()->getElementCount(); i++)
@@ -1583,13 +1929,13 @@ void Invocation::executeVectorShuffle(const Instruction *Inst)
       Result.insert({i}, Vec2.extract({Idx - Vec1Length}));
   }
 
-  Objects[Id] = Result;
+  getLocal(Id) = Result;
 }
 
-void Invocation::executeVectorTimesMatrix(const Instruction *Inst)
+void Invocation::executeVectorTimesMatrix(const DecodedInstruction *Inst)
 {
-  Object Vector = Objects[Inst->getOperand(2)];
-  Object Matrix = Objects[Inst->getOperand(3)];
+  Object Vector = getValue(Inst->getOperand(2));
+  Object Matrix = getValue(Inst->getOperand(3));
   const Type *MatrixType = Matrix.getType();
   const Type *VectorType = Vector.getType();
   const Type *ScalarType = Inst->getResultType()->getElementType();
@@ -1621,27 +1967,56 @@ void Invocation::executeVectorTimesMatrix(const Instruction *Inst)
       break;
     }
   }
-  Objects[Inst->getOperand(1)] = Result;
-}
-
-void Invocation::executeVectorTimesScalar(const Instruction *Inst)
-{
-  switch (Inst->getResultType()->getScalarType()->getBitWidth())
-  {
-  case 32:
-  {
-    float Scalar = Objects[Inst->getOperand(3)].get<float>();
-    executeOp<float, 1>(Inst, [&](float A) { return A * Scalar; });
-    break;
-  }
-  case 64:
+  getLocal(Inst->getOperand(1)) = Result;
+}
+
+template <typename T>
+void Invocation::executeVectorTimesScalar(const DecodedInstruction *Inst)
+{
+  T Scalar = getValue(Inst->getOperand(3)).get<T>();
+  executeOp<T, 1>(Inst, [&](T A) { return A * Scalar; });
+}
+
+template <typename T>
+void Invocation::executeDerivative(const DecodedInstruction *Inst, bool Coarse,
+                                   bool X, bool Y)
+{
+  uint32_t Id = Inst->getOperand(2);
+  const Object &P = getValue(Id);
+
+  // Get the operand value from another invocation in the quad. That value is
+  // undefined if the invocation does not exist or has not produced one (e.g.
+  // in non-uniform control flow), in which case an error is reported and our
+  // own value is used instead, which contributes zero to the derivative.
+  bool Undefined = false;
+  auto GetP = [&](uint32_t Lane) -> const Object & {
+    if (Quad && Quad[Lane] && Quad[Lane]->getValue(Id))
+      return Quad[Lane]->getValue(Id);
+    Undefined = true;
+    return P;
+  };
+
+  // Fine derivatives use the row and column containing this invocation, while
+  // coarse derivatives always use those containing the first invocation.
+  uint32_t Lane = Coarse ? 0 : QuadLane;
+  const Object &Left = GetP(Lane & ~1U);
+  const Object &Right = GetP(Lane | 1U);
+  const Object &Top = GetP(Lane & ~2U);
+  const Object &Bottom = GetP(Lane | 2U);
+  if (Undefined)
+    Dev.reportError("Derivative operand is undefined in another invocation of "
+                    "the quad");
+
+  Object &Result = getLocal(Inst->getOperand(1));
+  Result.reset(Inst->getResultType());
+  for (uint32_t i = 0; i < Inst->getResultType()->getElementCount(); i++)
   {
-    double Scalar = Objects[Inst->getOperand(3)].get<double>();
-    executeOp<double, 1>(Inst, [&](double A) { return A * Scalar; });
-    break;
-  }
-  default:
-    assert(false && "Unhandled floating point size for OpDot");
+    T DX = Right.get<T>(i) - Left.get<T>(i);
+    T DY = Bottom.get<T>(i) - Top.get<T>(i);
+    if (X && Y)
+      Result.set<T>(std::fabs(DX) + std::fabs(DY), i);
+    else
+      Result.set<T>(X ? DX : DY, i);
   }
 }
 
@@ -1671,8 +2046,8 @@ Memory &Invocation::getMemory(uint32_t StorageClass)
 
 Object Invocation::getObject(uint32_t Id) const
 {
-  if (Id < Objects.size())
-    return Objects[Id];
+  if (Id < IdBound)
+    return getValue(Id);
   else
     return Object();
 }
@@ -1686,10 +2061,53 @@ Invocation::State Invocation::getState() const
 
 void Invocation::moveToBlock(uint32_t Id)
 {
-  const Block *B = CurrentFunction->getBlock(Id);
-  CurrentInstruction = B->getLabel().next();
+  moveToBlock(CurrentFunction->getBlock(Id));
+}
+
+void Invocation::moveToBlock(const Block *B)
+{
+  CurrentInstruction = B->getCode();
   PreviousBlock = CurrentBlock;
-  CurrentBlock = Id;
+  CurrentBlock = B->getId();
+}
+
+bool Invocation::skipHelperWrite(uint32_t StorageClass) const
+{
+  return Helper && (StorageClass == SpvStorageClassStorageBuffer ||
+                    StorageClass == SpvStorageClassUniform);
+}
+
+void Invocation::reset()
+{
+  // Release function scope allocations, including those of any stack frames
+  // that are still active (e.g. if OpKill was executed in a called function).
+  for (const StackEntry &SE : CallStack)
+    for (uint64_t Address : SE.Allocations)
+      PrivateMemory->release(Address);
+  for (uint64_t Address : EntryAllocations)
+    PrivateMemory->release(Address);
+  CallStack.clear();
+  EntryAllocations.clear();
+  PhiTemps.clear();
+
+  AtBarrier = false;
+  Discarded = false;
+  CurrentFunction = EntryFunction;
+  moveToBlock(CurrentFunction->getFirstBlockId());
+
+  // Leave function scope results undefined.
+  for (auto &R : CurrentStage->getRegisters())
+    getLocal(R.first).bind(RegisterFile.get() + R.second);
+
+  // Re-initialize private variables.
+  for (auto V : CurrentModule->getVariables())
+  {
+    if (V->getType()->getStorageClass() == SpvStorageClassPrivate &&
+        V->getInitializer())
+      getValue(V->getInitializer()).store(*PrivateMemory, getValue(V->getId()));
+  }
+
+  Dev.reportInvocationBegin(this);
 }
 
 void Invocation::step()
@@ -1697,27 +2115,56 @@ void Invocation::step()
   assert(getState() == READY);
   assert(CurrentInstruction);
 
-  const Instruction *I = CurrentInstruction;
+  const DecodedInstruction *I = CurrentInstruction;
 
   if (!PhiTemps.empty() && I->getOpcode() != SpvOpPhi &&
       I->getOpcode() != SpvOpLine)
   {
     for (auto &P : PhiTemps)
-      Objects[P.first] = std::move(P.second);
+      getLocal(P.first) = std::move(P.second);
     PhiTemps.clear();
   }
 
-  execute(I);
+  (this->*I->Handler)(I);
 
   // Move program counter to next instruction, unless a terminator instruction
   // was executed.
   if (I == CurrentInstruction)
-    CurrentInstruction = CurrentInstruction->next();
+    CurrentInstruction++;
+
+  if (Dev.hasPlugins())
+  {
+    Dev.reportInstructionExecuted(this, I->getInstruction());
+
+    if (getState() == FINISHED)
+      Dev.reportInvocationComplete(this);
+  }
+}
+
+bool Invocation::stepLanes(const std::vector<Invocation *> &Lanes)
+{
+  Invocation *First = Lanes.front();
+  const DecodedInstruction *I = First->CurrentInstruction;
+  if (Lanes.size() < 2 || !I->isLanewise() || First->Dev.hasPlugins())
+    return false;
 
-  Dev.reportInstructionExecuted(this, I);
+  // Apply pending OpPhi results, since this is not an OpPhi instruction.
+  for (Invocation *Lane : Lanes)
+  {
+    assert(Lane->getState() == READY && Lane->CurrentInstruction == I);
+    for (auto &P : Lane->PhiTemps)
+      Lane->getLocal(P.first) = std::move(P.second);
+    Lane->PhiTemps.clear();
+  }
+
+  First->Lanes = &Lanes;
+  (First->*I->Handler)(I);
+  First->Lanes = nullptr;
 
-  if (getState() == FINISHED)
-    Dev.reportInvocationComplete(this);
+  for (Invocation *Lane : Lanes)
+    Lane->CurrentInstruction++;
+
+  return true;
 }
 
 // Private helper functions for executing simple instructions.
@@ -1740,93 +2187,124 @@ static auto apply(const std::array<OpTy, 3> Operands, const F &Op)
   return Op(Operands[0], Operands[1], Operands[2]);
 }
 
-template <typename OpTy, unsigned N, unsigned Offset, typename F>
-void Invocation::executeOp(const Instruction *Inst, const F &Op)
+/// Apply \p Op component-wise to \p Count elements of each operand array,
+/// writing each result to \p Result.
+/// This loop is written over contiguous arrays so that it can be vectorized.
+template <typename R, typename OpTy, size_t N, typename F>
+static TALVOS_ALWAYS_INLINE void
+applyComponents(R *Result, const std::array<const OpTy *, N> &Operands,
+                uint32_t Count, const F &Op)
 {
-  uint32_t Id = Inst->getOperand(1);
-  Object Result(Inst->getResultType());
-  std::array<OpTy, N> Operands;
-
-  // Loop over each vector component.
-  for (uint32_t i = 0; i < Inst->getResultType()->getElementCount(); i++)
+  std::array<OpTy, N> Values;
+  for (uint32_t i = 0; i < Count; i++)
   {
-    // Gather operands.
-    for (unsigned j = 0; j < N; j++)
-      Operands[j] = Objects[Inst->getOperand(Offset + j)].get<OpTy>(i);
-
-    // Apply lambda and set result.
-    Result.set(apply(Operands, Op), i);
+    for (size_t j = 0; j < N; j++)
+      Values[j] = Operands[j][i];
+    Result[i] = apply(Values, Op);
   }
+}
 
-  Objects[Id] = Result;
+#if TALVOS_HAVE_AVX2_KERNELS
+/// Variant of applyComponents() that is compiled for CPUs that support AVX2.
+template <typename R, typename OpTy, size_t N, typename F>
+__attribute__((target("avx2"))) static void
+applyComponentsAVX2(R *Result, const std::array<const OpTy *, N> &Operands,
+                    uint32_t Count, const F &Op)
+{
+  applyComponents(Result, Operands, Count, Op);
 }
+#endif
 
-template <unsigned N, unsigned Offset, typename F>
-void Invocation::executeOpSInt(const Instruction *Inst, const F &&Op)
+/// Apply \p Op component-wise to \p Count elements of each operand array,
+/// which hold the operands of several invocations, using the widest
+/// instruction set that the host CPU supports.
+template <typename R, typename OpTy, size_t N, typename F>
+static void applyLaneKernel(R *Result,
+                            const std::array<const OpTy *, N> &Operands,
+                            uint32_t Count, const F &Op)
 {
-  const Type *OpType = Objects[Inst->getOperand(Offset)].getType();
-  OpType = OpType->getScalarType();
-  assert(OpType->isInt());
-  switch (OpType->getBitWidth())
+#if TALVOS_HAVE_AVX2_KERNELS
+  if (HasAVX2)
   {
-  case 8:
-    executeOp<int8_t, N, Offset>(Inst, Op);
-    break;
-  case 16:
-    executeOp<int16_t, N, Offset>(Inst, Op);
-    break;
-  case 32:
-    executeOp<int32_t, N, Offset>(Inst, Op);
-    break;
-  case 64:
-    executeOp<int64_t, N, Offset>(Inst, Op);
-    break;
-  default:
-    assert(false && "Unhandled binary operation integer width");
+    applyComponentsAVX2(Result, Operands, Count, Op);
+    return;
   }
+#endif
+  applyComponents(Result, Operands, Count, Op);
 }
 
-template <unsigned N, unsigned Offset, typename F>
-void Invocation::executeOpFP(const Instruction *Inst, const F &&Op)
+template <typename OpTy, unsigned N, unsigned Offset, typename F>
+void Invocation::executeOp(const DecodedInstruction *Inst, const F &Op)
 {
-  const Type *OpType = Objects[Inst->getOperand(Offset)].getType();
-  OpType = OpType->getScalarType();
-  assert(OpType->isFloat());
-  switch (OpType->getBitWidth())
+  typedef decltype(apply(std::array<OpTy, N>(), Op)) R;
+  assert(Inst->getResultType()->getScalarType()->getSize() == sizeof(R));
+
+  // Apply the instruction to each invocation that it was dispatched for.
+  Invocation *Self = this;
+  Invocation *const *LaneList = Lanes ? Lanes->data() : &Self;
+  size_t NumLanes = Lanes ? Lanes->size() : 1;
+
+  // When there are several invocations, gather the operands of as many of
+  // them as possible into contiguous arrays and apply a lane kernel to all of
+  // their components at once, before scattering the results.
+  uint32_t NumComponents = Inst->getNumComponents();
+  if (NumLanes > 1 && UseLaneKernels && NumComponents <= LANE_KERNEL_SIZE)
   {
-  case 32:
-    executeOp<float, N, Offset>(Inst, Op);
-    break;
-  case 64:
-    executeOp<double, N, Offset>(Inst, Op);
-    break;
-  default:
-    assert(false && "Unhandled binary operation floating point size");
+    OpTy Values[N][LANE_KERNEL_SIZE];
+    R Results[LANE_KERNEL_SIZE];
+    std::array<const OpTy *, N> Operands;
+    for (unsigned j = 0; j < N; j++)
+      Operands[j] = Values[j];
+
+    size_t LanesPerKernel = LANE_KERNEL_SIZE / NumComponents;
+    for (size_t Base = 0; Base < NumLanes; Base += LanesPerKernel)
+    {
+      size_t Count = std::min(LanesPerKernel, NumLanes - Base);
+      for (size_t l = 0; l < Count; l++)
+      {
+        Invocation *Lane = LaneList[Base + l];
+        for (unsigned j = 0; j < N; j++)
+        {
+          const Object &Operand = Lane->getValue(Inst->getOperand(Offset + j));
+          assert(Operand.getType()->getScalarType()->getSize() ==
+                 sizeof(OpTy));
+          memcpy(Values[j] + l * NumComponents, Operand.getData(),
+                 NumComponents * sizeof(OpTy));
+        }
+      }
+
+      applyLaneKernel(Results, Operands, (uint32_t)(Count * NumComponents),
+                      Op);
+
+      for (size_t l = 0; l < Count; l++)
+      {
+        Object &Result = LaneList[Base + l]->getLocal(Inst->getOperand(1));
+        Result.reset(Inst->getResultType());
+        memcpy(Result.getData(), Results + l * NumComponents,
+               NumComponents * sizeof(R));
+      }
+    }
+    return;
   }
-}
 
-template <unsigned N, unsigned Offset, typename F>
-void Invocation::executeOpUInt(const Instruction *Inst, const F &&Op)
-{
-  const Type *OpType = Objects[Inst->getOperand(Offset)].getType();
-  OpType = OpType->getScalarType();
-  assert(OpType->isInt());
-  switch (OpType->getBitWidth())
+  for (size_t l = 0; l < NumLanes; l++)
   {
-  case 8:
-    executeOp<uint8_t, N>(Inst, Op);
-    break;
-  case 16:
-    executeOp<uint16_t, N>(Inst, Op);
-    break;
-  case 32:
-    executeOp<uint32_t, N>(Inst, Op);
-    break;
-  case 64:
-    executeOp<uint64_t, N>(Inst, Op);
-    break;
-  default:
-    assert(false && "Unhandled binary operation integer width");
+    Invocation *Lane = LaneList[l];
+    Object &Result = Lane->getLocal(Inst->getOperand(1));
+    Result.reset(Inst->getResultType());
+
+    // Gather pointers to the components of each operand.
+    std::array<const OpTy *, N> Operands;
+    for (unsigned j = 0; j < N; j++)
+    {
+      const Object &Operand = Lane->getValue(Inst->getOperand(Offset + j));
+      assert(Operand.getType()->getScalarType()->getSize() == sizeof(OpTy));
+      Operands[j] = (const OpTy *)Operand.getData();
+    }
+
+    // Apply lambda to each vector component.
+    applyComponents((R *)Result.getData(), Operands, Inst->getNumComponents(),
+                    Op);
   }
 }
 
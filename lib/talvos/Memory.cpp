@@ -14,16 +14,64 @@
 
 #include <spirv/unified1/spirv.h>
 
+#include "config.h"
+
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "talvos/Device.h"
 #include "talvos/Memory.h"
+#include "Utils.h"
+
+/// Default number of bits used for the buffer ID in device memory.
+/// This can be overridden with the TALVOS_DEVICE_BUFFER_BITS environment
+/// variable.
+#define DEVICE_BUFFER_BITS (24)
+
+/// Number of bits used for the buffer ID in workgroup memory.
+#define WORKGROUP_BUFFER_BITS (16)
+
+/// Number of bits used for the buffer ID in invocation memory.
+#define INVOCATION_BUFFER_BITS (16)
+
+/// Minimum number of bits used for the buffer ID.
+#define MIN_BUFFER_BITS (8)
 
-// TODO: Allow different number of buffer bits depending on address space
+/// Maximum number of bits used for the buffer ID.
+#define MAX_BUFFER_BITS (40)
 
-/// Number of bits used for the buffer ID.
-#define BUFFER_BITS (16)
+/// Minimum size in bytes of a device scope allocation that is mapped directly
+/// from the operating system, and committed lazily as pages are touched.
+#define LAZY_ALLOCATION_THRESHOLD (1 << 20)
+
+/// Number of entries in the first chunk of the buffer table, as a power of two.
+/// Each subsequent chunk doubles the size of the table.
+#define FIRST_CHUNK_BITS (4)
 
 /// Number of bits used for the address offset.
-#define OFFSET_BITS (64 - BUFFER_BITS)
+#define OFFSET_BITS (64 - BufferBits)
+
+/// Mask used to extract the address offset.
+#define OFFSET_MASK (((uint64_t)-1) >> BufferBits)
+
+/// Minimum size of an arena slab in bytes.
+#define ARENA_SLAB_SIZE (4096)
+
+/// Alignment of allocations made from an arena.
+#define ARENA_ALIGNMENT (16)
+
+/// Maximum number of released arena slabs cached by each thread.
+#define ARENA_SLAB_CACHE_SIZE (16)
+
+/// Atomic operations on aligned memory locations use native atomic
+/// instructions when the compiler provides them, instead of a mutex.
+#if defined(__GNUC__)
+#define NATIVE_ATOMICS 1
+#else
+#define NATIVE_ATOMICS 0
+#endif
 
 // Macros for locking/unlocking atomic mutexes if necessary.
 #define LOCK_ATOMIC_MUTEX(Address)                                             \
@@ -36,59 +84,259 @@
 namespace talvos
 {
 
-Memory::Memory(Device &D, MemoryScope Scope) : Dev(D), Scope(Scope)
+thread_local std::vector<Memory::ArenaSlab> Memory::SlabCache;
+
+/// Returns the index of the most significant set bit of \p Value.
+static inline unsigned log2Floor(uint64_t Value)
+{
+  assert(Value);
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(Value);
+#else
+  unsigned Result = 0;
+  while (Value >>= 1)
+    Result++;
+  return Result;
+#endif
+}
+
+/// Returns the number of bits used for the buffer ID for \p Scope.
+static unsigned getBufferBits(MemoryScope Scope)
 {
+  switch (Scope)
+  {
+  case MemoryScope::Device:
+  {
+    static const unsigned long DeviceBufferBits =
+        getEnvUInt("TALVOS_DEVICE_BUFFER_BITS", DEVICE_BUFFER_BITS);
+    if (DeviceBufferBits < MIN_BUFFER_BITS ||
+        DeviceBufferBits > MAX_BUFFER_BITS)
+    {
+      std::cerr << std::endl
+                << "ERROR: TALVOS_DEVICE_BUFFER_BITS must be between "
+                << MIN_BUFFER_BITS << " and " << MAX_BUFFER_BITS << std::endl;
+      abort();
+    }
+    return (unsigned)DeviceBufferBits;
+  }
+  case MemoryScope::Workgroup:
+    return WORKGROUP_BUFFER_BITS;
+  case MemoryScope::Invocation:
+    return INVOCATION_BUFFER_BITS;
+  default:
+    assert(false && "Invalid memory scope");
+    abort();
+  }
+}
+
+Memory::Memory(Device &D, MemoryScope Scope)
+    : Dev(D), Scope(Scope), BufferBits(getBufferBits(Scope)),
+      Arena(Scope != MemoryScope::Device),
+      CountAccesses(D.isMemoryStatsEnabled())
+{
+  for (std::atomic<Buffer *> &Chunk : BufferChunks)
+    Chunk.store(nullptr, std::memory_order_relaxed);
+
   // Skip the first buffer identifier (0).
-  Buffers.resize(1);
+  NumBuffers = 1;
+  NumFreeBuffers = 0;
+
+  LiveBytes = 0;
+  PeakBytes = 0;
+  LiveBuffers = 0;
+  NumAllocations = 0;
+  NumReused = 0;
+  LoadBytes = 0;
+  StoreBytes = 0;
 }
 
 Memory::~Memory()
 {
-  // Release all allocations.
-  for (size_t Id = 1; Id < Buffers.size(); Id++)
-    delete[] Buffers[Id].Data;
+  // Add the statistics for short-lived memory instances to the device totals.
+  if (Scope != MemoryScope::Device)
+    Dev.accumulateMemoryStats(Scope, getStats());
+
+  // Release all allocations and buffer table chunks.
+  for (unsigned i = 0; i < MAX_BUFFER_CHUNKS; i++)
+  {
+    Buffer *Chunk = BufferChunks[i].load(std::memory_order_relaxed);
+    if (!Chunk)
+      continue;
+    if (!Arena)
+    {
+      // Released buffers have no data, but keep the flags from when they
+      // were allocated, so they must be skipped here.
+      for (uint64_t j = 0; j < getChunkSize(i); j++)
+      {
+        uint8_t *Data = Chunk[j].Data.load(std::memory_order_relaxed);
+        if (Data && !Chunk[j].Imported)
+          freeData(Data, Chunk[j].NumBytes, Chunk[j].Mapped);
+      }
+    }
+    delete[] Chunk;
+  }
+
+  // Return arena slabs to the cache for reuse by other memory instances.
+  for (ArenaSlab &Slab : Slabs)
+  {
+    if (SlabCache.size() >= ARENA_SLAB_CACHE_SIZE)
+      break;
+    SlabCache.push_back(std::move(Slab));
+  }
 }
 
 uint64_t Memory::allocate(uint64_t NumBytes)
 {
-  std::lock_guard<std::mutex> Lock(Mutex);
+  uint64_t Id = createBufferId(NumBytes);
+  if (!Id)
+    return 0;
 
-  // Allocate buffer.
-  Buffer B;
+  // Allocate buffer and publish it in the buffer table.
+  Buffer &B = createBuffer(Id);
   B.NumBytes = NumBytes;
-  B.Data = new uint8_t[NumBytes];
+  B.Mapped = false;
+  B.Imported = false;
+  uint8_t *Data =
+      Arena ? allocateFromArena(NumBytes) : allocateData(NumBytes, B.Mapped);
+  B.Data.store(Data, std::memory_order_release);
+
+  return (Id << OFFSET_BITS);
+}
+
+uint64_t Memory::createBufferId(uint64_t NumBytes)
+{
+  if (NumBytes > OFFSET_MASK)
+  {
+    std::stringstream Err;
+    Err << "Memory allocation failed: " << NumBytes << " bytes exceeds the "
+        << "maximum buffer size in " << scopeToString(Scope) << " scope";
+    Dev.reportError(Err.str(), true);
+    return 0;
+  }
+
+  // Re-use a previously released buffer identifier if there is one.
+  // Arena allocations always use the next identifier, so that they can be
+  // released in stack order.
+  uint64_t Id = 0;
+  if (!Arena && NumFreeBuffers.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (FreeBuffers.size())
+    {
+      Id = FreeBuffers.back();
+      FreeBuffers.pop_back();
+      NumFreeBuffers = FreeBuffers.size();
+    }
+  }
 
-  // Get the next available buffer identifier.
-  uint64_t Id;
-  if (FreeBuffers.size())
+  // Otherwise, allocate a new buffer identifier.
+  if (!Id)
   {
-    // Re-use previously released buffer identifier.
-    Id = FreeBuffers.back();
-    FreeBuffers.pop_back();
-    Buffers[Id] = B;
+    Id = NumBuffers.fetch_add(1, std::memory_order_relaxed);
+    if (Id >= (1ULL << BufferBits))
+    {
+      std::stringstream Err;
+      Err << "Memory allocation failed: more than " << (1ULL << BufferBits)
+          << " buffers allocated in " << scopeToString(Scope) << " scope";
+      Dev.reportError(Err.str(), true);
+      return 0;
+    }
   }
   else
   {
-    // Allocate new buffer identifier.
-    Id = Buffers.size();
-    Buffers.push_back(B);
+    NumReused.fetch_add(1, std::memory_order_relaxed);
   }
 
-  return (Id << OFFSET_BITS);
+  // Update allocation statistics.
+  NumAllocations.fetch_add(1, std::memory_order_relaxed);
+  LiveBuffers.fetch_add(1, std::memory_order_relaxed);
+  uint64_t Live =
+      LiveBytes.fetch_add(NumBytes, std::memory_order_relaxed) + NumBytes;
+  uint64_t Peak = PeakBytes.load(std::memory_order_relaxed);
+  while (Live > Peak && !PeakBytes.compare_exchange_weak(
+                            Peak, Live, std::memory_order_relaxed))
+    ;
+
+  return Id;
+}
+
+uint8_t *Memory::allocateData(uint64_t NumBytes, bool &Mapped)
+{
+#if HAVE_MMAP
+  // Map large allocations directly, so that pages are committed on demand.
+  if (NumBytes >= LAZY_ALLOCATION_THRESHOLD)
+  {
+    void *Data = mmap(nullptr, NumBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Data != MAP_FAILED)
+    {
+#ifdef MADV_RANDOM
+      // Sparsely used buffers gain nothing from faulting in nearby pages.
+      madvise(Data, NumBytes, MADV_RANDOM);
+#endif
+      Mapped = true;
+      return (uint8_t *)Data;
+    }
+  }
+#endif
+
+  Mapped = false;
+  return new uint8_t[NumBytes];
+}
+
+uint8_t *Memory::allocateFromArena(uint64_t NumBytes)
+{
+  uint64_t Size = (NumBytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+  // Find the next slab with enough space left, creating one if necessary.
+  while (CurrentSlab < Slabs.size() &&
+         SlabOffset + Size > Slabs[CurrentSlab].Size)
+  {
+    CurrentSlab++;
+    SlabOffset = 0;
+  }
+  if (CurrentSlab == Slabs.size())
+  {
+    uint64_t SlabSize = std::max<uint64_t>(Size, ARENA_SLAB_SIZE);
+
+    // Take a slab from the cache if there is one that is large enough.
+    auto Cached = std::find_if(
+        SlabCache.begin(), SlabCache.end(),
+        [SlabSize](const ArenaSlab &S) { return S.Size >= SlabSize; });
+    if (Cached != SlabCache.end())
+    {
+      Slabs.push_back(std::move(*Cached));
+      SlabCache.erase(Cached);
+    }
+    else
+    {
+      Slabs.push_back({std::unique_ptr<uint8_t[]>(new uint8_t[SlabSize]),
+                       SlabSize});
+    }
+  }
+
+  // Bump the allocation pointer, remembering where the allocation started.
+  ArenaStack.push_back({CurrentSlab, SlabOffset});
+  uint8_t *Data = Slabs[CurrentSlab].Data.get() + SlabOffset;
+  SlabOffset += Size;
+  return Data;
 }
 
 template <typename T>
 T Memory::atomic(uint64_t Address, uint32_t Opcode, uint32_t Scope,
                  uint32_t Semantics, T Value)
 {
-  assert(sizeof(T) == 4);
+  static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Invalid atomic width");
 
-  Dev.reportAtomicAccess(this, Address, 4, Opcode, Scope, Semantics);
+  if (Dev.hasPlugins())
+    Dev.reportAtomicAccess(this, Address, sizeof(T), Opcode, Scope, Semantics);
 
-  if (!isAccessValid(Address, 4))
+  // Get pointer to memory location.
+  T *Pointer = (T *)getPointer(Address, sizeof(T));
+  if (!Pointer)
   {
     std::stringstream Err;
-    Err << "Invalid atomic access of 4 bytes"
+    Err << "Invalid atomic access of " << sizeof(T) << " bytes"
         << " at address 0x" << std::hex << Address << " ("
         << scopeToString(this->Scope) << " scope) ";
     Dev.reportError(Err.str());
@@ -96,10 +344,53 @@ T Memory::atomic(uint64_t Address, uint32_t Opcode, uint32_t Scope,
     return 0;
   }
 
-  // Get pointer to memory location.
-  uint64_t Id = (Address >> OFFSET_BITS);
-  uint64_t Offset = (Address & (((uint64_t)-1) >> BUFFER_BITS));
-  T *Pointer = (T *)(Buffers[Id].Data + Offset);
+#if NATIVE_ATOMICS
+  // Use native atomic instructions if the memory location is aligned.
+  if (((uintptr_t)Pointer % sizeof(T)) == 0)
+  {
+    switch (Opcode)
+    {
+    case SpvOpAtomicAnd:
+      return __atomic_fetch_and(Pointer, Value, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicExchange:
+    case SpvOpAtomicStore:
+      return __atomic_exchange_n(Pointer, Value, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicIAdd:
+      return __atomic_fetch_add(Pointer, Value, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicIDecrement:
+      return __atomic_fetch_sub(Pointer, 1, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicIIncrement:
+      return __atomic_fetch_add(Pointer, 1, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicISub:
+      return __atomic_fetch_sub(Pointer, Value, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicLoad:
+      return __atomic_load_n(Pointer, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicOr:
+      return __atomic_fetch_or(Pointer, Value, __ATOMIC_SEQ_CST);
+    case SpvOpAtomicSMax:
+    case SpvOpAtomicUMax:
+    case SpvOpAtomicSMin:
+    case SpvOpAtomicUMin:
+    {
+      bool Max = (Opcode == SpvOpAtomicSMax || Opcode == SpvOpAtomicUMax);
+      T OldValue = __atomic_load_n(Pointer, __ATOMIC_RELAXED);
+      T NewValue;
+      do
+      {
+        NewValue = Max ? std::max(OldValue, Value) : std::min(OldValue, Value);
+      } while (!__atomic_compare_exchange_n(Pointer, &OldValue, NewValue,
+                                            false, __ATOMIC_SEQ_CST,
+                                            __ATOMIC_RELAXED));
+      return OldValue;
+    }
+    case SpvOpAtomicXor:
+      return __atomic_fetch_xor(Pointer, Value, __ATOMIC_SEQ_CST);
+    default:
+      Dev.reportError("Unhandled atomic operation", true);
+      return 0;
+    }
+  }
+#endif
 
   LOCK_ATOMIC_MUTEX(Address);
 
@@ -153,19 +444,24 @@ T Memory::atomic(uint64_t Address, uint32_t Opcode, uint32_t Scope,
   return OldValue;
 }
 
-uint32_t Memory::atomicCmpXchg(uint64_t Address, uint32_t Scope,
-                               uint32_t EqualSemantics,
-                               uint32_t UnequalSemantics, uint32_t Value,
-                               uint32_t Comparator)
+template <typename T>
+T Memory::atomicCmpXchg(uint64_t Address, uint32_t Scope,
+                        uint32_t EqualSemantics, uint32_t UnequalSemantics,
+                        T Value, T Comparator)
 {
-  if (!isAccessValid(Address, 4))
+  static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Invalid atomic width");
+
+  // Get pointer to memory location.
+  T *Pointer = (T *)getPointer(Address, sizeof(T));
+  if (!Pointer)
   {
     // Make sure we still report the access for any plugins to observe.
-    Dev.reportAtomicAccess(this, Address, 4, SpvOpAtomicCompareExchange, Scope,
+    Dev.reportAtomicAccess(this, Address, sizeof(T),
+                           SpvOpAtomicCompareExchange, Scope,
                            UnequalSemantics);
 
     std::stringstream Err;
-    Err << "Invalid atomic access of 4 bytes"
+    Err << "Invalid atomic access of " << sizeof(T) << " bytes"
         << " at address 0x" << std::hex << Address << " ("
         << scopeToString(this->Scope) << " scope) ";
     Dev.reportError(Err.str());
@@ -173,37 +469,110 @@ uint32_t Memory::atomicCmpXchg(uint64_t Address, uint32_t Scope,
     return 0;
   }
 
-  // Get pointer to memory location.
-  uint64_t Id = (Address >> OFFSET_BITS);
-  uint64_t Offset = (Address & (((uint64_t)-1) >> BUFFER_BITS));
-  uint32_t *Pointer = (uint32_t *)(Buffers[Id].Data + Offset);
+#if NATIVE_ATOMICS
+  // Use native atomic instructions if the memory location is aligned.
+  if (((uintptr_t)Pointer % sizeof(T)) == 0)
+  {
+    T OldValue = Comparator;
+    bool Equal = __atomic_compare_exchange_n(
+        Pointer, &OldValue, Value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    if (Dev.hasPlugins())
+      Dev.reportAtomicAccess(this, Address, sizeof(T),
+                             SpvOpAtomicCompareExchange, Scope,
+                             Equal ? EqualSemantics : UnequalSemantics);
+    return OldValue;
+  }
+#endif
 
   LOCK_ATOMIC_MUTEX(Address);
 
   // Compare values and exchange if necessary.
-  uint32_t OldValue = *Pointer;
-  if (OldValue == Comparator)
-  {
-    Dev.reportAtomicAccess(this, Address, 4, SpvOpAtomicCompareExchange, Scope,
-                           EqualSemantics);
+  T OldValue = *Pointer;
+  bool Equal = OldValue == Comparator;
+  if (Dev.hasPlugins())
+    Dev.reportAtomicAccess(this, Address, sizeof(T),
+                           SpvOpAtomicCompareExchange, Scope,
+                           Equal ? EqualSemantics : UnequalSemantics);
+  if (Equal)
     *Pointer = Value;
+
+  UNLOCK_ATOMIC_MUTEX(Address);
+
+  return OldValue;
+}
+
+Memory::Buffer &Memory::createBuffer(uint64_t Id)
+{
+  unsigned ChunkIndex;
+  uint64_t Index;
+  getChunkIndex(Id, ChunkIndex, Index);
+
+  std::atomic<Buffer *> &ChunkPtr = BufferChunks[ChunkIndex];
+  Buffer *Chunk = ChunkPtr.load(std::memory_order_acquire);
+  if (!Chunk)
+  {
+    // Create the chunk, unless another thread beats us to it.
+    Buffer *NewChunk = new Buffer[getChunkSize(ChunkIndex)]();
+    if (ChunkPtr.compare_exchange_strong(Chunk, NewChunk,
+                                         std::memory_order_acq_rel))
+      Chunk = NewChunk;
+    else
+      delete[] NewChunk;
   }
-  else
+  return Chunk[Index];
+}
+
+void Memory::freeData(uint8_t *Data, uint64_t NumBytes, bool Mapped)
+{
+#if HAVE_MMAP
+  if (Mapped)
   {
-    Dev.reportAtomicAccess(this, Address, 4, SpvOpAtomicCompareExchange, Scope,
-                           UnequalSemantics);
+    munmap(Data, NumBytes);
+    return;
   }
+#endif
+  delete[] Data;
+}
 
-  UNLOCK_ATOMIC_MUTEX(Address);
+MemoryStats Memory::getStats() const
+{
+  MemoryStats Stats;
+  Stats.LiveBytes = LiveBytes.load(std::memory_order_relaxed);
+  Stats.PeakBytes = PeakBytes.load(std::memory_order_relaxed);
+  Stats.LiveBuffers = LiveBuffers.load(std::memory_order_relaxed);
+  Stats.NumAllocations = NumAllocations.load(std::memory_order_relaxed);
+  Stats.NumReused = NumReused.load(std::memory_order_relaxed);
+  Stats.LoadBytes = LoadBytes.load(std::memory_order_relaxed);
+  Stats.StoreBytes = StoreBytes.load(std::memory_order_relaxed);
+  Stats.HasAccessCounts = CountAccesses;
+  return Stats;
+}
 
-  return OldValue;
+uint64_t Memory::import(uint8_t *Data, uint64_t NumBytes)
+{
+  assert(!Arena && "Cannot import host memory into an arena");
+
+  uint64_t Id = createBufferId(NumBytes);
+  if (!Id)
+    return 0;
+
+  // Publish the host memory in the buffer table, without taking ownership.
+  Buffer &B = createBuffer(Id);
+  B.NumBytes = NumBytes;
+  B.Mapped = false;
+  B.Imported = true;
+  B.Data.store(Data, std::memory_order_release);
+
+  return (Id << OFFSET_BITS);
 }
 
 void Memory::dump() const
 {
-  for (size_t Id = 1; Id < Buffers.size(); Id++)
+  uint64_t Count = NumBuffers.load(std::memory_order_acquire);
+  for (uint64_t Id = 1; Id < Count; Id++)
   {
-    if (Buffers[Id].Data)
+    Buffer *B = getBuffer(Id);
+    if (B && B->Data.load(std::memory_order_acquire))
       dump(Id << OFFSET_BITS);
   }
 }
@@ -212,13 +581,16 @@ void Memory::dump(uint64_t Address) const
 {
   uint64_t Id = (Address >> OFFSET_BITS);
 
-  if (!Buffers[Id].Data)
+  Buffer *B = getBuffer(Id);
+  const uint8_t *Data =
+      B ? B->Data.load(std::memory_order_acquire) : nullptr;
+  if (!Data)
   {
     std::cerr << "Memory::dump() invalid address: " << Address << std::endl;
     return;
   }
 
-  for (uint64_t i = 0; i < Buffers[Id].NumBytes; i++)
+  for (uint64_t i = 0; i < B->NumBytes; i++)
   {
     if (i % 4 == 0)
     {
@@ -228,32 +600,114 @@ void Memory::dump(uint64_t Address) const
                 << ((((uint64_t)Id) << OFFSET_BITS) | i) << ":";
     }
     std::cout << " " << std::hex << std::uppercase << std::setw(2)
-              << std::setfill('0') << (int)Buffers[Id].Data[i];
+              << std::setfill('0') << (int)Data[i];
   }
   std::cout << std::endl;
 }
 
-bool Memory::isAccessValid(uint64_t Address, uint64_t NumBytes) const
+Memory::Buffer *Memory::getBuffer(uint64_t Id) const
+{
+  if (Id >= (1ULL << BufferBits))
+    return nullptr;
+
+  unsigned ChunkIndex;
+  uint64_t Index;
+  getChunkIndex(Id, ChunkIndex, Index);
+
+  Buffer *Chunk = BufferChunks[ChunkIndex].load(std::memory_order_acquire);
+  if (!Chunk)
+    return nullptr;
+  return &Chunk[Index];
+}
+
+void Memory::getChunkIndex(uint64_t Id, unsigned &ChunkIndex, uint64_t &Index)
+{
+  // Chunk 0 holds the first 2^FIRST_CHUNK_BITS IDs, and chunk N > 0 holds the
+  // IDs in [2^(FIRST_CHUNK_BITS+N-1), 2^(FIRST_CHUNK_BITS+N)).
+  if (Id < (1ULL << FIRST_CHUNK_BITS))
+  {
+    ChunkIndex = 0;
+    Index = Id;
+    return;
+  }
+  unsigned Bit = log2Floor(Id);
+  ChunkIndex = Bit - FIRST_CHUNK_BITS + 1;
+  Index = Id - (1ULL << Bit);
+}
+
+uint64_t Memory::getChunkSize(unsigned ChunkIndex)
+{
+  if (ChunkIndex == 0)
+    return 1ULL << FIRST_CHUNK_BITS;
+  return 1ULL << (FIRST_CHUNK_BITS + ChunkIndex - 1);
+}
+
+uint64_t Memory::getCommitment(uint64_t Address) const
+{
+  Buffer *B = getBuffer(Address >> OFFSET_BITS);
+  uint8_t *Data = B ? B->Data.load(std::memory_order_acquire) : nullptr;
+  if (!Data)
+    return 0;
+
+#if HAVE_MMAP
+  // Count the pages of a mapped allocation that are resident.
+  if (B->Mapped)
+  {
+    uint64_t PageSize = sysconf(_SC_PAGESIZE);
+    uint64_t NumPages = (B->NumBytes + PageSize - 1) / PageSize;
+#ifdef __APPLE__
+    std::vector<char> Residency(NumPages);
+#else
+    std::vector<unsigned char> Residency(NumPages);
+#endif
+    if (mincore(Data, B->NumBytes, Residency.data()) == 0)
+    {
+      uint64_t NumResident = std::count_if(
+          Residency.begin(), Residency.end(), [](auto R) { return R & 1; });
+      return std::min(NumResident * PageSize, B->NumBytes);
+    }
+  }
+#endif
+
+  return B->NumBytes;
+}
+
+uint8_t *Memory::getPointer(uint64_t Address, uint64_t NumBytes) const
 {
   uint64_t Id = (Address >> OFFSET_BITS);
-  uint64_t Offset = (Address & (((uint64_t)-1) >> BUFFER_BITS));
-  if (Id >= Buffers.size())
-    return false;
-  if (!Buffers[Id].Data)
-    return false;
-  if ((Offset + NumBytes) > Buffers[Id].NumBytes)
-    return false;
-  return true;
+  uint64_t Offset = (Address & OFFSET_MASK);
+  Buffer *B = getBuffer(Id);
+  if (!B)
+    return nullptr;
+  uint8_t *Data = B->Data.load(std::memory_order_acquire);
+  if (!Data)
+    return nullptr;
+  if ((Offset + NumBytes) > B->NumBytes)
+    return nullptr;
+  return Data + Offset;
+}
+
+uint8_t *Memory::getPointerInBounds(uint64_t Address, uint64_t NumBytes) const
+{
+  Buffer *B = getBuffer(Address >> OFFSET_BITS);
+  assert(B && "Invalid buffer for in bounds access");
+  uint8_t *Data = B->Data.load(std::memory_order_acquire);
+  assert(Data && ((Address & OFFSET_MASK) + NumBytes) <= B->NumBytes &&
+         "In bounds access exceeds buffer");
+  (void)NumBytes;
+  return Data + (Address & OFFSET_MASK);
 }
 
 void Memory::load(uint8_t *Data, uint64_t Address, uint64_t NumBytes) const
 {
-  uint64_t Id = (Address >> OFFSET_BITS);
-  uint64_t Offset = (Address & (((uint64_t)-1) >> BUFFER_BITS));
+  if (CountAccesses)
+    LoadBytes.fetch_add(NumBytes, std::memory_order_relaxed);
 
-  Dev.reportMemoryLoad(this, Address, NumBytes);
+  if (Dev.hasPlugins())
+    Dev.reportMemoryLoad(this, Address, NumBytes);
 
-  if (!isAccessValid(Address, NumBytes))
+  const uint8_t *Pointer = getPointer(Address, NumBytes);
+  if (!Pointer)
   {
     std::stringstream Err;
     Err << "Invalid load of " << NumBytes << " bytes"
@@ -267,16 +721,28 @@ void Memory::load(uint8_t *Data, uint64_t Address, uint64_t NumBytes) const
     return;
   }
 
-  memcpy(Data, Buffers[Id].Data + Offset, NumBytes);
+  memcpy(Data, Pointer, NumBytes);
 }
 
-uint8_t *Memory::map(uint64_t Base, uint64_t Offset, uint64_t NumBytes)
+void Memory::loadInBounds(uint8_t *Data, uint64_t Address,
+                          uint64_t NumBytes) const
 {
-  uint64_t Id = (Base >> OFFSET_BITS);
+  if (CountAccesses)
+    LoadBytes.fetch_add(NumBytes, std::memory_order_relaxed);
+
+  if (Dev.hasPlugins())
+    Dev.reportMemoryLoad(this, Address, NumBytes);
+
+  memcpy(Data, getPointerInBounds(Address, NumBytes), NumBytes);
+}
 
-  Dev.reportMemoryMap(this, Base, Offset, NumBytes);
+uint8_t *Memory::map(uint64_t Base, uint64_t Offset, uint64_t NumBytes)
+{
+  if (Dev.hasPlugins())
+    Dev.reportMemoryMap(this, Base, Offset, NumBytes);
 
-  if (!isAccessValid(Base + Offset, NumBytes))
+  uint8_t *Pointer = getPointer(Base + Offset, NumBytes);
+  if (!Pointer)
   {
     std::stringstream Err;
     Err << "Invalid mapping of " << NumBytes << " bytes"
@@ -286,31 +752,55 @@ uint8_t *Memory::map(uint64_t Base, uint64_t Offset, uint64_t NumBytes)
     return nullptr;
   }
 
-  return Buffers[Id].Data + Offset;
+  return Pointer;
 }
 
 void Memory::release(uint64_t Address)
 {
-  std::lock_guard<std::mutex> Lock(Mutex);
-
   uint64_t Id = (Address >> OFFSET_BITS);
-  assert(Buffers[Id].Data != nullptr);
+  Buffer *B = getBuffer(Id);
+  assert(B && B->Data.load(std::memory_order_relaxed) != nullptr);
+
+  // Update allocation statistics.
+  LiveBuffers.fetch_sub(1, std::memory_order_relaxed);
+  LiveBytes.fetch_sub(B->NumBytes, std::memory_order_relaxed);
 
   // Release memory used by buffer.
-  delete[] Buffers[Id].Data;
-  Buffers[Id].Data = nullptr;
+  uint8_t *Data = B->Data.exchange(nullptr, std::memory_order_acq_rel);
+  if (Arena)
+  {
+    // Reclaim arena space and buffer identifiers from the top of the stack.
+    // Space used by other buffers is reclaimed once every buffer above them
+    // has also been released.
+    uint64_t Top = NumBuffers.load(std::memory_order_relaxed);
+    while (Top > 1 && !getBuffer(Top - 1)->Data.load(std::memory_order_relaxed))
+    {
+      Top--;
+      CurrentSlab = ArenaStack.back().first;
+      SlabOffset = ArenaStack.back().second;
+      ArenaStack.pop_back();
+    }
+    NumBuffers.store(Top, std::memory_order_relaxed);
+    return;
+  }
+  if (!B->Imported)
+    freeData(Data, B->NumBytes, B->Mapped);
 
+  std::lock_guard<std::mutex> Lock(Mutex);
   FreeBuffers.push_back(Id);
+  NumFreeBuffers = FreeBuffers.size();
 }
 
 void Memory::store(uint64_t Address, uint64_t NumBytes, const uint8_t *Data)
 {
-  uint64_t Id = (Address >> OFFSET_BITS);
-  uint64_t Offset = (Address & (((uint64_t)-1) >> BUFFER_BITS));
+  if (CountAccesses)
+    StoreBytes.fetch_add(NumBytes, std::memory_order_relaxed);
 
-  Dev.reportMemoryStore(this, Address, NumBytes, Data);
+  if (Dev.hasPlugins())
+    Dev.reportMemoryStore(this, Address, NumBytes, Data);
 
-  if (!isAccessValid(Address, NumBytes))
+  uint8_t *Pointer = getPointer(Address, NumBytes);
+  if (!Pointer)
   {
     std::stringstream Err;
     Err << "Invalid store of " << NumBytes << " bytes"
@@ -320,20 +810,40 @@ void Memory::store(uint64_t Address, uint64_t NumBytes, const uint8_t *Data)
     return;
   }
 
-  memcpy(Buffers[Id].Data + Offset, Data, NumBytes);
+  memcpy(Pointer, Data, NumBytes);
 }
 
-void Memory::unmap(uint64_t Base) { Dev.reportMemoryUnmap(this, Base); }
+void Memory::storeInBounds(uint64_t Address, uint64_t NumBytes,
+                           const uint8_t *Data)
+{
+  if (CountAccesses)
+    StoreBytes.fetch_add(NumBytes, std::memory_order_relaxed);
+
+  if (Dev.hasPlugins())
+    Dev.reportMemoryStore(this, Address, NumBytes, Data);
+
+  memcpy(getPointerInBounds(Address, NumBytes), Data, NumBytes);
+}
+
+void Memory::unmap(uint64_t Base)
+{
+  if (Dev.hasPlugins())
+    Dev.reportMemoryUnmap(this, Base);
+}
 
 void Memory::copy(uint64_t DstAddress, Memory &DstMem, uint64_t SrcAddress,
                   const Memory &SrcMem, uint64_t NumBytes)
 {
-  uint64_t SrcId = (SrcAddress >> OFFSET_BITS);
-  uint64_t SrcOffset = (SrcAddress & (((uint64_t)-1) >> BUFFER_BITS));
+  if (SrcMem.CountAccesses)
+    SrcMem.LoadBytes.fetch_add(NumBytes, std::memory_order_relaxed);
+  if (DstMem.CountAccesses)
+    DstMem.StoreBytes.fetch_add(NumBytes, std::memory_order_relaxed);
 
-  SrcMem.Dev.reportMemoryLoad(&SrcMem, SrcAddress, NumBytes);
+  if (SrcMem.Dev.hasPlugins())
+    SrcMem.Dev.reportMemoryLoad(&SrcMem, SrcAddress, NumBytes);
 
-  if (!SrcMem.isAccessValid(SrcAddress, NumBytes))
+  const uint8_t *SrcPointer = SrcMem.getPointer(SrcAddress, NumBytes);
+  if (!SrcPointer)
   {
     std::stringstream Err;
     Err << "Invalid load of " << NumBytes << " bytes"
@@ -343,7 +853,7 @@ void Memory::copy(uint64_t DstAddress, Memory &DstMem, uint64_t SrcAddress,
     return;
   }
 
-  DstMem.store(DstAddress, NumBytes, SrcMem.Buffers[SrcId].Data + SrcOffset);
+  DstMem.store(DstAddress, NumBytes, SrcPointer);
 }
 
 // Explicit instantiations for types valid for atomic operations.
@@ -353,5 +863,19 @@ template uint32_t Memory::atomic(uint64_t Address, uint32_t Opcode,
 template int32_t Memory::atomic(uint64_t Address, uint32_t Opcode,
                                 uint32_t Scope, uint32_t Semantics,
                                 int32_t Value);
+template uint64_t Memory::atomic(uint64_t Address, uint32_t Opcode,
+                                 uint32_t Scope, uint32_t Semantics,
+                                 uint64_t Value);
+template int64_t Memory::atomic(uint64_t Address, uint32_t Opcode,
+                                uint32_t Scope, uint32_t Semantics,
+                                int64_t Value);
+template uint32_t Memory::atomicCmpXchg(uint64_t Address, uint32_t Scope,
+                                        uint32_t EqualSemantics,
+                                        uint32_t UnequalSemantics,
+                                        uint32_t Value, uint32_t Comparator);
+template uint64_t Memory::atomicCmpXchg(uint64_t Address, uint32_t Scope,
+                                        uint32_t EqualSemantics,
+                                        uint32_t UnequalSemantics,
+                                        uint64_t Value, uint64_t Comparator);
 
 } // namespace talvos
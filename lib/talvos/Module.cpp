@@ -7,13 +7,29 @@
 /// This file defines the Module class.
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
 #include <spirv-tools/libspirv.hpp>
 
 #include <spirv/unified1/spirv.h>
 
+#include "config.h"
+
+#if HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "talvos/Block.h"
 #include "talvos/EntryPoint.h"
 #include "talvos/Function.h"
@@ -25,63 +41,79 @@
 namespace talvos
 {
 
-/// Internal class used to construct a Module during SPIRV-Tools parsing.
-class ModuleBuilder
+/// Magic number at the start of a serialized module.
+#define SERIALIZED_MAGIC (0x4d53564c)
+
+/// Number of words in the header of a serialized module.
+/// The header holds the magic number, format version, SPIR-V hash (two
+/// words), SPIR-V length in words, SPIR-V digest (two words), payload hash
+/// (two words), and ID bound.
+#define SERIALIZED_HEADER_WORDS (10)
+
+/// Returns a 64-bit digest of \p NumWords words of SPIR-V binary data.
+/// This is computed independently of Module::hash(), so that a serialized
+/// module is only used for a binary that matches both of them.
+static uint64_t digest(const uint32_t *Words, size_t NumWords)
+{
+  uint64_t Digest = 0x9e3779b97f4a7c15ULL ^ NumWords;
+  for (size_t i = 0; i < NumWords; i++)
+  {
+    Digest ^= Words[i];
+    Digest = ((Digest << 31) | (Digest >> 33)) * 0xff51afd7ed558ccdULL;
+  }
+  Digest ^= Digest >> 33;
+  Digest *= 0xc4ceb9fe1a85ec53ULL;
+  Digest ^= Digest >> 33;
+  return Digest;
+}
+
+/// Information about a parsed module that is needed to build its functions.
+struct FunctionContext
+{
+  /// The result type of each result ID.
+  std::vector<const Type *> ResultTypes;
+
+  /// Flags indicating which result IDs are (non-specialization) constants.
+  std::vector<bool> Constants;
+
+  /// Flags indicating which module scope pointers are statically known to be
+  /// within the bounds of their allocation.
+  std::vector<bool> InBoundsPointers;
+};
+
+/// Internal class used to build a Function from its parsed instructions.
+class FunctionBuilder
 {
 public:
-  /// Initialize the module builder.
-  void init(uint32_t IdBound)
+  /// Create a function builder for a function in module \p Mod.
+  FunctionBuilder(const Module *Mod, const FunctionContext &Context)
+      : Mod(Mod), Context(Context), InBoundsPointers(Context.InBoundsPointers)
   {
-    assert(!Mod && "Module already initialized");
-    Mod = std::unique_ptr<Module>(new Module(IdBound));
-    CurrentFunction = nullptr;
-    CurrentBlock = nullptr;
     PreviousInstruction = nullptr;
   }
 
-  /// Process a parsed SPIR-V instruction.
+  /// Returns the Function that has been built.
+  std::unique_ptr<Function> getFunction() { return std::move(CurrentFunction); }
+
+  /// Process a parsed SPIR-V instruction from the function.
   void processInstruction(const spv_parsed_instruction_t *Inst)
   {
-    assert(Mod);
-
     if (Inst->opcode == SpvOpFunction)
     {
       assert(CurrentFunction == nullptr);
       const Type *FuncType =
           Mod->getType(Inst->words[Inst->operands[3].offset]);
       CurrentFunction = std::make_unique<Function>(Inst->result_id, FuncType);
-
-      // Check if this is an entry point.
-      if (EntryPoints.count(Inst->result_id))
-      {
-        EntryPointSpec EPS = EntryPoints.at(Inst->result_id);
-
-        // Gather the list of input/output variables used by the entry point.
-        VariableList Variables;
-        for (auto V : EPS.Variables)
-        {
-          auto ModVars = Mod->getVariables();
-          auto VarItr =
-              std::find_if(ModVars.begin(), ModVars.end(),
-                           [V](auto Var) { return Var->getId() == V; });
-          assert(VarItr != ModVars.end());
-          Variables.push_back(*VarItr);
-        }
-
-        // Create the entry point and add it to the module.
-        Mod->addEntryPoint(new EntryPoint(Inst->result_id, EPS.Name,
-                                          EPS.ExecutionModel,
-                                          CurrentFunction.get(), Variables));
-      }
     }
     else if (Inst->opcode == SpvOpFunctionEnd)
     {
       assert(CurrentFunction);
       assert(CurrentBlock);
       CurrentFunction->addBlock(std::move(CurrentBlock));
-      Mod->addFunction(std::move(CurrentFunction));
-      CurrentFunction = nullptr;
-      CurrentBlock = nullptr;
+
+      // Pre-decode the function now that all of its results are known.
+      CurrentFunction->decode(
+          [this](uint32_t Id) { return Context.ResultTypes[Id]; });
     }
     else if (Inst->opcode == SpvOpFunctionParameter)
     {
@@ -100,7 +132,7 @@ public:
       CurrentBlock = std::make_unique<Block>(Inst->result_id);
       PreviousInstruction = &CurrentBlock->getLabel();
     }
-    else if (CurrentFunction)
+    else
     {
       // Skip OpLine/OpNoLine instructions.
       if (Inst->opcode == SpvOpLine || Inst->opcode == SpvOpNoLine)
@@ -122,11 +154,246 @@ public:
                                        Operands, ResultType);
       delete[] Operands;
 
+      // Track pointers and memory accesses that are statically in bounds.
+      markInBounds(I, Inst->result_id);
+
       // Insert this instruction into the current block.
       assert(PreviousInstruction);
       I->insertAfter(PreviousInstruction);
       PreviousInstruction = I;
     }
+  }
+
+private:
+  /// Mark \p I (with result ID \p ResultId) if it produces a pointer or
+  /// accesses memory through a pointer that is statically known to be within
+  /// the bounds of its allocation.
+  ///
+  /// Only variables whose storage is allocated with the size of their type
+  /// and access chains into them with constant, in-range indices qualify.
+  /// Buffers can be bound with a smaller range than their declared type, so
+  /// accesses to them (and any access with a dynamic index) are always
+  /// checked in order to preserve robust buffer access semantics.
+  void markInBounds(Instruction *I, uint32_t ResultId)
+  {
+    switch (I->getOpcode())
+    {
+    case SpvOpAccessChain:
+    case SpvOpInBoundsAccessChain:
+    {
+      uint32_t BaseId = I->getOperand(2);
+      if (!InBoundsPointers[BaseId])
+        return;
+
+      // Walk the indices, computing the byte range of the result.
+      const Type *BaseTy = Context.ResultTypes[BaseId]->getElementType();
+      const Type *Ty = BaseTy;
+      uint64_t Offset = 0;
+      for (unsigned i = 3; i < I->getNumOperands(); i++)
+      {
+        uint32_t IndexId = I->getOperand(i);
+        if (!Context.Constants[IndexId])
+          return;
+
+        uint64_t Index;
+        const Object &IndexObj = Mod->getObject(IndexId);
+        switch (IndexObj.getType()->getSize())
+        {
+        case 2:
+          Index = IndexObj.get<uint16_t>();
+          break;
+        case 4:
+          Index = IndexObj.get<uint32_t>();
+          break;
+        case 8:
+          Index = IndexObj.get<uint64_t>();
+          break;
+        default:
+          return;
+        }
+        if (!Ty->isComposite() || Index >= Ty->getElementCount())
+          return;
+
+        // Matrices with explicit layouts are accessed element-wise.
+        if (Ty->getTypeId() == Type::STRUCT &&
+            Ty->getStructMemberDecorations((uint32_t)Index)
+                .count(SpvDecorationMatrixStride))
+          return;
+
+        Offset += Ty->getElementOffset(Index);
+        Ty = Ty->getElementType(Index);
+      }
+      if (Offset + Ty->getSize() <= BaseTy->getSize())
+        InBoundsPointers[ResultId] = true;
+      break;
+    }
+    case SpvOpCopyObject:
+      InBoundsPointers[ResultId] = InBoundsPointers[I->getOperand(2)];
+      break;
+    case SpvOpLoad:
+      if (InBoundsPointers[I->getOperand(2)])
+        I->setInBounds();
+      break;
+    case SpvOpStore:
+      if (InBoundsPointers[I->getOperand(0)])
+        I->setInBounds();
+      break;
+    case SpvOpVariable:
+      assert(I->getOperand(2) == SpvStorageClassFunction);
+      InBoundsPointers[ResultId] = true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  /// Internal FunctionBuilder variables.
+  ///\{
+  const Module *Mod;
+  const FunctionContext &Context;
+  std::unique_ptr<Function> CurrentFunction;
+  std::unique_ptr<Block> CurrentBlock;
+  Instruction *PreviousInstruction;
+  std::vector<bool> InBoundsPointers;
+  ///\}
+};
+
+/// Internal class used to construct a Module during SPIRV-Tools parsing.
+class ModuleBuilder
+{
+public:
+  /// Create a module builder for a SPIR-V binary of \p NumWords words, with
+  /// hash \p Hash and digest \p Digest.
+  ModuleBuilder(uint64_t Hash, uint32_t NumWords, uint64_t Digest)
+      : Hash(Hash), NumWords(NumWords), Digest(Digest)
+  {
+  }
+
+  /// Initialize the module builder.
+  void init(uint32_t IdBound)
+  {
+    assert(!Mod && "Module already initialized");
+    Mod = std::unique_ptr<Module>(new Module(IdBound));
+    CurrentFunction = 0;
+    Context = std::make_unique<FunctionContext>();
+    Context->ResultTypes.resize(IdBound);
+    Context->Constants.resize(IdBound);
+    Context->InBoundsPointers.resize(IdBound);
+
+    // Start the serialized form of the module with a header.
+    Serialized.assign(SERIALIZED_HEADER_WORDS, 0);
+    Serialized[0] = SERIALIZED_MAGIC;
+    Serialized[1] = Module::SERIALIZED_VERSION;
+    Serialized[2] = (uint32_t)Hash;
+    Serialized[3] = (uint32_t)(Hash >> 32);
+    Serialized[4] = NumWords;
+    Serialized[5] = (uint32_t)Digest;
+    Serialized[6] = (uint32_t)(Digest >> 32);
+    Serialized[9] = IdBound;
+  }
+
+  /// Process a parsed SPIR-V instruction.
+  void processInstruction(const spv_parsed_instruction_t *Inst)
+  {
+    assert(Mod);
+
+    // Record the parsed instruction in the serialized form of the module.
+    size_t RecordOffset = Serialized.size();
+    Serialized.push_back(Inst->opcode | (Inst->num_operands << 16));
+    Serialized.push_back(Inst->num_words);
+    Serialized.push_back(Inst->type_id);
+    Serialized.push_back(Inst->result_id);
+    Serialized.insert(Serialized.end(), Inst->words,
+                      Inst->words + Inst->num_words);
+    for (int i = 0; i < Inst->num_operands; i++)
+    {
+      Serialized.push_back(Inst->operands[i].offset |
+                           (Inst->operands[i].num_words << 16));
+    }
+
+    // Track result types, which are needed when decoding functions, and
+    // assign a register to each result produced inside a function.
+    if (Inst->type_id)
+    {
+      const Type *Ty = Mod->getType(Inst->type_id);
+      Context->ResultTypes[Inst->result_id] = Ty;
+      if (CurrentFunction)
+        Mod->addRegister(Inst->result_id, Ty);
+    }
+
+    if (Inst->opcode == SpvOpFunction)
+    {
+      assert(CurrentFunction == 0);
+      CurrentFunction = Inst->result_id;
+      CurrentFunctionBegin = RecordOffset;
+
+      // Check if this is an entry point.
+      if (EntryPoints.count(Inst->result_id))
+      {
+        EntryPointSpec EPS = EntryPoints.at(Inst->result_id);
+
+        // Gather the list of input/output variables used by the entry point.
+        VariableList Variables;
+        for (auto V : EPS.Variables)
+        {
+          auto ModVars = Mod->getVariables();
+          auto VarItr =
+              std::find_if(ModVars.begin(), ModVars.end(),
+                           [V](auto Var) { return Var->getId() == V; });
+          assert(VarItr != ModVars.end());
+          Variables.push_back(*VarItr);
+        }
+
+        // Create the entry point and add it to the module.
+        Mod->addEntryPoint(new EntryPoint(Inst->result_id, EPS.Name,
+                                          EPS.ExecutionModel, Mod.get(),
+                                          Variables));
+      }
+    }
+    else if (Inst->opcode == SpvOpFunctionEnd)
+    {
+      assert(CurrentFunction);
+
+      // The function body is built from its serialized instructions the first
+      // time that it is used, since most pipelines only use a few functions.
+      // Each function keeps its own records, so that they can be released
+      // once it has been built.
+      std::vector<uint32_t> Records(Serialized.begin() + CurrentFunctionBegin,
+                                    Serialized.end());
+      Serialized.resize(CurrentFunctionBegin);
+      Mod->addFunction(CurrentFunction, std::move(Records),
+                       std::move(CurrentCallees));
+      CurrentCallees.clear();
+      CurrentFunction = 0;
+    }
+    else if (CurrentFunction)
+    {
+      // Fragment shaders with derivatives need helper invocations.
+      switch (Inst->opcode)
+      {
+      case SpvOpDPdx:
+      case SpvOpDPdxCoarse:
+      case SpvOpDPdxFine:
+      case SpvOpDPdy:
+      case SpvOpDPdyCoarse:
+      case SpvOpDPdyFine:
+      case SpvOpFwidth:
+      case SpvOpFwidthCoarse:
+      case SpvOpFwidthFine:
+        Mod->setHasDerivatives();
+        break;
+      case SpvOpFunctionCall:
+      {
+        uint32_t Callee = Inst->words[Inst->operands[2].offset];
+        if (std::find(CurrentCallees.begin(), CurrentCallees.end(), Callee) ==
+            CurrentCallees.end())
+          CurrentCallees.push_back(Callee);
+        break;
+      }
+      default:
+        break;
+      }
+    }
     else
     {
       switch (Inst->opcode)
@@ -138,12 +405,14 @@ public:
         {
         case SpvCapabilityClipDistance:
         case SpvCapabilityCullDistance:
+        case SpvCapabilityDerivativeControl:
         case SpvCapabilityImage1D:
         case SpvCapabilityImageCubeArray:
         case SpvCapabilityImageQuery:
         case SpvCapabilityInputAttachment:
         case SpvCapabilityInt16:
         case SpvCapabilityInt64:
+        case SpvCapabilityInt64Atomics:
         case SpvCapabilityFloat64:
         case SpvCapabilityImageBuffer:
         case SpvCapabilityMatrix:
@@ -192,6 +461,8 @@ public:
           abort();
         }
         Mod->addObject(Inst->result_id, Constant);
+        if (Inst->opcode == SpvOpConstant)
+          Context->Constants[Inst->result_id] = true;
         break;
       }
       case SpvOpConstantComposite:
@@ -636,6 +907,20 @@ public:
         }
 
         Mod->addVariable(Var);
+
+        // Variables whose storage is always allocated with the size of their
+        // type can be accessed without bounds checks.
+        switch (Var->getType()->getStorageClass())
+        {
+        case SpvStorageClassInput:
+        case SpvStorageClassOutput:
+        case SpvStorageClassPrivate:
+        case SpvStorageClassWorkgroup:
+          Context->InBoundsPointers[Inst->result_id] = true;
+          break;
+        default:
+          break;
+        }
         break;
       }
       default:
@@ -648,15 +933,28 @@ public:
   };
 
   /// Returns the Module that has been built.
-  std::shared_ptr<Module> getModule() { return Mod; }
+  std::shared_ptr<Module> getModule()
+  {
+    if (Mod)
+    {
+      Mod->setSerializedData(Hash, std::move(Serialized));
+      Mod->setFunctionContext(std::move(Context));
+    }
+    return Mod;
+  }
 
 private:
   /// Internal ModuleBuilder variables.
   ///\{
   std::shared_ptr<Module> Mod;
-  std::unique_ptr<Function> CurrentFunction;
-  std::unique_ptr<Block> CurrentBlock;
-  Instruction *PreviousInstruction;
+  uint64_t Hash;
+  uint32_t NumWords;
+  uint64_t Digest;
+  std::vector<uint32_t> Serialized;
+  std::unique_ptr<FunctionContext> Context;
+  uint32_t CurrentFunction;
+  size_t CurrentFunctionBegin;
+  std::vector<uint32_t> CurrentCallees;
   std::map<uint32_t, uint32_t> ArrayStrides;
   std::map<std::pair<uint32_t, uint32_t>, std::map<uint32_t, uint32_t>>
       MemberDecorations;
@@ -692,11 +990,301 @@ HandleInstruction(void *user_data,
   return SPV_SUCCESS;
 }
 
+/// Returns true if an instruction with opcode \p Opcode may have \p NumOperands
+/// operands (including its result type and result ID).
+///
+/// The module and function builders and the instruction handlers read the
+/// operands that an instruction is required to have without checking that
+/// they are present. Parsed SPIR-V always satisfies this, and serialized
+/// records are checked against this before use so that a stale or damaged
+/// cache entry that passes the header checks cannot cause out-of-bounds reads.
+/// Opcodes that are never inspected are not checked. This is not a validator:
+/// the IDs referenced by operands are not checked against the ID bound, so
+/// serialized data must have been produced by Module::serialize().
+static bool isValidOperandCount(uint16_t Opcode, uint16_t NumOperands)
+{
+  uint16_t Min, Max = UINT16_MAX;
+  switch (Opcode)
+  {
+  case SpvOpFunctionEnd:
+  case SpvOpKill:
+  case SpvOpNoLine:
+  case SpvOpNop:
+  case SpvOpReturn:
+  case SpvOpUnreachable:
+    Min = Max = 0;
+    break;
+  case SpvOpBranch:
+  case SpvOpCapability:
+  case SpvOpExtension:
+  case SpvOpLabel:
+  case SpvOpModuleProcessed:
+  case SpvOpReturnValue:
+  case SpvOpSourceContinued:
+  case SpvOpSourceExtension:
+  case SpvOpTypeBool:
+  case SpvOpTypeSampler:
+  case SpvOpTypeVoid:
+    Min = Max = 1;
+    break;
+  case SpvOpConstantFalse:
+  case SpvOpConstantNull:
+  case SpvOpConstantTrue:
+  case SpvOpExtInstImport:
+  case SpvOpFunctionParameter:
+  case SpvOpMemoryBarrier:
+  case SpvOpMemoryModel:
+  case SpvOpName:
+  case SpvOpSelectionMerge:
+  case SpvOpSpecConstantFalse:
+  case SpvOpSpecConstantTrue:
+  case SpvOpString:
+  case SpvOpTypeFloat:
+  case SpvOpTypeRuntimeArray:
+  case SpvOpTypeSampledImage:
+  case SpvOpUndef:
+    Min = Max = 2;
+    break;
+  case SpvOpAll:
+  case SpvOpAny:
+  case SpvOpBitcast:
+  case SpvOpConstant:
+  case SpvOpControlBarrier:
+  case SpvOpConvertFToS:
+  case SpvOpConvertFToU:
+  case SpvOpConvertSToF:
+  case SpvOpConvertUToF:
+  case SpvOpCopyObject:
+  case SpvOpDPdx:
+  case SpvOpDPdxCoarse:
+  case SpvOpDPdxFine:
+  case SpvOpDPdy:
+  case SpvOpDPdyCoarse:
+  case SpvOpDPdyFine:
+  case SpvOpFConvert:
+  case SpvOpFNegate:
+  case SpvOpFwidth:
+  case SpvOpFwidthCoarse:
+  case SpvOpFwidthFine:
+  case SpvOpImage:
+  case SpvOpImageQuerySize:
+  case SpvOpIsInf:
+  case SpvOpIsNan:
+  case SpvOpLine:
+  case SpvOpLogicalNot:
+  case SpvOpMemberName:
+  case SpvOpNot:
+  case SpvOpSConvert:
+  case SpvOpSNegate:
+  case SpvOpSpecConstant:
+  case SpvOpTypeArray:
+  case SpvOpTypeInt:
+  case SpvOpTypeMatrix:
+  case SpvOpTypePointer:
+  case SpvOpTypeVector:
+  case SpvOpUConvert:
+    Min = Max = 3;
+    break;
+  case SpvOpAtomicStore:
+  case SpvOpBitwiseAnd:
+  case SpvOpBitwiseOr:
+  case SpvOpBitwiseXor:
+  case SpvOpDot:
+  case SpvOpFAdd:
+  case SpvOpFDiv:
+  case SpvOpFMod:
+  case SpvOpFMul:
+  case SpvOpFOrdEqual:
+  case SpvOpFOrdGreaterThan:
+  case SpvOpFOrdGreaterThanEqual:
+  case SpvOpFOrdLessThan:
+  case SpvOpFOrdLessThanEqual:
+  case SpvOpFOrdNotEqual:
+  case SpvOpFRem:
+  case SpvOpFSub:
+  case SpvOpFUnordEqual:
+  case SpvOpFUnordGreaterThan:
+  case SpvOpFUnordGreaterThanEqual:
+  case SpvOpFUnordLessThan:
+  case SpvOpFUnordLessThanEqual:
+  case SpvOpFUnordNotEqual:
+  case SpvOpFunction:
+  case SpvOpIAdd:
+  case SpvOpIEqual:
+  case SpvOpIMul:
+  case SpvOpINotEqual:
+  case SpvOpISub:
+  case SpvOpImageQuerySizeLod:
+  case SpvOpLogicalAnd:
+  case SpvOpLogicalEqual:
+  case SpvOpLogicalNotEqual:
+  case SpvOpLogicalOr:
+  case SpvOpMatrixTimesScalar:
+  case SpvOpMatrixTimesVector:
+  case SpvOpSDiv:
+  case SpvOpSGreaterThan:
+  case SpvOpSGreaterThanEqual:
+  case SpvOpSLessThan:
+  case SpvOpSLessThanEqual:
+  case SpvOpSMod:
+  case SpvOpSRem:
+  case SpvOpSampledImage:
+  case SpvOpShiftLeftLogical:
+  case SpvOpShiftRightArithmetic:
+  case SpvOpShiftRightLogical:
+  case SpvOpUDiv:
+  case SpvOpUGreaterThan:
+  case SpvOpUGreaterThanEqual:
+  case SpvOpULessThan:
+  case SpvOpULessThanEqual:
+  case SpvOpUMod:
+  case SpvOpVectorExtractDynamic:
+  case SpvOpVectorTimesMatrix:
+  case SpvOpVectorTimesScalar:
+    Min = Max = 4;
+    break;
+  case SpvOpAtomicIDecrement:
+  case SpvOpAtomicIIncrement:
+  case SpvOpAtomicLoad:
+  case SpvOpSelect:
+  case SpvOpVectorInsertDynamic:
+    Min = Max = 5;
+    break;
+  case SpvOpAtomicAnd:
+  case SpvOpAtomicExchange:
+  case SpvOpAtomicIAdd:
+  case SpvOpAtomicISub:
+  case SpvOpAtomicOr:
+  case SpvOpAtomicSMax:
+  case SpvOpAtomicSMin:
+  case SpvOpAtomicUMax:
+  case SpvOpAtomicUMin:
+  case SpvOpAtomicXor:
+    Min = Max = 6;
+    break;
+  case SpvOpAtomicCompareExchange:
+    Min = Max = 8;
+    break;
+  case SpvOpTypeImage:
+    Min = 8;
+    Max = 9;
+    break;
+  case SpvOpSource:
+    Min = 2;
+    Max = 4;
+    break;
+  case SpvOpBranchConditional:
+    Min = 3;
+    Max = 5;
+    break;
+  case SpvOpVariable:
+    Min = 3;
+    Max = 4;
+    break;
+  case SpvOpTypeStruct:
+    Min = 1;
+    break;
+  case SpvOpCompositeConstruct:
+  case SpvOpConstantComposite:
+  case SpvOpCopyMemory:
+  case SpvOpDecorate:
+  case SpvOpExecutionMode:
+  case SpvOpSpecConstantComposite:
+  case SpvOpStore:
+  case SpvOpTypeFunction:
+    Min = 2;
+    break;
+  case SpvOpAccessChain:
+  case SpvOpCompositeExtract:
+  case SpvOpEntryPoint:
+  case SpvOpFunctionCall:
+  case SpvOpImageWrite:
+  case SpvOpInBoundsAccessChain:
+  case SpvOpLoad:
+  case SpvOpLoopMerge:
+  case SpvOpMemberDecorate:
+  case SpvOpSpecConstantOp:
+    Min = 3;
+    break;
+  case SpvOpCompositeInsert:
+  case SpvOpExtInst:
+  case SpvOpImageFetch:
+  case SpvOpImageRead:
+  case SpvOpPtrAccessChain:
+  case SpvOpVectorShuffle:
+    Min = 4;
+    break;
+  case SpvOpImageSampleExplicitLod:
+    Min = 5;
+    break;
+  case SpvOpPhi:
+  case SpvOpSwitch:
+    // Operands after the first two come in pairs.
+    return NumOperands >= 2 && NumOperands % 2 == 0;
+  default:
+    return true;
+  }
+  return NumOperands >= Min && NumOperands <= Max;
+}
+
+/// Read the parsed instruction record at word \p Offset in the serialized
+/// module \p Words into \p Inst, using \p Operands to hold the operand
+/// descriptions. \p Offset is advanced to the start of the next record.
+/// Returns false if the record is malformed.
+static bool readRecord(const std::vector<uint32_t> &Words, size_t &Offset,
+                       uint32_t IdBound, spv_parsed_instruction_t &Inst,
+                       std::vector<spv_parsed_operand_t> &Operands)
+{
+  if (Words.size() - Offset < 4)
+    return false;
+
+  Inst = {};
+  Inst.opcode = (uint16_t)Words[Offset];
+  Inst.num_operands = (uint16_t)(Words[Offset] >> 16);
+  Inst.num_words = (uint16_t)Words[Offset + 1];
+  Inst.type_id = Words[Offset + 2];
+  Inst.result_id = Words[Offset + 3];
+  Offset += 4;
+  if (Inst.type_id >= IdBound || Inst.result_id >= IdBound ||
+      Words.size() - Offset < (size_t)Inst.num_words + Inst.num_operands)
+    return false;
+
+  Inst.words = Words.data() + Offset;
+  Offset += Inst.num_words;
+
+  Operands.assign(Inst.num_operands, spv_parsed_operand_t());
+  for (uint16_t i = 0; i < Inst.num_operands; i++, Offset++)
+  {
+    Operands[i].offset = (uint16_t)Words[Offset];
+    Operands[i].num_words = (uint16_t)(Words[Offset] >> 16);
+    if (Operands[i].num_words == 0 ||
+        Operands[i].offset + Operands[i].num_words > Inst.num_words)
+      return false;
+  }
+  Inst.operands = Operands.data();
+
+  // Check that the operands that will be read are present. The operands of
+  // OpSpecConstantOp are those of the instruction that it encodes, in place
+  // of its third operand.
+  if (!isValidOperandCount(Inst.opcode, Inst.num_operands))
+    return false;
+  if (Inst.opcode == SpvOpSpecConstantOp &&
+      !isValidOperandCount((uint16_t)Inst.words[Operands[2].offset],
+                           Inst.num_operands - 1))
+    return false;
+
+  return true;
+}
+
 Module::Module(uint32_t IdBound)
 {
   this->IdBound = IdBound;
   this->Objects.resize(IdBound);
+  RegisterFileSize = 0;
   WorkgroupSizeId = 0;
+  HasDerivatives = false;
+  Hash = 0;
+  NumUnbuilt = 0;
 }
 
 Module::~Module()
@@ -717,10 +1305,15 @@ void Module::addEntryPoint(EntryPoint *EP)
   EntryPoints.push_back(EP);
 }
 
-void Module::addFunction(std::unique_ptr<Function> Func)
+void Module::addFunction(uint32_t Id, std::vector<uint32_t> &&Records,
+                         std::vector<uint32_t> &&Callees)
 {
-  assert(Functions.count(Func->getId()) == 0);
-  Functions[Func->getId()] = std::move(Func);
+  assert(Functions.count(Id) == 0);
+  Functions[Id] = std::make_unique<LazyFunction>();
+  Functions[Id]->Records = std::move(Records);
+  Functions[Id]->Callees = std::move(Callees);
+  FunctionOrder.push_back(Id);
+  NumUnbuilt++;
 }
 
 void Module::addLocalSize(uint32_t Entry, Dim3 LocalSize)
@@ -735,6 +1328,19 @@ void Module::addObject(uint32_t Id, const Object &Obj)
   Objects[Id] = Obj;
 }
 
+void Module::addRegister(uint32_t Id, const Type *Ty)
+{
+  size_t Size = Ty->getSize();
+  if (Size == 0)
+    return;
+
+  // Align each register so that it can hold any scalar type.
+  const size_t Alignment = 8;
+  RegisterFileSize = (RegisterFileSize + Alignment - 1) & ~(Alignment - 1);
+  Registers.push_back({Id, RegisterFileSize});
+  RegisterFileSize += Size;
+}
+
 void Module::addSpecConstant(uint32_t SpecId, uint32_t ResultId)
 {
   // TODO: Allow the same SpecId to apply to multiple results.
@@ -753,6 +1359,51 @@ void Module::addType(uint32_t Id, std::unique_ptr<Type> Ty)
   Types[Id] = std::move(Ty);
 }
 
+std::unique_ptr<Function>
+Module::buildFunction(const std::vector<uint32_t> &Records) const
+{
+  // Replay the parsed instructions of the function through a builder.
+  FunctionBuilder FB(this, *Context);
+  spv_parsed_instruction_t Inst;
+  std::vector<spv_parsed_operand_t> Operands;
+  size_t Offset = 0;
+  while (Offset < Records.size())
+  {
+    bool Valid = readRecord(Records, Offset, IdBound, Inst, Operands);
+    assert(Valid && "invalid serialized function");
+    (void)Valid;
+    FB.processInstruction(&Inst);
+  }
+  return FB.getFunction();
+}
+
+std::vector<uint32_t> Module::getUnbuiltFunctions(uint32_t Id) const
+{
+  // Find the functions that are reachable from this function.
+  std::vector<uint32_t> Reachable = {Id};
+  for (size_t i = 0; i < Reachable.size(); i++)
+  {
+    auto Itr = Functions.find(Reachable[i]);
+    if (Itr == Functions.end())
+      return {};
+
+    for (uint32_t Callee : Itr->second->Callees)
+    {
+      if (std::find(Reachable.begin(), Reachable.end(), Callee) ==
+          Reachable.end())
+        Reachable.push_back(Callee);
+    }
+  }
+
+  // Drop the functions that have already been built.
+  Reachable.erase(std::remove_if(Reachable.begin(), Reachable.end(),
+                                 [&](uint32_t F) {
+                                   return Functions.at(F)->IsBuilt.load();
+                                 }),
+                  Reachable.end());
+  return Reachable;
+}
+
 const EntryPoint *Module::getEntryPoint(const std::string &Name,
                                         uint32_t ExecutionModel) const
 {
@@ -766,9 +1417,22 @@ const EntryPoint *Module::getEntryPoint(const std::string &Name,
 
 const Function *Module::getFunction(uint32_t Id) const
 {
-  if (!Functions.count(Id))
+  auto Itr = Functions.find(Id);
+  if (Itr == Functions.end())
     return nullptr;
-  return Functions.at(Id).get();
+
+  // Build the function the first time that it is used.
+  // The records of this function are only released once it has been built, so
+  // they do not need to be locked while building it.
+  LazyFunction &LF = *Itr->second;
+  std::call_once(LF.Built, [&]() {
+    LF.Func = buildFunction(LF.Records);
+    LF.IsBuilt = true;
+    releaseRecords(LF);
+    if (--NumUnbuilt == 0)
+      Context.reset();
+  });
+  return LF.Func.get();
 }
 
 Dim3 Module::getLocalSize(uint32_t Entry) const
@@ -795,6 +1459,67 @@ const std::vector<Instruction *> &Module::getSpecConstantOps() const
   return SpecConstantOps;
 }
 
+uint64_t Module::hash(const uint32_t *Words, size_t NumWords)
+{
+  // 64-bit FNV-1a hash, applied to each byte of the data.
+  const uint8_t *Bytes = (const uint8_t *)Words;
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < NumWords * 4; i++)
+  {
+    Hash ^= Bytes[i];
+    Hash *= 0x100000001b3ULL;
+  }
+  return Hash;
+}
+
+void Module::releaseRecords(LazyFunction &LF) const
+{
+  // The module can no longer be serialized without the records of this
+  // function, so the module scope records are released too.
+  std::unique_lock<std::shared_mutex> Lock(RecordsMutex);
+  std::vector<uint32_t>().swap(LF.Records);
+  std::vector<uint32_t>().swap(SerializedData);
+}
+
+std::vector<uint8_t> Module::serialize() const
+{
+  std::shared_lock<std::shared_mutex> Lock(RecordsMutex);
+  if (SerializedData.empty())
+    return {};
+
+  // Append the records of each function to the module scope records.
+  std::vector<uint32_t> Words = SerializedData;
+  for (uint32_t Id : FunctionOrder)
+  {
+    const std::vector<uint32_t> &Records = Functions.at(Id)->Records;
+    Words.insert(Words.end(), Records.begin(), Records.end());
+  }
+  Lock.unlock();
+
+  // Record the hash of the payload, to detect corrupted data when loading.
+  uint64_t PayloadHash = hash(Words.data() + SERIALIZED_HEADER_WORDS,
+                              Words.size() - SERIALIZED_HEADER_WORDS);
+  Words[7] = (uint32_t)PayloadHash;
+  Words[8] = (uint32_t)(PayloadHash >> 32);
+
+  std::vector<uint8_t> Data(Words.size() * 4);
+  memcpy(Data.data(), Words.data(), Data.size());
+  return Data;
+}
+
+void Module::setSerializedData(uint64_t Hash, std::vector<uint32_t> &&Data)
+{
+  assert(Data.size() >= SERIALIZED_HEADER_WORDS);
+  this->Hash = Hash;
+  SerializedData = std::move(Data);
+  SerializedData.shrink_to_fit();
+}
+
+void Module::setFunctionContext(std::unique_ptr<FunctionContext> Context)
+{
+  this->Context = std::move(Context);
+}
+
 const Type *Module::getType(uint32_t Id) const
 {
   if (Types.count(Id) == 0)
@@ -802,8 +1527,90 @@ const Type *Module::getType(uint32_t Id) const
   return Types.at(Id).get();
 }
 
+/// Create a new module from data produced by Module::serialize(), for the
+/// SPIR-V binary \p Words with hash \p Hash.
+/// Returns nullptr if \p Data is not a valid serialized copy of that binary.
+static std::shared_ptr<Module> deserialize(const uint8_t *Data,
+                                           size_t NumBytes, uint64_t Hash,
+                                           const uint32_t *Words,
+                                           size_t NumWords)
+{
+  if (NumBytes % 4 || NumBytes < SERIALIZED_HEADER_WORDS * 4)
+    return nullptr;
+
+  // Copy the data to guarantee word alignment.
+  std::vector<uint32_t> Records(NumBytes / 4);
+  memcpy(Records.data(), Data, NumBytes);
+
+  // Check the header, and that the payload has not been corrupted.
+  if (Records[0] != SERIALIZED_MAGIC ||
+      Records[1] != Module::SERIALIZED_VERSION)
+    return nullptr;
+  uint64_t PayloadHash = Records[7] | ((uint64_t)Records[8] << 32);
+  if (Module::hash(Records.data() + SERIALIZED_HEADER_WORDS,
+                   Records.size() - SERIALIZED_HEADER_WORDS) != PayloadHash)
+    return nullptr;
+
+  // Check that the records were produced from the same SPIR-V binary, using
+  // its length and a second digest in case of a collision between hashes.
+  if (Records[2] != (uint32_t)Hash || Records[3] != (uint32_t)(Hash >> 32) ||
+      Records[4] != NumWords)
+    return nullptr;
+  uint64_t Digest = digest(Words, NumWords);
+  if (Records[5] != (uint32_t)Digest || Records[6] != (uint32_t)(Digest >> 32))
+    return nullptr;
+  uint32_t IdBound = Records[9];
+
+  // Replay the parsed instructions through a module builder.
+  ModuleBuilder MB(Hash, (uint32_t)NumWords, Digest);
+  MB.init(IdBound);
+  spv_parsed_instruction_t Inst;
+  std::vector<spv_parsed_operand_t> Operands;
+  size_t Offset = SERIALIZED_HEADER_WORDS;
+  while (Offset < Records.size())
+  {
+    if (!readRecord(Records, Offset, IdBound, Inst, Operands))
+      return nullptr;
+    MB.processInstruction(&Inst);
+  }
+
+  return MB.getModule();
+}
+
+std::shared_ptr<Module> Module::deserialize(const uint8_t *Data,
+                                            size_t NumBytes,
+                                            const uint32_t *Words,
+                                            size_t NumWords)
+{
+  return talvos::deserialize(Data, NumBytes, hash(Words, NumWords), Words,
+                             NumWords);
+}
+
 std::shared_ptr<Module> Module::load(const uint32_t *Words, size_t NumWords)
 {
+  uint64_t Hash = hash(Words, NumWords);
+
+  // Look for a serialized copy of this module in the on-disk cache.
+  std::string CacheFile;
+  if (const char *CacheDir = getenv("TALVOS_CACHE_DIR"))
+  {
+    std::stringstream SS;
+    SS << CacheDir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << Hash << ".tmod";
+    CacheFile = SS.str();
+
+    std::ifstream Stream(CacheFile, std::ios::binary);
+    if (Stream)
+    {
+      std::vector<uint8_t> Data((std::istreambuf_iterator<char>(Stream)),
+                                std::istreambuf_iterator<char>());
+      std::shared_ptr<Module> M = talvos::deserialize(
+          Data.data(), Data.size(), Hash, Words, NumWords);
+      if (M)
+        return M;
+    }
+  }
+
   spvtools::Context SPVContext(SPV_ENV_VULKAN_1_1);
   spv_diagnostic Diagnostic = nullptr;
 
@@ -815,7 +1622,7 @@ std::shared_ptr<Module> Module::load(const uint32_t *Words, size_t NumWords)
   }
 
   // Parse binary.
-  ModuleBuilder MB;
+  ModuleBuilder MB(Hash, (uint32_t)NumWords, digest(Words, NumWords));
   spvBinaryParse(SPVContext.CContext(), &MB, Words, NumWords, HandleHeader,
                  HandleInstruction, &Diagnostic);
   if (Diagnostic)
@@ -823,40 +1630,41 @@ std::shared_ptr<Module> Module::load(const uint32_t *Words, size_t NumWords)
     spvDiagnosticPrint(Diagnostic);
     return nullptr;
   }
+  std::shared_ptr<Module> M = MB.getModule();
 
-  return MB.getModule();
-}
-
-std::shared_ptr<Module> Module::load(const std::string &FileName)
-{
-  // Open file.
-  FILE *SPVFile = fopen(FileName.c_str(), "rb");
-  if (!SPVFile)
+  // Add the module to the on-disk cache.
+  // Write to a temporary file first, so that other processes never observe a
+  // partially written module.
+  if (M && !CacheFile.empty())
   {
-    std::cerr << "Failed to open '" << FileName << "'" << std::endl;
-    return nullptr;
+    std::string TempFile =
+        CacheFile + "." + std::to_string(std::random_device()());
+    std::vector<uint8_t> Data = M->serialize();
+    std::ofstream Stream(TempFile, std::ios::binary);
+    Stream.write((const char *)Data.data(), Data.size());
+    Stream.close();
+    if (!Stream || std::rename(TempFile.c_str(), CacheFile.c_str()))
+      std::remove(TempFile.c_str());
   }
 
-  // Read file data.
-  std::vector<uint8_t> Bytes;
-  fseek(SPVFile, 0, SEEK_END);
-  long NumBytes = ftell(SPVFile);
-  Bytes.resize(NumBytes);
-  fseek(SPVFile, 0, SEEK_SET);
-  fread(Bytes.data(), 1, NumBytes, SPVFile);
-  fclose(SPVFile);
+  return M;
+}
 
+/// Create a new module from the contents of a SPIR-V binary or text file.
+static std::shared_ptr<Module> loadFileData(const uint8_t *Data,
+                                            size_t NumBytes)
+{
   // Check for SPIR-V magic number.
-  if (((uint32_t *)Bytes.data())[0] == 0x07230203)
-    return load((uint32_t *)Bytes.data(), NumBytes / 4);
+  if (NumBytes >= 4 && ((const uint32_t *)Data)[0] == 0x07230203)
+    return Module::load((const uint32_t *)Data, NumBytes / 4);
 
   // Assume file is in textual SPIR-V format.
   // Assemble it to a SPIR-V binary in memory.
   spv_binary Binary;
   spv_diagnostic Diagnostic = nullptr;
   spvtools::Context SPVContext(SPV_ENV_VULKAN_1_1);
-  spvTextToBinary(SPVContext.CContext(), (const char *)Bytes.data(), NumBytes,
-                  &Binary, &Diagnostic);
+  spvTextToBinary(SPVContext.CContext(), (const char *)Data, NumBytes, &Binary,
+                  &Diagnostic);
   if (Diagnostic)
   {
     spvDiagnosticPrint(Diagnostic);
@@ -865,9 +1673,73 @@ std::shared_ptr<Module> Module::load(const std::string &FileName)
   }
 
   // Load and return Module.
-  std::shared_ptr<Module> M = load(Binary->code, Binary->wordCount);
+  std::shared_ptr<Module> M = Module::load(Binary->code, Binary->wordCount);
   spvBinaryDestroy(Binary);
   return M;
 }
 
+std::shared_ptr<Module> Module::load(const std::string &FileName)
+{
+  const uint8_t *Data = nullptr;
+  size_t NumBytes = 0;
+  std::vector<uint8_t> Bytes;
+
+#if HAVE_MMAP
+  // Map the file into memory, so that it is parsed straight from the mapped
+  // pages instead of first being copied into a buffer.
+  int FD = open(FileName.c_str(), O_RDONLY);
+  if (FD < 0)
+  {
+    std::cerr << "Failed to open '" << FileName << "'" << std::endl;
+    return nullptr;
+  }
+  struct stat Stat;
+  if (fstat(FD, &Stat) == 0 && Stat.st_size > 0)
+  {
+    void *Addr = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+    if (Addr != MAP_FAILED)
+    {
+#ifdef MADV_SEQUENTIAL
+      // The file is read from start to end when hashing, validating and
+      // parsing it.
+      madvise(Addr, Stat.st_size, MADV_SEQUENTIAL);
+#endif
+      Data = (const uint8_t *)Addr;
+      NumBytes = Stat.st_size;
+    }
+  }
+  close(FD);
+  bool Mapped = Data != nullptr;
+#endif
+
+  if (!Data)
+  {
+    // Open file.
+    FILE *SPVFile = fopen(FileName.c_str(), "rb");
+    if (!SPVFile)
+    {
+      std::cerr << "Failed to open '" << FileName << "'" << std::endl;
+      return nullptr;
+    }
+
+    // Read file data.
+    fseek(SPVFile, 0, SEEK_END);
+    NumBytes = ftell(SPVFile);
+    Bytes.resize(NumBytes);
+    fseek(SPVFile, 0, SEEK_SET);
+    fread(Bytes.data(), 1, NumBytes, SPVFile);
+    fclose(SPVFile);
+    Data = Bytes.data();
+  }
+
+  std::shared_ptr<Module> M = loadFileData(Data, NumBytes);
+
+#if HAVE_MMAP
+  if (Mapped)
+    munmap((void *)Data, NumBytes);
+#endif
+
+  return M;
+}
+
 } // namespace talvos
@@ -35,12 +35,25 @@ template <typename T> Object::Object(const Type *Ty, T Value) : Object(Ty)
   *((T *)Data) = Value;
 }
 
-Object::~Object() { delete[] Data; }
+Object::~Object()
+{
+  if (Ownership == OWNED)
+    delete[] Data;
+}
 
 Object::Object(const Object &Src)
 {
+  Ty = nullptr;
   Data = nullptr;
-  if (Src)
+  if (Src.Ownership == SHARED)
+  {
+    Ty = Src.Ty;
+    Data = Src.Data;
+    Ownership = SHARED;
+    MatrixLayout = Src.MatrixLayout;
+    DescriptorElements = Src.DescriptorElements;
+  }
+  else if (Src)
   {
     Ty = Src.Ty;
     Data = new uint8_t[Ty->getSize()];
@@ -52,11 +65,24 @@ Object::Object(const Object &Src)
 
 Object &Object::operator=(const Object &Src)
 {
-  if (this != &Src)
+  if (this == &Src)
+    return *this;
+
+  if (Ownership == BOUND)
+  {
+    // Copy the data into the bound storage in place.
+    if (Src)
+      memcpy(Data, Src.Data, Src.Ty->getSize());
+    Ty = Src ? Src.Ty : nullptr;
+    MatrixLayout = Src.MatrixLayout;
+    DescriptorElements = Src.DescriptorElements;
+  }
+  else
   {
     Object Tmp(Src);
     std::swap(Data, Tmp.Data);
     std::swap(Ty, Tmp.Ty);
+    std::swap(Ownership, Tmp.Ownership);
     std::swap(MatrixLayout, Tmp.MatrixLayout);
     std::swap(DescriptorElements, Tmp.DescriptorElements);
   }
@@ -67,11 +93,23 @@ Object::Object(Object &&Src) noexcept
 {
   Ty = Src.Ty;
   Data = Src.Data;
+  Ownership = Src.Ownership;
   MatrixLayout = Src.MatrixLayout;
   DescriptorElements = Src.DescriptorElements;
   Src.Data = nullptr;
 }
 
+void Object::bind(uint8_t *Storage)
+{
+  if (Ownership == OWNED)
+    delete[] Data;
+  Ty = nullptr;
+  Data = Storage;
+  Ownership = BOUND;
+  MatrixLayout = PtrMatrixLayout();
+  DescriptorElements = nullptr;
+}
+
 Object Object::extract(const std::vector<uint32_t> &Indices) const
 {
   assert(Data);
@@ -118,6 +156,7 @@ const PtrMatrixLayout &Object::getMatrixLayout() const
 void Object::insert(const std::vector<uint32_t> &Indices, const Object &Element)
 {
   assert(Data);
+  assert(Ownership != SHARED && "Cannot modify shared data");
 
   // Loop over indices to compute byte offset.
   size_t Offset = 0;
@@ -146,8 +185,15 @@ Object Object::load(const Type *Ty, const Memory &Mem, uint64_t Address)
 Object Object::load(const Type *Ty, const Memory &Mem, const Object &Pointer)
 {
   Object Result;
-  Result.Ty = Ty;
-  Result.Data = new uint8_t[Ty->getSize()];
+  Result.loadFrom(Ty, Mem, Pointer);
+  return Result;
+}
+
+void Object::loadFrom(const Type *Ty, const Memory &Mem, const Object &Pointer,
+                      bool InBounds)
+{
+  reset(Ty);
+  this->Ty = nullptr;
 
   // Special case for loading matrices from memory with non-default layouts.
   if (Pointer.MatrixLayout)
@@ -162,7 +208,7 @@ Object Object::load(const Type *Ty, const Memory &Mem, const Object &Pointer)
     for (uint32_t Col = 0; Col < NumCols; Col++)
     {
       // Calculate offsets into source and destination pointers.
-      uint8_t *DstPtr = Result.Data + Ty->getElementOffset(Col);
+      uint8_t *DstPtr = Data + Ty->getElementOffset(Col);
       uint64_t SrcPtr = Pointer.get<uint64_t>();
       if (Pointer.MatrixLayout.Order == PtrMatrixLayout::COL_MAJOR)
         SrcPtr += Col * Pointer.MatrixLayout.Stride;
@@ -183,12 +229,16 @@ Object Object::load(const Type *Ty, const Memory &Mem, const Object &Pointer)
       }
     }
   }
+  else if (InBounds)
+  {
+    Mem.loadInBounds(Data, Pointer.get<uint64_t>(), Ty->getSize());
+  }
   else
   {
-    Mem.load(Result.Data, Pointer.get<uint64_t>(), Ty->getSize());
+    Mem.load(Data, Pointer.get<uint64_t>(), Ty->getSize());
   }
 
-  return Result;
+  this->Ty = Ty;
 }
 
 /// Recursively print typed data to a stream.
@@ -292,15 +342,47 @@ std::ostream &operator<<(std::ostream &Stream, const Object &O)
   return Stream;
 }
 
+void Object::reset(const Type *Ty)
+{
+  assert(Ty);
+
+  // Allocate a new data store unless the existing one can be reused.
+  bool Reuse = (Ownership == BOUND);
+  if (Ownership == OWNED && *this)
+    Reuse = (this->Ty->getSize() == Ty->getSize());
+  if (!Reuse)
+  {
+    if (Ownership == OWNED)
+      delete[] Data;
+    Data = new uint8_t[Ty->getSize()];
+    Ownership = OWNED;
+  }
+  this->Ty = Ty;
+  MatrixLayout = PtrMatrixLayout();
+  DescriptorElements = nullptr;
+}
+
 template <typename T> void Object::set(T Value, uint32_t Element)
 {
   assert(Data);
+  assert(Ownership != SHARED && "Cannot modify shared data");
   assert(Ty->isScalar() || Ty->isVector());
   assert(Ty->isScalar() ? (sizeof(T) == Ty->getSize() && Element == 0)
                         : sizeof(T) == Ty->getElementType()->getSize());
   ((T *)Data)[Element] = Value;
 }
 
+Object Object::share() const
+{
+  Object Result;
+  Result.Ty = Ty;
+  Result.Data = Data;
+  Result.Ownership = SHARED;
+  Result.MatrixLayout = MatrixLayout;
+  Result.DescriptorElements = DescriptorElements;
+  return Result;
+}
+
 void Object::setDescriptorElements(const DescriptorElement *DAE)
 {
   assert(Ty->isPointer() && Ty->getElementType()->isArray());
@@ -320,7 +402,7 @@ void Object::store(Memory &Mem, uint64_t Address) const
   Mem.store(Address, Ty->getSize(), Data);
 }
 
-void Object::store(Memory &Mem, const Object &Pointer) const
+void Object::store(Memory &Mem, const Object &Pointer, bool InBounds) const
 {
   assert(Data);
 
@@ -358,13 +440,21 @@ void Object::store(Memory &Mem, const Object &Pointer) const
       }
     }
   }
+  else if (InBounds)
+  {
+    Mem.storeInBounds(Pointer.get<uint64_t>(), Ty->getSize(), Data);
+  }
   else
   {
     Mem.store(Pointer.get<uint64_t>(), Ty->getSize(), Data);
   }
 }
 
-void Object::zero() { memset(Data, 0, Ty->getSize()); }
+void Object::zero()
+{
+  assert(Ownership != SHARED && "Cannot modify shared data");
+  memset(Data, 0, Ty->getSize());
+}
 
 // Explicit template instantiations for scalar types.
 ///\{
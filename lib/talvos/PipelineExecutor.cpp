@@ -57,6 +57,21 @@
 /// The number of lines before and after the current instruction to print.
 #define CONTEXT_SIZE 3
 
+/// The width and height (in pixels) of the screen-space tiles used to bin
+/// primitives during rasterization.
+#define TILE_SIZE 32
+
+/// The width and height (in pixels) of the blocks that triangles are
+/// classified against before individual fragments are tested.
+#define BLOCK_SIZE 8
+
+/// Tolerance used when testing barycentric coordinates against zero.
+#define EDGE_EPSILON 1.e-7f
+
+/// Tolerance used when classifying blocks, to allow for rounding differences
+/// between the block corners and the fragments within.
+#define BLOCK_EPSILON 1.e-5f
+
 namespace talvos
 {
 
@@ -64,6 +79,10 @@ namespace talvos
 static thread_local bool IsWorkerThread = false;
 static thread_local Workgroup *CurrentGroup;
 static thread_local Invocation *CurrentInvocation;
+static thread_local unsigned CurrentWorker;
+
+/// Range of items of work claimed by this worker thread but not yet started.
+static thread_local size_t ClaimedBegin, ClaimedEnd;
 
 uint32_t PipelineExecutor::NextBreakpoint = 1;
 std::map<uint32_t, uint32_t> PipelineExecutor::Breakpoints;
@@ -104,6 +123,79 @@ struct PipelineExecutor::TrianglePrimitive
   const VertexOutput &OutA; ///< The vertex shader outputs for vertex A.
   const VertexOutput &OutB; ///< The vertex shader outputs for vertex B.
   const VertexOutput &OutC; ///< The vertex shader outputs for vertex C.
+
+  /// An edge function of the triangle, which gives one of its barycentric
+  /// coordinates as a linear function of the framebuffer coordinate.
+  struct EdgeFunction
+  {
+    float Origin; ///< The value at framebuffer coordinate (X0, Y0).
+    float DX;     ///< The change in value for each step in x.
+    float DY;     ///< The change in value for each step in y.
+    bool TopLeft; ///< True if fragments exactly on the edge are inside.
+  };
+
+  int X0; ///< The framebuffer x-coordinate of the edge function origin.
+  int Y0; ///< The framebuffer y-coordinate of the edge function origin.
+
+  /// The edge functions for the barycentric coordinates of A, B and C.
+  EdgeFunction Edges[3];
+};
+
+/// A fragment shader invocation, which is reset and reused for each fragment
+/// processed in the same lane of a quad by a worker thread.
+struct PipelineExecutor::FragmentInvocation
+{
+  /// A fragment shader input or output variable.
+  struct PipelineVariable
+  {
+    const Variable *Var; ///< The variable.
+    const Type *Ty;      ///< The type of the variable data.
+    uint64_t Address;    ///< The address of the variable data.
+    uint32_t Location;   ///< The location (or built-in) of the variable.
+    uint32_t Component;  ///< The component of the variable.
+    bool BuiltIn;        ///< True if the variable is a built-in.
+  };
+
+  /// The memory that holds the input and output variables.
+  std::shared_ptr<Memory> PipelineMemory;
+
+  std::vector<PipelineVariable> Inputs;  ///< The input variables.
+  std::vector<PipelineVariable> Outputs; ///< The output variables.
+
+  /// The output texel for each color attachment location, sorted by location.
+  std::vector<std::pair<uint32_t, Image::Texel>> OutTexels;
+
+  /// The invocation.
+  std::unique_ptr<Invocation> Inv;
+};
+
+/// The fragment shader invocations for a 2x2 quad of fragments.
+/// Lanes 0 to 3 hold the fragments at (x, y), (x+1, y), (x, y+1) and
+/// (x+1, y+1) respectively.
+struct PipelineExecutor::FragmentQuad
+{
+  /// The invocation for each lane, created when first needed.
+  std::unique_ptr<FragmentInvocation> Lanes[4];
+
+  /// The invocations executing in each lane of the current quad, or nullptr
+  /// for lanes that are not being executed.
+  const Invocation *Invocations[4] = {};
+};
+
+/// The primitives in a draw, binned into screen-space tiles.
+struct PipelineExecutor::TileBins
+{
+  /// The number of tiles in each row of the framebuffer.
+  uint32_t NumTilesX;
+
+  /// The bounding boxes of the binned primitives, in primitive order.
+  std::vector<BoundingBox> Primitives;
+
+  /// The indices of the primitives that overlap each tile, in primitive order.
+  std::vector<std::vector<uint32_t>> Tiles;
+
+  /// The indices of the tiles that overlap at least one primitive.
+  std::vector<uint32_t> PendingTiles;
 };
 
 PipelineExecutor::PipelineExecutor(PipelineExecutorKey Key, Device &Dev)
@@ -111,13 +203,24 @@ PipelineExecutor::PipelineExecutor(PipelineExecutorKey Key, Device &Dev)
 {
   ShutDownWorkers = false;
 
-  Interactive = checkEnv("TALVOS_INTERACTIVE", false);
+  Interactive = Dev.isInteractive();
+
+  // Lockstep execution is not supported by the interactive debugger, which
+  // steps a single invocation at a time.
+  Lockstep = !Interactive && checkEnv("TALVOS_LOCKSTEP", false);
 
   // Get number of worker threads to launch.
   NumThreads = 1;
   if (!Interactive && Dev.isThreadSafe())
     NumThreads = (uint32_t)getEnvUInt("TALVOS_NUM_WORKERS",
                                       std::thread::hardware_concurrency());
+
+  // Select the scheduler used to distribute work to worker threads.
+  // The interactive debugger relies on work being claimed in order.
+  CurrentScheduler = (Scheduler)getEnvOption(
+      "TALVOS_SCHEDULER", {"shared", "steal"}, WORK_STEALING_SCHEDULER);
+  if (Interactive)
+    CurrentScheduler = SHARED_SCHEDULER;
 }
 
 PipelineExecutor::~PipelineExecutor()
@@ -151,7 +254,7 @@ Workgroup *PipelineExecutor::createWorkgroup(Dim3 GroupId) const
         Dim3 LocalId(LX, LY, LZ);
         Dim3 GlobalId = LocalId + GroupId * GroupSize;
         uint32_t LocalIndex = LX + (LY + (LZ * GroupSize.Y)) * GroupSize.X;
-        std::vector<Object> InitialObjects = Objects;
+        Invocation::ObjectList InvocationObjects;
 
         // Create pipeline memory and populate with builtin variables.
         std::shared_ptr<Memory> PipelineMemory =
@@ -189,13 +292,13 @@ Workgroup *PipelineExecutor::createWorkgroup(Dim3 GroupId) const
           }
 
           // Set pointer value.
-          InitialObjects[Var->getId()] = Object(Ty, Address);
+          InvocationObjects.push_back({Var->getId(), Object(Ty, Address)});
         }
 
         // Create invocation and add to group.
-        Group->addWorkItem(
-            std::make_unique<Invocation>(Dev, *CurrentStage, InitialObjects,
-                                         PipelineMemory, Group, GlobalId));
+        Group->addWorkItem(std::make_unique<Invocation>(
+            Dev, *CurrentStage, Objects, InvocationObjects, PipelineMemory,
+            Group, GlobalId));
       }
     }
   }
@@ -215,9 +318,28 @@ const Workgroup *PipelineExecutor::getCurrentWorkgroup() const
 
 bool PipelineExecutor::isWorkerThread() const { return IsWorkerThread; }
 
+void PipelineExecutor::parallelFor(size_t NumItems,
+                                   std::function<void(size_t)> Task)
+{
+  std::unique_lock<std::mutex> TaskLock(TaskMutex, std::defer_lock);
+  if (NumItems <= 1 || NumThreads == 1 || !TaskLock.try_lock())
+  {
+    for (size_t i = 0; i < NumItems; i++)
+      Task(i);
+    return;
+  }
+
+  doWork(NumItems, [&]() {
+    size_t Index;
+    while (claimWork(Index))
+      Task(Index);
+  });
+}
+
 void PipelineExecutor::run(const talvos::DispatchCommand &Cmd)
 {
   assert(CurrentCommand == nullptr);
+  std::lock_guard<std::mutex> TaskLock(TaskMutex);
   CurrentCommand = &Cmd;
 
   const PipelineContext &PC = Cmd.getPipelineContext();
@@ -250,8 +372,7 @@ void PipelineExecutor::run(const talvos::DispatchCommand &Cmd)
             {BaseGroup.X + GX, BaseGroup.Y + GY, BaseGroup.Z + GZ});
 
   // Run worker threads to process groups.
-  NextWorkIndex = 0;
-  doWork([&]() { runComputeWorker(); });
+  doWork(PendingGroups.size(), [&]() { runComputeWorker(); });
 
   finalizeVariables(PC.getComputeDescriptors());
   GlobalMem.release(PushConstantAddress);
@@ -263,6 +384,7 @@ void PipelineExecutor::run(const talvos::DispatchCommand &Cmd)
 void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
 {
   assert(CurrentCommand == nullptr);
+  std::lock_guard<std::mutex> TaskLock(TaskMutex);
   CurrentCommand = &Cmd;
 
   Continue = false;
@@ -298,8 +420,8 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
     initializeVariables(PC.getGraphicsDescriptors(), PushConstantAddress);
 
     // Run worker threads to process vertices.
-    NextWorkIndex = 0;
-    doWork([&]() { runVertexWorker(&State, InstanceIndex); });
+    doWork(Cmd.getNumVertices(),
+           [&]() { runVertexWorker(&State, InstanceIndex); });
 
     finalizeVariables(PC.getGraphicsDescriptors());
 
@@ -313,6 +435,15 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
     Objects = CurrentStage->getObjects();
     initializeVariables(PC.getGraphicsDescriptors(), PushConstantAddress);
 
+    // Bin the primitives in the draw into screen-space tiles.
+    const Framebuffer &FB = Cmd.getRenderPassInstance().getFramebuffer();
+    TileBins Bins;
+    Bins.NumTilesX = (FB.getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+    Bins.Tiles.resize(Bins.NumTilesX *
+                      ((FB.getHeight() + TILE_SIZE - 1) / TILE_SIZE));
+    std::vector<PointPrimitive> Points;
+    std::vector<TrianglePrimitive> Triangles;
+
     // TODO: Handle other topologies
     VkPrimitiveTopology Topology = PL->getTopology();
     switch (Topology)
@@ -320,15 +451,15 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
     case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
     {
       for (uint32_t v = 0; v < Cmd.getNumVertices(); v++)
-        rasterizePoint(Cmd, Viewport, State.VertexOutputs[v]);
+        binPoint(Cmd, Viewport, State.VertexOutputs[v], Bins, Points);
       break;
     }
     case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST:
     {
       for (uint32_t v = 0; v < Cmd.getNumVertices(); v += 3)
-        rasterizeTriangle(Cmd, Viewport, State.VertexOutputs[v],
-                          State.VertexOutputs[v + 1],
-                          State.VertexOutputs[v + 2]);
+        binTriangle(Cmd, Viewport, State.VertexOutputs[v],
+                    State.VertexOutputs[v + 1], State.VertexOutputs[v + 2],
+                    Bins, Triangles);
       break;
     }
     case VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP:
@@ -339,13 +470,13 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
         const VertexOutput &B = State.VertexOutputs[v - 1];
 
         const VertexOutput &C = State.VertexOutputs[v];
-        rasterizeTriangle(Cmd, Viewport, A, B, C);
+        binTriangle(Cmd, Viewport, A, B, C, Bins, Triangles);
 
         if (++v >= Cmd.getNumVertices())
           break;
 
         const VertexOutput &D = State.VertexOutputs[v];
-        rasterizeTriangle(Cmd, Viewport, B, D, C);
+        binTriangle(Cmd, Viewport, B, D, C, Bins, Triangles);
       }
       break;
     }
@@ -356,7 +487,7 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
       {
         const VertexOutput &A = State.VertexOutputs[v - 1];
         const VertexOutput &B = State.VertexOutputs[v];
-        rasterizeTriangle(Cmd, Viewport, A, B, Center);
+        binTriangle(Cmd, Viewport, A, B, Center, Bins, Triangles);
       }
       break;
     }
@@ -366,6 +497,20 @@ void PipelineExecutor::run(const talvos::DrawCommandBase &Cmd)
       abort();
     }
 
+    // Run worker threads to process tiles. Each tile is processed by a single
+    // worker, which rasterizes the primitives that overlap it in order.
+    const RenderPassInstance &RPI = Cmd.getRenderPassInstance();
+    FragmentQuads.resize(NumThreads);
+    doWork(Bins.PendingTiles.size(), [&]() {
+      runFragmentWorker(Bins, [&](uint32_t Index, const BoundingBox &Box) {
+        if (Topology == VK_PRIMITIVE_TOPOLOGY_POINT_LIST)
+          rasterizePoint(Points[Index], Box, RPI);
+        else
+          rasterizeTriangle(Triangles[Index], Box, RPI);
+      });
+    });
+    FragmentQuads.clear();
+
     finalizeVariables(PC.getGraphicsDescriptors());
   }
 
@@ -393,27 +538,29 @@ void PipelineExecutor::runComputeWorker()
       CurrentGroup = RunningGroups.back();
       RunningGroups.pop_back();
     }
-    else if (NextWorkIndex < PendingGroups.size())
+    else
     {
-      size_t GroupIndex = NextWorkIndex++;
-      if (GroupIndex >= PendingGroups.size())
+      size_t GroupIndex;
+      if (!claimWork(GroupIndex))
+      {
+        // All groups are finished.
         break;
+      }
       CurrentGroup = createWorkgroup(PendingGroups[GroupIndex]);
       Dev.reportWorkgroupBegin(CurrentGroup);
     }
-    else
-    {
-      // All groups are finished.
-      break;
-    }
 
     // Loop until all work items in the group have completed.
     while (true)
     {
+      // In lockstep mode, step every invocation in the group together.
+      if (Lockstep)
+        runLockstep();
+
       // Step each invocation in group until it hits a barrier or completes.
       // Note that the interact() calls can potentially change the current
       // invocation and group being processed.
-      while (true)
+      while (!Lockstep)
       {
         // Get the next invocation in the current group in the READY state.
         // TODO: Could move some of this logic into the Workgroup class?
@@ -472,34 +619,134 @@ void PipelineExecutor::runComputeWorker()
   }
 }
 
-void PipelineExecutor::buildPendingFragments(const DrawCommandBase &Cmd,
-                                             int XMinFB, int XMaxFB, int YMinFB,
-                                             int YMaxFB)
+/// Returns true if executing an instruction with opcode \p Opcode can move
+/// invocations that were at the same program counter to different positions,
+/// or stop them from being ready to execute.
+static bool mayDiverge(uint16_t Opcode)
+{
+  switch (Opcode)
+  {
+  case SpvOpBranch:
+  case SpvOpBranchConditional:
+  case SpvOpControlBarrier:
+  case SpvOpFunctionCall:
+  case SpvOpKill:
+  case SpvOpReturn:
+  case SpvOpReturnValue:
+  case SpvOpSwitch:
+  case SpvOpUnreachable:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void PipelineExecutor::runLockstep()
+{
+  const Workgroup::WorkItemList &WorkItems = CurrentGroup->getWorkItems();
+
+  // Ready invocations are kept in groups of invocations that are at the same
+  // program counter, ordered from the furthest ahead to the furthest behind.
+  // Stepping the group that is furthest behind first allows divergent
+  // invocations to reconverge, which happens when their group reaches the
+  // position of another group.
+  typedef std::vector<Invocation *> LaneGroup;
+  std::vector<LaneGroup> Groups;
+  auto AddGroup = [&Groups](LaneGroup &&Lanes) {
+    auto G = std::lower_bound(Groups.begin(), Groups.end(), Lanes[0],
+                              [](const LaneGroup &G, const Invocation *Lane) {
+                                return G[0]->comparePosition(*Lane) > 0;
+                              });
+    if (G != Groups.end() && G->front()->comparePosition(*Lanes[0]) == 0)
+      G->insert(G->end(), Lanes.begin(), Lanes.end());
+    else
+      Groups.insert(G, std::move(Lanes));
+  };
+
+  for (auto &WI : WorkItems)
+  {
+    if (WI->getState() == Invocation::READY)
+      AddGroup({WI.get()});
+  }
+
+  // Loop until every invocation has hit a barrier or completed.
+  while (!Groups.empty())
+  {
+    LaneGroup ActiveLanes = std::move(Groups.back());
+    Groups.pop_back();
+
+    // Execute the current instruction for every active invocation.
+    // Lanewise instructions are dispatched once for all of them, and other
+    // instructions step each invocation in turn.
+    bool Diverge =
+        mayDiverge(ActiveLanes[0]->getCurrentInstruction()->getOpcode());
+    if (!Invocation::stepLanes(ActiveLanes))
+    {
+      for (Invocation *Lane : ActiveLanes)
+      {
+        CurrentInvocation = Lane;
+        Lane->step();
+      }
+      CurrentInvocation = nullptr;
+    }
+
+    // Other instructions move every invocation to the next instruction, so
+    // the group only needs to be split after control flow instructions.
+    if (!Diverge)
+    {
+      AddGroup(std::move(ActiveLanes));
+      continue;
+    }
+    for (Invocation *Lane : ActiveLanes)
+    {
+      if (Lane->getState() == Invocation::READY)
+        AddGroup({Lane});
+    }
+  }
+}
+
+bool PipelineExecutor::binPrimitive(const DrawCommandBase &Cmd, TileBins &Bins,
+                                    BoundingBox &Box)
 {
   const RenderPassInstance &RPI = Cmd.getRenderPassInstance();
   const Framebuffer &FB = RPI.getFramebuffer();
   const PipelineContext &PC = Cmd.getPipelineContext();
 
   // Clamp the bounding box to be within the framebuffer.
-  XMinFB = std::clamp(XMinFB, 0, (int)(FB.getWidth() - 1));
-  XMaxFB = std::clamp(XMaxFB, 0, (int)(FB.getWidth() - 1));
-  YMinFB = std::clamp(YMinFB, 0, (int)(FB.getHeight() - 1));
-  YMaxFB = std::clamp(YMaxFB, 0, (int)(FB.getHeight() - 1));
+  Box.XMin = std::clamp(Box.XMin, 0, (int)(FB.getWidth() - 1));
+  Box.XMax = std::clamp(Box.XMax, 0, (int)(FB.getWidth() - 1));
+  Box.YMin = std::clamp(Box.YMin, 0, (int)(FB.getHeight() - 1));
+  Box.YMax = std::clamp(Box.YMax, 0, (int)(FB.getHeight() - 1));
 
   // Clamp the bounding box to be within the scissor rectangle.
   // TODO: Select correct scissor for current viewport
   assert(PC.getScissors().size() == 1);
   VkRect2D Scissor = PC.getScissors()[0];
-  XMinFB = std::max<int>(XMinFB, Scissor.offset.x);
-  XMaxFB = std::min<int>(XMaxFB, Scissor.offset.x + Scissor.extent.width - 1);
-  YMinFB = std::max<int>(YMinFB, Scissor.offset.y);
-  YMaxFB = std::min<int>(YMaxFB, Scissor.offset.y + Scissor.extent.height - 1);
-
-  // Build list of framebuffer coordinates in the axis-aligned bounding box.
-  assert(PendingFragments.empty());
-  for (int YFB = YMinFB; YFB <= YMaxFB; YFB++)
-    for (int XFB = XMinFB; XFB <= XMaxFB; XFB++)
-      PendingFragments.push_back({(uint32_t)XFB, (uint32_t)YFB, 0});
+  Box.XMin = std::max<int>(Box.XMin, Scissor.offset.x);
+  Box.XMax =
+      std::min<int>(Box.XMax, Scissor.offset.x + Scissor.extent.width - 1);
+  Box.YMin = std::max<int>(Box.YMin, Scissor.offset.y);
+  Box.YMax =
+      std::min<int>(Box.YMax, Scissor.offset.y + Scissor.extent.height - 1);
+
+  if (Box.XMin > Box.XMax || Box.YMin > Box.YMax)
+    return false;
+
+  // Add the primitive to each tile that its bounding box overlaps.
+  uint32_t Index = (uint32_t)Bins.Primitives.size();
+  Bins.Primitives.push_back(Box);
+  for (int TY = Box.YMin / TILE_SIZE; TY <= Box.YMax / TILE_SIZE; TY++)
+  {
+    for (int TX = Box.XMin / TILE_SIZE; TX <= Box.XMax / TILE_SIZE; TX++)
+    {
+      uint32_t Tile = TY * Bins.NumTilesX + TX;
+      if (Bins.Tiles[Tile].empty())
+        Bins.PendingTiles.push_back(Tile);
+      Bins.Tiles[Tile].push_back(Index);
+    }
+  }
+
+  return true;
 }
 
 /// Recursively populate a fragment shader input variable by interpolating
@@ -587,6 +834,12 @@ float YFBToDev(float Yfb, VkViewport Viewport)
          (Viewport.height / 2.f);
 }
 
+// Compute the area of a triangle (doubled).
+float TriArea2(const Vec4 &A, const Vec4 &B, const Vec4 &C)
+{
+  return (C.X - A.X) * (B.Y - A.Y) - (B.X - A.X) * (C.Y - A.Y);
+}
+
 // Blend a texel (NewTexel) against an existing color attachment (OldTexel).
 void blendTexel(Image::Texel &NewTexel, const Image::Texel &OldTexel,
                 const VkPipelineColorBlendAttachmentState &Blend,
@@ -773,30 +1026,21 @@ void blendTexel(Image::Texel &NewTexel, const Image::Texel &OldTexel,
   }
 }
 
-void PipelineExecutor::processFragment(
-    const Fragment &Frag, const RenderPassInstance &RPI,
-    std::function<void(uint32_t, uint32_t, const Variable *, const Type *,
-                       Memory *, uint64_t)>
-        GenLocData)
+PipelineExecutor::FragmentInvocation &
+PipelineExecutor::getFragmentInvocation(uint32_t Lane)
 {
-  const PipelineContext &PC =
-      ((const DrawCommandBase *)CurrentCommand)->getPipelineContext();
-  const Framebuffer &FB = RPI.getFramebuffer();
-  const RenderPass &RP = RPI.getRenderPass();
-
-  // Data about a fragment shader output variable.
-  struct FragmentOutput
+  FragmentQuad &Quad = FragmentQuads[CurrentWorker];
+  if (Quad.Lanes[Lane])
   {
-    uint64_t Address;
-    uint32_t Location;
-    uint32_t Component;
-  };
+    Quad.Lanes[Lane]->Inv->reset();
+    Quad.Invocations[Lane] = Quad.Lanes[Lane]->Inv.get();
+    return *Quad.Lanes[Lane];
+  }
 
   // Create pipeline memory and populate with input/output variables.
-  std::vector<Object> InitialObjects = Objects;
-  std::shared_ptr<Memory> PipelineMemory =
-      std::make_shared<Memory>(Dev, MemoryScope::Invocation);
-  std::map<const Variable *, FragmentOutput> Outputs;
+  FragmentInvocation *FI = new FragmentInvocation;
+  Invocation::ObjectList InvocationObjects;
+  FI->PipelineMemory = std::make_shared<Memory>(Dev, MemoryScope::Invocation);
   for (auto Var : CurrentStage->getEntryPoint()->getVariables())
   {
     const Type *PtrTy = Var->getType();
@@ -804,34 +1048,30 @@ void PipelineExecutor::processFragment(
     if (PtrTy->getStorageClass() == SpvStorageClassInput)
     {
       // Allocate storage for input variable.
-      uint64_t Address = PipelineMemory->allocate(VarTy->getSize());
-      InitialObjects[Var->getId()] = Object(PtrTy, Address);
+      uint64_t Address = FI->PipelineMemory->allocate(VarTy->getSize());
+      InvocationObjects.push_back({Var->getId(), Object(PtrTy, Address)});
 
-      // Initialize input variable data.
       if (Var->hasDecoration(SpvDecorationLocation))
       {
         uint32_t Location = Var->getDecoration(SpvDecorationLocation);
         uint32_t Component = 0;
         if (Var->hasDecoration(SpvDecorationComponent))
           Component = Var->getDecoration(SpvDecorationComponent);
-        GenLocData(Location, Component, Var, VarTy, &*PipelineMemory, Address);
+        FI->Inputs.push_back({Var, VarTy, Address, Location, Component, false});
       }
       else if (Var->hasDecoration(SpvDecorationBuiltIn))
       {
-        switch (Var->getDecoration(SpvDecorationBuiltIn))
+        uint32_t BuiltIn = Var->getDecoration(SpvDecorationBuiltIn);
+        switch (BuiltIn)
         {
         case SpvBuiltInFragCoord:
-        {
           // TODO: Sample shading affects x/y components
           assert(VarTy->isVector() && VarTy->getSize() == 16);
-          float FragCoord[4] = {Frag.X + 0.5f, Frag.Y + 0.5f, Frag.Depth,
-                                Frag.InvW};
-          PipelineMemory->store(Address, 16, (const uint8_t *)FragCoord);
           break;
-        }
         default:
           assert(false && "Unhandled fragment input builtin");
         }
+        FI->Inputs.push_back({Var, VarTy, Address, BuiltIn, 0, true});
       }
       else
       {
@@ -841,71 +1081,151 @@ void PipelineExecutor::processFragment(
     else if (PtrTy->getStorageClass() == SpvStorageClassOutput)
     {
       // Allocate storage for output variable.
-      uint64_t Address = PipelineMemory->allocate(VarTy->getSize());
-      InitialObjects[Var->getId()] = Object(PtrTy, Address);
+      uint64_t Address = FI->PipelineMemory->allocate(VarTy->getSize());
+      InvocationObjects.push_back({Var->getId(), Object(PtrTy, Address)});
 
       // Store output variable information.
       assert(Var->hasDecoration(SpvDecorationLocation));
+      assert(VarTy->isScalar() || VarTy->isVector());
+      assert(VarTy->getScalarType()->getSize() == 4);
       uint32_t Location = Var->getDecoration(SpvDecorationLocation);
       uint32_t Component = 0;
       if (Var->hasDecoration(SpvDecorationComponent))
         Component = Var->getDecoration(SpvDecorationComponent);
-      Outputs[Var] = {Address, Location, Component};
+      FI->Outputs.push_back({Var, VarTy, Address, Location, Component, false});
+
+      // Add an output texel for this location if necessary.
+      auto Texel = std::lower_bound(
+          FI->OutTexels.begin(), FI->OutTexels.end(), Location,
+          [](const auto &T, uint32_t Location) { return T.first < Location; });
+      if (Texel == FI->OutTexels.end() || Texel->first != Location)
+        FI->OutTexels.insert(Texel, {Location, Image::Texel()});
     }
   }
 
   // Create fragment shader invocation.
-  CurrentInvocation = new Invocation(Dev, *CurrentStage, InitialObjects,
-                                     PipelineMemory, nullptr, Dim3(0, 0, 0));
+  FI->Inv.reset(new Invocation(Dev, *CurrentStage, Objects, InvocationObjects,
+                               FI->PipelineMemory, nullptr, Dim3(0, 0, 0)));
+  FI->Inv->setQuad(Quad.Invocations, Lane);
 
-  // Run shader invocation to completion.
-  interact();
-  while (CurrentInvocation->getState() == Invocation::READY)
+  Quad.Lanes[Lane].reset(FI);
+  Quad.Invocations[Lane] = FI->Inv.get();
+  return *FI;
+}
+
+void PipelineExecutor::processQuad(
+    const Fragment Frags[4], uint32_t Covered, const RenderPassInstance &RPI,
+    std::function<void(uint32_t, uint32_t, uint32_t, const Variable *,
+                       const Type *, Memory *, uint64_t)>
+        GenLocData)
+{
+  // Uncovered fragments only need to be executed if they might be used to
+  // compute derivatives for the covered fragments.
+  FragmentQuad &Quad = FragmentQuads[CurrentWorker];
+  uint32_t Active =
+      CurrentStage->getModule()->hasDerivatives() ? 0xF : Covered;
+  for (uint32_t Lane = 0; Lane < 4; Lane++)
   {
-    CurrentInvocation->step();
+    if (!(Active & (1 << Lane)))
+    {
+      Quad.Invocations[Lane] = nullptr;
+      continue;
+    }
+
+    FragmentInvocation &FI = getFragmentInvocation(Lane);
+    FI.Inv->setHelper(!(Covered & (1 << Lane)));
+
+    // Initialize input variable data.
+    const Fragment &Frag = Frags[Lane];
+    for (const FragmentInvocation::PipelineVariable &Input : FI.Inputs)
+    {
+      if (!Input.BuiltIn)
+      {
+        GenLocData(Lane, Input.Location, Input.Component, Input.Var, Input.Ty,
+                   &*FI.PipelineMemory, Input.Address);
+      }
+      else
+      {
+        assert(Input.Location == SpvBuiltInFragCoord);
+        float FragCoord[4] = {Frag.X + 0.5f, Frag.Y + 0.5f, Frag.Depth,
+                              Frag.InvW};
+        FI.PipelineMemory->store(Input.Address, 16,
+                                 (const uint8_t *)FragCoord);
+      }
+    }
+
+    CurrentInvocation = FI.Inv.get();
     interact();
   }
 
-  bool Discarded = CurrentInvocation->wasDiscarded();
+  // Run shader invocations to completion, stepping them in lockstep so that
+  // each one can see the values computed by the others in the quad.
+  bool Running = true;
+  while (Running)
+  {
+    Running = false;
+    for (uint32_t Lane = 0; Lane < 4; Lane++)
+    {
+      if (!(Active & (1 << Lane)))
+        continue;
+
+      CurrentInvocation = Quad.Lanes[Lane]->Inv.get();
+      if (CurrentInvocation->getState() != Invocation::READY)
+        continue;
 
-  delete CurrentInvocation;
+      CurrentInvocation->step();
+      interact();
+      Running = true;
+    }
+  }
   CurrentInvocation = nullptr;
 
-  if (Discarded)
-    return;
+  // Write outputs for covered fragments that were not discarded.
+  for (uint32_t Lane = 0; Lane < 4; Lane++)
+  {
+    if ((Covered & (1 << Lane)) && !Quad.Lanes[Lane]->Inv->wasDiscarded())
+      writeFragmentOutputs(*Quad.Lanes[Lane], Frags[Lane], RPI);
+  }
+}
+
+void PipelineExecutor::writeFragmentOutputs(FragmentInvocation &FI,
+                                            const Fragment &Frag,
+                                            const RenderPassInstance &RPI)
+{
+  const PipelineContext &PC =
+      ((const DrawCommandBase *)CurrentCommand)->getPipelineContext();
+  const Framebuffer &FB = RPI.getFramebuffer();
+  const RenderPass &RP = RPI.getRenderPass();
 
   // Gather fragment outputs for each location.
-  std::vector<uint32_t> ColorAttachments =
+  const std::vector<uint32_t> &ColorAttachments =
       RP.getSubpass(RPI.getSubpassIndex()).ColorAttachments;
-  std::map<uint32_t, Image::Texel> OutTexels;
-  for (auto Output : Outputs)
+  for (const FragmentInvocation::PipelineVariable &Output : FI.Outputs)
   {
-    uint32_t Location = Output.second.Location;
+    uint32_t Location = Output.Location;
     assert(Location < ColorAttachments.size());
 
     // Get output variable data.
-    const Object &OutputData =
-        Object::load(Output.first->getType()->getElementType(), *PipelineMemory,
-                     Output.second.Address);
+    uint32_t OutputData[4];
+    assert(Output.Ty->getSize() <= sizeof(OutputData));
+    FI.PipelineMemory->load((uint8_t *)OutputData, Output.Address,
+                            Output.Ty->getSize());
 
     // Set texel component(s) for this variable.
-    assert(OutputData.getType()->isScalar() ||
-           OutputData.getType()->isVector());
-    assert(OutputData.getType()->getScalarType()->getSize() == 4);
-    Image::Texel T;
-    if (OutTexels.count(Location))
-      T = OutTexels.at(Location);
-    for (uint32_t i = 0; i < OutputData.getType()->getElementCount(); i++)
-      T.set(Output.second.Component + i, OutputData.get<uint32_t>(i));
-    OutTexels[Location] = T;
+    auto Texel = std::find_if(
+        FI.OutTexels.begin(), FI.OutTexels.end(),
+        [Location](const auto &T) { return T.first == Location; });
+    Image::Texel &T = Texel->second;
+    for (uint32_t i = 0; i < Output.Ty->getElementCount(); i++)
+      T.set(Output.Component + i, OutputData[i]);
   }
 
-  BlendAttachmentStateList BlendAttachmentStates =
+  const BlendAttachmentStateList &BlendAttachmentStates =
       PC.getGraphicsPipeline()->getBlendAttachmentStates();
   assert(BlendAttachmentStates.size() == ColorAttachments.size());
 
   // Write fragment outputs to color attachments.
-  for (auto OT : OutTexels)
+  for (const auto &OT : FI.OutTexels)
   {
     uint32_t Ref = ColorAttachments[OT.first];
     assert(Ref < RP.getNumAttachments());
@@ -948,8 +1268,10 @@ void PipelineExecutor::processFragment(
   }
 }
 
-void PipelineExecutor::runWorker()
+void PipelineExecutor::runWorker(unsigned WorkerIndex)
 {
+  CurrentWorker = WorkerIndex;
+
   uint32_t NextTaskID = 1;
   while (true)
   {
@@ -968,6 +1290,7 @@ void PipelineExecutor::runWorker()
 
     // Do work.
     assert(CurrentTask);
+    ClaimedBegin = ClaimedEnd = 0;
     CurrentTask();
 
     // If we are last worker to finish, notify master that work is complete.
@@ -982,13 +1305,75 @@ void PipelineExecutor::runWorker()
   }
 }
 
-void PipelineExecutor::doWork(std::function<void()> Task)
+bool PipelineExecutor::claimWork(size_t &Index)
+{
+  if (CurrentScheduler == SHARED_SCHEDULER)
+  {
+    Index = NextWorkIndex++;
+    return Index < NumWorkItems;
+  }
+
+  while (ClaimedBegin == ClaimedEnd)
+  {
+    // Claim a chunk of work from the front of our own queue. The chunk size
+    // shrinks as the queue empties, leaving more work available to steal.
+    WorkQueue &Queue = WorkQueues[CurrentWorker];
+    {
+      std::lock_guard<std::mutex> Lock(Queue.Mutex);
+      size_t Remaining = Queue.End - Queue.Begin;
+      if (Remaining)
+      {
+        ClaimedBegin = Queue.Begin;
+        ClaimedEnd = Queue.Begin + std::max<size_t>(1, Remaining / 4);
+        Queue.Begin = ClaimedEnd;
+        break;
+      }
+    }
+
+    // Our queue is empty, so steal half of the work from the back of the
+    // queue of another worker.
+    size_t StolenBegin = 0, StolenEnd = 0;
+    for (unsigned i = 1; i < NumThreads && StolenBegin == StolenEnd; i++)
+    {
+      WorkQueue &Victim = WorkQueues[(CurrentWorker + i) % NumThreads];
+      std::lock_guard<std::mutex> Lock(Victim.Mutex);
+      size_t Remaining = Victim.End - Victim.Begin;
+      StolenEnd = Victim.End;
+      StolenBegin = Victim.End - (Remaining + 1) / 2;
+      Victim.End = StolenBegin;
+    }
+
+    // No work left in any queue.
+    if (StolenBegin == StolenEnd)
+      return false;
+
+    std::lock_guard<std::mutex> Lock(Queue.Mutex);
+    Queue.Begin = StolenBegin;
+    Queue.End = StolenEnd;
+  }
+
+  Index = ClaimedBegin++;
+  return true;
+}
+
+void PipelineExecutor::doWork(size_t NumItems, std::function<void()> Task)
 {
   // Create worker threads if necessary.
   if (WorkerThreads.empty())
   {
+    WorkQueues = std::vector<WorkQueue>(NumThreads);
     for (unsigned i = 0; i < NumThreads; i++)
-      WorkerThreads.push_back(std::thread(&PipelineExecutor::runWorker, this));
+      WorkerThreads.push_back(
+          std::thread(&PipelineExecutor::runWorker, this, i));
+  }
+
+  // Distribute items of work evenly between worker queues.
+  NextWorkIndex = 0;
+  NumWorkItems = NumItems;
+  for (unsigned i = 0; i < NumThreads; i++)
+  {
+    WorkQueues[i].Begin = (NumItems * i) / NumThreads;
+    WorkQueues[i].End = (NumItems * (i + 1)) / NumThreads;
   }
 
   // Signal worker threads to perform task.
@@ -1008,179 +1393,36 @@ void PipelineExecutor::doWork(std::function<void()> Task)
   CurrentTask = std::function<void()>();
 }
 
-void PipelineExecutor::runPointFragmentWorker(PointPrimitive Primitive,
-                                              const RenderPassInstance &RPI)
+void PipelineExecutor::runFragmentWorker(
+    const TileBins &Bins,
+    std::function<void(uint32_t, const BoundingBox &)> Rasterize)
 {
   IsWorkerThread = true;
   CurrentInvocation = nullptr;
 
-  // Loop until all framebuffer coordinates have been processed.
+  // Loop until all tiles have been processed.
   while (true)
   {
-    // Get next framebuffer coordinate index.
-    uint32_t WorkIndex = (uint32_t)NextWorkIndex++;
-    if (WorkIndex >= PendingFragments.size())
+    // Get next tile index.
+    size_t WorkIndex;
+    if (!claimWork(WorkIndex))
       break;
 
-    Fragment Frag;
-    Frag.X = PendingFragments[WorkIndex].X;
-    Frag.Y = PendingFragments[WorkIndex].Y;
-    Frag.Depth = 0; // TODO
-    Frag.InvW = 0;  // TODO
-
-    // Compute point coordinate.
-    float S = 0.5f + (Frag.X + 0.5f - Primitive.X) / Primitive.PointSize;
-    float T = 0.5f + (Frag.Y + 0.5f - Primitive.Y) / Primitive.PointSize;
-
-    // Check if pixel is inside point radius.
-    if (S < 0 || T < 0 || S > 1 || T > 1)
-      continue;
-
-    // Lambda for generating data for location variables.
-    auto GenLocData = [&](uint32_t Location, uint32_t Component,
-                          const Variable *Var, const Type *VarTy, Memory *Mem,
-                          uint64_t Address) {
-      const Object &Out = Primitive.Out.Locations.at({Location, Component});
-      Mem->store(Address, VarTy->getSize(), Out.getData());
-    };
-
-    processFragment(Frag, RPI, GenLocData);
-  }
-}
+    uint32_t Tile = Bins.PendingTiles[WorkIndex];
+    int TileX = (Tile % Bins.NumTilesX) * TILE_SIZE;
+    int TileY = (Tile / Bins.NumTilesX) * TILE_SIZE;
 
-void PipelineExecutor::runTriangleFragmentWorker(TrianglePrimitive Primitive,
-                                                 const PipelineContext &PC,
-                                                 const RenderPassInstance &RPI,
-                                                 const VkViewport &Viewport)
-{
-  IsWorkerThread = true;
-  CurrentInvocation = nullptr;
-
-  // Get rasterization state.
-  const VkPipelineRasterizationStateCreateInfo &RasterizationState =
-      PC.getGraphicsPipeline()->getRasterizationState();
-
-  // Get vertex positions.
-  Vec4 A = Primitive.PosA;
-  Vec4 B = Primitive.PosB;
-  Vec4 C = Primitive.PosC;
-
-  // Lambda to compute the area of a triangle (doubled).
-  auto TriArea2 = [](const Vec4 &A, const Vec4 &B, const Vec4 &C) {
-    return (C.X - A.X) * (B.Y - A.Y) - (B.X - A.X) * (C.Y - A.Y);
-  };
-
-  // Compute the area of the triangle (doubled).
-  float Area2 = TriArea2(A, B, C);
-
-  // Determine whether triangle is front-facing.
-  bool FrontFacing;
-  switch (RasterizationState.frontFace)
-  {
-  case VK_FRONT_FACE_COUNTER_CLOCKWISE:
-    FrontFacing = Area2 > 0;
-    break;
-  case VK_FRONT_FACE_CLOCKWISE:
-    FrontFacing = Area2 < 0;
-    break;
-  default:
-    std::cerr << "Invalid front-facing sign value" << std::endl;
-    abort();
-  }
-
-  // Cull triangle if necessary.
-  if ((FrontFacing && RasterizationState.cullMode & VK_CULL_MODE_FRONT_BIT) ||
-      (!FrontFacing && RasterizationState.cullMode & VK_CULL_MODE_BACK_BIT))
-    return;
-
-  // Loop until all framebuffer coordinates have been processed.
-  while (true)
-  {
-    // Get next framebuffer coordinate index.
-    uint32_t WorkIndex = (uint32_t)NextWorkIndex++;
-    if (WorkIndex >= PendingFragments.size())
-      break;
-
-    Fragment Frag;
-    Frag.X = PendingFragments[WorkIndex].X;
-    Frag.Y = PendingFragments[WorkIndex].Y;
-
-    // Compute barycentric coordinates using normalized device coordinates.
-    Vec4 DevCoord = {XFBToDev(Frag.X, Viewport), YFBToDev(Frag.Y, Viewport)};
-    float a = TriArea2(B, C, DevCoord) / Area2;
-    float b = TriArea2(C, A, DevCoord) / Area2;
-    float c = TriArea2(A, B, DevCoord) / Area2;
-
-    // Snap back to the edge for samples that are only just over.
-    // This is nasty hack to deal with cases where two primitives should share
-    // an edge, but rounding errors cause the one that owns it to skip a sample.
-    if (fabs(a) < 1.e-7f)
-      a = 0.f;
-    if (fabs(b) < 1.e-7f)
-      b = 0.f;
-    if (fabs(c) < 1.e-7f)
-      c = 0.f;
-
-    // Check if pixel is inside triangle.
-    if (!(a >= 0 && b >= 0 && c >= 0))
-      continue;
-
-    // Calculate edge vectors.
-    float BCX = C.X - B.X;
-    float BCY = C.Y - B.Y;
-    float CAX = A.X - C.X;
-    float CAY = A.Y - C.Y;
-    float ABX = B.X - A.X;
-    float ABY = B.Y - A.Y;
-    if (!FrontFacing)
+    // Rasterize the primitives that overlap this tile in primitive order, so
+    // that fragments for each framebuffer coordinate are processed in order.
+    for (uint32_t Index : Bins.Tiles[Tile])
     {
-      BCX = -BCX;
-      BCY = -BCY;
-      CAX = -CAX;
-      CAY = -CAY;
-      ABX = -ABX;
-      ABY = -ABY;
-    }
-
-    // Only fill top-left edges to avoid double-sampling on shared edges.
-    if (a == 0)
-    {
-      if (!((BCY == 0 && BCX < 0) || BCY > 0))
-        continue;
+      const BoundingBox &Box = Bins.Primitives[Index];
+      BoundingBox TileBox = {std::max(Box.XMin, TileX),
+                             std::min(Box.XMax, TileX + TILE_SIZE - 1),
+                             std::max(Box.YMin, TileY),
+                             std::min(Box.YMax, TileY + TILE_SIZE - 1)};
+      Rasterize(Index, TileBox);
     }
-    if (b == 0)
-    {
-      if (!((CAY == 0 && CAX < 0) || CAY > 0))
-        continue;
-    }
-    if (c == 0)
-    {
-      if (!((ABY == 0 && ABX < 0) || ABY > 0))
-        continue;
-    }
-
-    // Compute fragment depth and 1/w using linear interpolation.
-    Frag.Depth = (a * A.Z) + (b * B.Z) + (c * C.Z);
-    Frag.InvW = (a / A.W) + (b / B.W) + (c / C.W);
-
-    // Lambda for generating data for location variables.
-    auto GenLocData = [&](uint32_t Location, uint32_t Component,
-                          const Variable *Var, const Type *VarTy, Memory *Mem,
-                          uint64_t Address) {
-      // Gather output data from each vertex.
-      const Object &FA = Primitive.OutA.Locations.at({Location, Component});
-      const Object &FB = Primitive.OutB.Locations.at({Location, Component});
-      const Object &FC = Primitive.OutC.Locations.at({Location, Component});
-
-      // Interpolate vertex outputs to produce fragment input.
-      Object VarObj(VarTy);
-      interpolate(VarObj, VarTy, 0, FA, FB, FC, A.W, B.W, C.W, Frag.InvW, a, b,
-                  c, Var->hasDecoration(SpvDecorationFlat),
-                  !Var->hasDecoration(SpvDecorationNoPerspective));
-      VarObj.store(*Mem, Address);
-    };
-
-    processFragment(Frag, RPI, GenLocData);
   }
 }
 
@@ -1196,8 +1438,8 @@ void PipelineExecutor::runVertexWorker(struct RenderPipelineState *State,
   while (true)
   {
     // Get next vertex index.
-    uint32_t WorkIndex = (uint32_t)NextWorkIndex++;
-    if (WorkIndex >= DC->getNumVertices())
+    size_t WorkIndex;
+    if (!claimWork(WorkIndex))
       break;
 
     // Generate vertex index from work index.
@@ -1240,7 +1482,7 @@ void PipelineExecutor::runVertexWorker(struct RenderPipelineState *State,
       assert(false && "Unhandled draw type");
     }
 
-    std::vector<Object> InitialObjects = Objects;
+    Invocation::ObjectList InvocationObjects;
 
     // Create pipeline memory and populate with input/output variables.
     std::shared_ptr<Memory> PipelineMemory =
@@ -1255,7 +1497,7 @@ void PipelineExecutor::runVertexWorker(struct RenderPipelineState *State,
         const Type *ElemTy = Ty->getElementType();
         size_t ElemSize = ElemTy->getSize();
         uint64_t Address = PipelineMemory->allocate(ElemSize);
-        InitialObjects[Var->getId()] = Object(Ty, Address);
+        InvocationObjects.push_back({Var->getId(), Object(Ty, Address)});
 
         // Initialize input variable data.
         if (Var->hasDecoration(SpvDecorationLocation))
@@ -1312,15 +1554,15 @@ void PipelineExecutor::runVertexWorker(struct RenderPipelineState *State,
         // Allocate storage for output variable and store address.
         uint64_t Address =
             PipelineMemory->allocate(Ty->getElementType()->getSize());
-        InitialObjects[Var->getId()] = Object(Ty, Address);
+        InvocationObjects.push_back({Var->getId(), Object(Ty, Address)});
         OutputAddresses[Var] = Address;
       }
     }
 
     // Create shader invocation.
     CurrentInvocation =
-        new Invocation(Dev, *CurrentStage, InitialObjects, PipelineMemory,
-                       nullptr, Dim3(VertexIndex, 0, 0));
+        new Invocation(Dev, *CurrentStage, Objects, InvocationObjects,
+                       PipelineMemory, nullptr, Dim3(VertexIndex, 0, 0));
 
     // Run shader invocation to completion.
     interact();
@@ -1381,41 +1623,22 @@ void PipelineExecutor::runVertexWorker(struct RenderPipelineState *State,
 
 void PipelineExecutor::finalizeVariables(const DescriptorSetMap &DSM)
 {
-  // Copy array variable data back to original buffers.
+  // Release descriptor array element tables.
   for (auto V : CurrentStage->getModule()->getVariables())
   {
-    // TODO: Skip constant variables too
     if (!V->isBufferVariable())
       continue;
     if (V->getType()->getElementType()->getTypeId() != Type::ARRAY)
       continue;
 
-    assert(V->getType()->getElementType()->getTypeId() == Type::ARRAY);
-    const Type *ArrayTy = V->getType()->getElementType();
-
-    // Get descriptor set and binding.
+    // Get descriptor set.
     uint32_t Set = V->getDecoration(SpvDecorationDescriptorSet);
-    uint32_t Binding = V->getDecoration(SpvDecorationBinding);
-    assert(DSM.count(Set));
+    if (!DSM.count(Set))
+      continue;
 
-    uint64_t Address = Objects[V->getId()].get<uint64_t>();
     const DescriptorElement *DescriptorElements =
         Objects[V->getId()].getDescriptorElements();
     assert(DescriptorElements);
-
-    // Copy array element values to original buffers.
-    for (uint32_t i = 0; i < ArrayTy->getElementCount(); i++)
-    {
-      if (!DSM.at(Set).count({Binding, i}))
-        continue;
-
-      Memory::copy(DSM.at(Set).at({Binding, i}).Address, Dev.getGlobalMemory(),
-                   DescriptorElements[i].Address, Dev.getGlobalMemory(),
-                   DescriptorElements[i].NumBytes);
-    }
-
-    // Release allocation.
-    Dev.getGlobalMemory().release(Address);
     delete[] DescriptorElements;
   }
 }
@@ -1445,12 +1668,10 @@ void PipelineExecutor::initializeVariables(const talvos::DescriptorSetMap &DSM,
     {
       const Type *ArrayType = V->getType()->getElementType();
 
-      // Allocate array for descriptor element information.
+      // Build a table of the addresses of the bound buffers, which access
+      // chains use to resolve array elements without copying any data.
       DescriptorElement *DescriptorElements =
           new DescriptorElement[ArrayType->getElementCount()];
-
-      // Determine offset for each array element and total size.
-      uint64_t NumBytes = 0;
       for (uint32_t i = 0; i < ArrayType->getElementCount(); i++)
       {
         if (!DSM.at(Set).count({Binding, i}))
@@ -1459,30 +1680,14 @@ void PipelineExecutor::initializeVariables(const talvos::DescriptorSetMap &DSM,
           continue;
         }
 
-        size_t ElemSize = DSM.at(Set).at({Binding, i}).NumBytes;
-        DescriptorElements[i] = {NumBytes, ElemSize};
-        NumBytes += (uint64_t)ElemSize;
+        const BindingInfo &BI = DSM.at(Set).at({Binding, i});
+        DescriptorElements[i] = {BI.Address, BI.NumBytes};
       }
 
-      // Create new allocation to store whole array.
-      uint64_t Address = Dev.getGlobalMemory().allocate(NumBytes);
-      Objects[V->getId()] = Object(V->getType(), Address);
+      // The array itself has no storage, so the variable is only usable
+      // through access chains.
+      Objects[V->getId()] = Object(V->getType(), (uint64_t)0);
       Objects[V->getId()].setDescriptorElements(DescriptorElements);
-
-      // Copy array element values into new allocation.
-      for (uint32_t i = 0; i < ArrayType->getElementCount(); i++)
-      {
-        if (!DSM.at(Set).count({Binding, i}))
-          continue;
-
-        // Set final address for start of array element.
-        DescriptorElements[i].Address = Address + DescriptorElements[i].Address;
-
-        // Perform copy.
-        Memory::copy(DescriptorElements[i].Address, Dev.getGlobalMemory(),
-                     DSM.at(Set).at({Binding, i}).Address,
-                     Dev.getGlobalMemory(), DescriptorElements[i].NumBytes);
-      }
     }
     else
     {
@@ -1495,12 +1700,11 @@ void PipelineExecutor::initializeVariables(const talvos::DescriptorSetMap &DSM,
   }
 }
 
-void PipelineExecutor::rasterizePoint(const DrawCommandBase &Cmd,
-                                      const VkViewport &Viewport,
-                                      const VertexOutput &Vertex)
+void PipelineExecutor::binPoint(const DrawCommandBase &Cmd,
+                                const VkViewport &Viewport,
+                                const VertexOutput &Vertex, TileBins &Bins,
+                                std::vector<PointPrimitive> &Points)
 {
-  const RenderPassInstance &RPI = Cmd.getRenderPassInstance();
-
   // Get the point position.
   Vec4 Position = getPosition(Vertex);
 
@@ -1514,29 +1718,23 @@ void PipelineExecutor::rasterizePoint(const DrawCommandBase &Cmd,
   float Y = YDevToFB(Position.Y, Viewport);
 
   // Compute a bounding box for the point primitive.
-  int XMinFB = (int)std::floor(X - (PointSize / 2));
-  int XMaxFB = (int)std::ceil(X + (PointSize / 2));
-  int YMinFB = (int)std::floor(Y - (PointSize / 2));
-  int YMaxFB = (int)std::ceil(Y + (PointSize / 2));
-
-  buildPendingFragments(Cmd, XMinFB, XMaxFB, YMinFB, YMaxFB);
-
-  // Run worker threads to process fragments.
-  NextWorkIndex = 0;
-  PointPrimitive Primitive = {X, Y, PointSize, Vertex};
-  doWork([&]() { runPointFragmentWorker(Primitive, RPI); });
-
-  PendingFragments.clear();
+  BoundingBox Box = {(int)std::floor(X - (PointSize / 2)),
+                     (int)std::ceil(X + (PointSize / 2)),
+                     (int)std::floor(Y - (PointSize / 2)),
+                     (int)std::ceil(Y + (PointSize / 2))};
+
+  // Add the primitive to the tiles that it overlaps.
+  if (binPrimitive(Cmd, Bins, Box))
+    Points.push_back({X, Y, PointSize, Vertex});
 }
 
-void PipelineExecutor::rasterizeTriangle(const DrawCommandBase &Cmd,
-                                         const VkViewport &Viewport,
-                                         const VertexOutput &VA,
-                                         const VertexOutput &VB,
-                                         const VertexOutput &VC)
+void PipelineExecutor::binTriangle(const DrawCommandBase &Cmd,
+                                   const VkViewport &Viewport,
+                                   const VertexOutput &VA,
+                                   const VertexOutput &VB,
+                                   const VertexOutput &VC, TileBins &Bins,
+                                   std::vector<TrianglePrimitive> &Triangles)
 {
-  const RenderPassInstance &RPI = Cmd.getRenderPassInstance();
-
   // Gather vertex positions for the primitive.
   Vec4 A = getPosition(VA);
   Vec4 B = getPosition(VB);
@@ -1558,22 +1756,284 @@ void PipelineExecutor::rasterizeTriangle(const DrawCommandBase &Cmd,
   float YMinDev = std::fmin(A.Y, std::fmin(B.Y, C.Y));
   float XMaxDev = std::fmax(A.X, std::fmax(B.X, C.X));
   float YMaxDev = std::fmax(A.Y, std::fmax(B.Y, C.Y));
-  int XMinFB = (int)std::floor(XDevToFB(XMinDev, Viewport));
-  int XMaxFB = (int)std::ceil(XDevToFB(XMaxDev, Viewport));
-  int YMinFB = (int)std::floor(YDevToFB(YMinDev, Viewport));
-  int YMaxFB = (int)std::ceil(YDevToFB(YMaxDev, Viewport));
+  BoundingBox Box = {(int)std::floor(XDevToFB(XMinDev, Viewport)),
+                     (int)std::ceil(XDevToFB(XMaxDev, Viewport)),
+                     (int)std::floor(YDevToFB(YMinDev, Viewport)),
+                     (int)std::ceil(YDevToFB(YMaxDev, Viewport))};
 
-  buildPendingFragments(Cmd, XMinFB, XMaxFB, YMinFB, YMaxFB);
+  // Compute the area of the triangle (doubled).
+  float Area2 = TriArea2(A, B, C);
 
-  // Run worker threads to process fragments.
-  NextWorkIndex = 0;
-  TrianglePrimitive Primitive = {A, B, C, VA, VB, VC};
-  doWork([&]() {
-    runTriangleFragmentWorker(Primitive, Cmd.getPipelineContext(), RPI,
-                              Viewport);
-  });
+  // Determine whether triangle is front-facing.
+  const VkPipelineRasterizationStateCreateInfo &RasterizationState =
+      Cmd.getPipelineContext().getGraphicsPipeline()->getRasterizationState();
+  bool FrontFacing;
+  switch (RasterizationState.frontFace)
+  {
+  case VK_FRONT_FACE_COUNTER_CLOCKWISE:
+    FrontFacing = Area2 > 0;
+    break;
+  case VK_FRONT_FACE_CLOCKWISE:
+    FrontFacing = Area2 < 0;
+    break;
+  default:
+    std::cerr << "Invalid front-facing sign value" << std::endl;
+    abort();
+  }
+
+  // Cull triangle if necessary.
+  if ((FrontFacing && RasterizationState.cullMode & VK_CULL_MODE_FRONT_BIT) ||
+      (!FrontFacing && RasterizationState.cullMode & VK_CULL_MODE_BACK_BIT))
+    return;
+
+  // Add the primitive to the tiles that it overlaps.
+  if (!binPrimitive(Cmd, Bins, Box))
+    return;
+
+  // Lambda to set up the edge function for the barycentric coordinate of the
+  // vertex opposite the edge from P to Q.
+  auto SetupEdge = [&](const Vec4 &P, const Vec4 &Q) {
+    TrianglePrimitive::EdgeFunction Edge;
+
+    // Evaluate the barycentric coordinate at the origin of the bounding box,
+    // and compute its derivatives with respect to framebuffer coordinates.
+    Vec4 DevCoord = {XFBToDev(Box.XMin, Viewport),
+                     YFBToDev(Box.YMin, Viewport)};
+    Edge.Origin = TriArea2(P, Q, DevCoord) / Area2;
+    Edge.DX = ((Q.Y - P.Y) * (2.f / Viewport.width)) / Area2;
+    Edge.DY = -((Q.X - P.X) * (2.f / Viewport.height)) / Area2;
+
+    // Only fill top-left edges to avoid double-sampling on shared edges.
+    float EX = FrontFacing ? (Q.X - P.X) : (P.X - Q.X);
+    float EY = FrontFacing ? (Q.Y - P.Y) : (P.Y - Q.Y);
+    Edge.TopLeft = (EY == 0 && EX < 0) || EY > 0;
+
+    return Edge;
+  };
+
+  Triangles.push_back({A,
+                       B,
+                       C,
+                       VA,
+                       VB,
+                       VC,
+                       Box.XMin,
+                       Box.YMin,
+                       {SetupEdge(B, C), SetupEdge(C, A), SetupEdge(A, B)}});
+}
+
+void PipelineExecutor::rasterizePoint(const PointPrimitive &Primitive,
+                                      const BoundingBox &Box,
+                                      const RenderPassInstance &RPI)
+{
+  // Lambda for generating data for location variables.
+  // Every fragment of a point gets the same data, regardless of its lane.
+  auto GenLocData = [&](uint32_t, uint32_t Location, uint32_t Component,
+                        const Variable *Var, const Type *VarTy, Memory *Mem,
+                        uint64_t Address) {
+    const Object &Out = Primitive.Out.Locations.at({Location, Component});
+    Mem->store(Address, VarTy->getSize(), Out.getData());
+  };
+
+  // Loop over the 2x2 quads that overlap the bounding box.
+  for (int QY = Box.YMin & ~1; QY <= Box.YMax; QY += 2)
+  {
+    for (int QX = Box.XMin & ~1; QX <= Box.XMax; QX += 2)
+    {
+      Fragment Frags[4];
+      uint32_t Covered = 0;
+      for (uint32_t Lane = 0; Lane < 4; Lane++)
+      {
+        int X = QX + (Lane & 1);
+        int Y = QY + (Lane >> 1);
+
+        Fragment &Frag = Frags[Lane];
+        Frag.X = X;
+        Frag.Y = Y;
+        Frag.Depth = 0; // TODO
+        Frag.InvW = 0;  // TODO
+
+        // Compute point coordinate.
+        float S = 0.5f + (Frag.X + 0.5f - Primitive.X) / Primitive.PointSize;
+        float T = 0.5f + (Frag.Y + 0.5f - Primitive.Y) / Primitive.PointSize;
+
+        // Check if pixel is inside the bounding box and the point radius.
+        if (X < Box.XMin || X > Box.XMax || Y < Box.YMin || Y > Box.YMax)
+          continue;
+        if (S < 0 || T < 0 || S > 1 || T > 1)
+          continue;
+
+        Covered |= 1 << Lane;
+      }
+
+      if (Covered)
+        processQuad(Frags, Covered, RPI, GenLocData);
+    }
+  }
+}
+
+void PipelineExecutor::rasterizeTriangle(const TrianglePrimitive &Primitive,
+                                         const BoundingBox &Box,
+                                         const RenderPassInstance &RPI)
+{
+  const TrianglePrimitive::EdgeFunction *Edges = Primitive.Edges;
+
+  // Lambda to evaluate an edge function at a framebuffer coordinate.
+  auto EvalEdge = [&](const TrianglePrimitive::EdgeFunction &Edge, int X,
+                      int Y) {
+    return Edge.Origin + (X - Primitive.X0) * Edge.DX +
+           (Y - Primitive.Y0) * Edge.DY;
+  };
+
+  // Loop over the blocks that overlap the bounding box.
+  for (int BY = Box.YMin - (Box.YMin % BLOCK_SIZE); BY <= Box.YMax;
+       BY += BLOCK_SIZE)
+  {
+    for (int BX = Box.XMin - (Box.XMin % BLOCK_SIZE); BX <= Box.XMax;
+         BX += BLOCK_SIZE)
+    {
+      int XMin = std::max(BX, Box.XMin);
+      int XMax = std::min(BX + BLOCK_SIZE - 1, Box.XMax);
+      int YMin = std::max(BY, Box.YMin);
+      int YMax = std::min(BY + BLOCK_SIZE - 1, Box.YMax);
+
+      // Classify the block against each edge, using the corners of the block
+      // at which the edge function is smallest and largest.
+      bool Inside = true;
+      bool Outside = false;
+      for (int e = 0; e < 3; e++)
+      {
+        float Value = EvalEdge(Edges[e], XMin, YMin);
+        float SX = Edges[e].DX * (XMax - XMin);
+        float SY = Edges[e].DY * (YMax - YMin);
+        float Min = Value + std::min(SX, 0.f) + std::min(SY, 0.f);
+        float Max = Value + std::max(SX, 0.f) + std::max(SY, 0.f);
+        if (Max < -BLOCK_EPSILON)
+          Outside = true;
+        if (Min < BLOCK_EPSILON)
+          Inside = false;
+      }
+
+      // Skip blocks that are entirely outside the triangle.
+      if (Outside)
+        continue;
+
+      // Loop over the 2x2 quads in the block. Blocks are aligned to an even
+      // framebuffer coordinate, so quads never straddle two blocks.
+      for (int QY = YMin & ~1; QY <= YMax; QY += 2)
+      {
+        // Evaluate the edge functions at the start of both rows of quads, and
+        // then step them incrementally across them.
+        float Rows[2][3];
+        for (int r = 0; r < 2; r++)
+          for (int e = 0; e < 3; e++)
+            Rows[r][e] = EvalEdge(Edges[e], XMin & ~1, QY + r);
+
+        for (int QX = XMin & ~1; QX <= XMax; QX += 2)
+        {
+          float Bary[4][3];
+          uint32_t Covered = 0;
+          for (uint32_t Lane = 0; Lane < 4; Lane++)
+          {
+            int X = QX + (Lane & 1);
+            int Y = QY + (Lane >> 1);
+            float *Row = Rows[Lane >> 1];
+            float a = Bary[Lane][0] = Row[0];
+            float b = Bary[Lane][1] = Row[1];
+            float c = Bary[Lane][2] = Row[2];
+            for (int e = 0; e < 3; e++)
+              Row[e] += Edges[e].DX;
+
+            // Fragments outside the bounding box are never covered.
+            if (X < XMin || X > XMax || Y < YMin || Y > YMax)
+              continue;
+
+            // Every fragment in a block that is entirely inside the triangle
+            // is covered, so no further tests are needed.
+            if (Inside)
+            {
+              Covered |= 1 << Lane;
+              continue;
+            }
+
+            // Snap back to the edge for samples that are only just over.
+            // This is nasty hack to deal with cases where two primitives
+            // should share an edge, but rounding errors cause the one that
+            // owns it to skip a sample.
+            float SA = fabs(a) < EDGE_EPSILON ? 0.f : a;
+            float SB = fabs(b) < EDGE_EPSILON ? 0.f : b;
+            float SC = fabs(c) < EDGE_EPSILON ? 0.f : c;
+
+            // Check if pixel is inside triangle.
+            if (!(SA >= 0 && SB >= 0 && SC >= 0))
+              continue;
+
+            // Only fill top-left edges to avoid double-sampling on shared
+            // edges.
+            if ((SA == 0 && !Edges[0].TopLeft) ||
+                (SB == 0 && !Edges[1].TopLeft) ||
+                (SC == 0 && !Edges[2].TopLeft))
+              continue;
+
+            Bary[Lane][0] = SA;
+            Bary[Lane][1] = SB;
+            Bary[Lane][2] = SC;
+            Covered |= 1 << Lane;
+          }
+
+          if (Covered)
+            processTriangleQuad(Primitive, QX, QY, Bary, Covered, RPI);
+        }
+      }
+    }
+  }
+}
+
+void PipelineExecutor::processTriangleQuad(const TrianglePrimitive &Primitive,
+                                           uint32_t X, uint32_t Y,
+                                           const float Bary[4][3],
+                                           uint32_t Covered,
+                                           const RenderPassInstance &RPI)
+{
+  const Vec4 &A = Primitive.PosA;
+  const Vec4 &B = Primitive.PosB;
+  const Vec4 &C = Primitive.PosC;
+
+  Fragment Frags[4];
+  for (uint32_t Lane = 0; Lane < 4; Lane++)
+  {
+    float a = Bary[Lane][0];
+    float b = Bary[Lane][1];
+    float c = Bary[Lane][2];
+
+    Fragment &Frag = Frags[Lane];
+    Frag.X = X + (Lane & 1);
+    Frag.Y = Y + (Lane >> 1);
+
+    // Compute fragment depth and 1/w using linear interpolation.
+    Frag.Depth = (a * A.Z) + (b * B.Z) + (c * C.Z);
+    Frag.InvW = (a / A.W) + (b / B.W) + (c / C.W);
+  }
+
+  // Lambda for generating data for location variables.
+  auto GenLocData = [&](uint32_t Lane, uint32_t Location, uint32_t Component,
+                        const Variable *Var, const Type *VarTy, Memory *Mem,
+                        uint64_t Address) {
+    // Gather output data from each vertex.
+    const Object &FA = Primitive.OutA.Locations.at({Location, Component});
+    const Object &FB = Primitive.OutB.Locations.at({Location, Component});
+    const Object &FC = Primitive.OutC.Locations.at({Location, Component});
+
+    // Interpolate vertex outputs to produce fragment input.
+    Object VarObj(VarTy);
+    interpolate(VarObj, VarTy, 0, FA, FB, FC, A.W, B.W, C.W, Frags[Lane].InvW,
+                Bary[Lane][0], Bary[Lane][1], Bary[Lane][2],
+                Var->hasDecoration(SpvDecorationFlat),
+                !Var->hasDecoration(SpvDecorationNoPerspective));
+    VarObj.store(*Mem, Address);
+  };
 
-  PendingFragments.clear();
+  processQuad(Frags, Covered, RPI, GenLocData);
 }
 
 void PipelineExecutor::signalError()
@@ -2114,6 +2574,7 @@ bool PipelineExecutor::swtch(const std::vector<std::string> &Args)
       Group = createWorkgroup(*PG);
       Dev.reportWorkgroupBegin(Group);
       PendingGroups.erase(PG);
+      NumWorkItems--;
     }
   }
 
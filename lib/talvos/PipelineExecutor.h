@@ -13,6 +13,8 @@
 #include <condition_variable>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -78,6 +80,12 @@ public:
   /// Returns true if the calling thread is a PipelineExecutor worker thread.
   bool isWorkerThread() const;
 
+  /// Call \p Task with each index from 0 to \p NumItems - 1, using the worker
+  /// threads, and return once every call has completed.
+  /// The calls are made on the calling thread instead if there is at most one
+  /// item, or if the worker threads are busy executing a command.
+  void parallelFor(size_t NumItems, std::function<void(size_t)> Task);
+
   /// Run a compute dispatch command to completion.
   void run(const DispatchCommand &Cmd);
 
@@ -100,6 +108,26 @@ private:
   /// Internal structure to hold triangle primitive data during rasterization.
   struct TrianglePrimitive;
 
+  /// Internal structure to hold the primitives in a draw, binned into
+  /// screen-space tiles.
+  struct TileBins;
+
+  /// Internal structure to hold an axis-aligned framebuffer bounding box.
+  struct BoundingBox
+  {
+    int XMin; ///< Minimum framebuffer x-coordinate (inclusive).
+    int XMax; ///< Maximum framebuffer x-coordinate (inclusive).
+    int YMin; ///< Minimum framebuffer y-coordinate (inclusive).
+    int YMax; ///< Maximum framebuffer y-coordinate (inclusive).
+  };
+
+  /// Internal structure to hold a reusable fragment shader invocation.
+  struct FragmentInvocation;
+
+  /// Internal structure to hold the fragment shader invocations for a 2x2
+  /// quad of fragments.
+  struct FragmentQuad;
+
   /// Internal structure to hold fragment data.
   struct Fragment
   {
@@ -109,24 +137,32 @@ private:
     float InvW;  ///< Inverse of the interpolated clip w coordinate.
   };
 
-  /// Execute a function on every worker thread.
-  void doWork(std::function<void()> Task);
+  /// Claim the next item of work in the current task for the calling worker
+  /// thread, storing its index in \p Index.
+  /// Returns false if there are no items of work left in the task.
+  bool claimWork(size_t &Index);
+
+  /// Execute a function on every worker thread, which will process
+  /// \p NumItems items of work.
+  void doWork(size_t NumItems, std::function<void()> Task);
 
-  /// Worker thread entry point.
-  void runWorker();
+  /// Worker thread entry point. \p WorkerIndex identifies the worker thread.
+  void runWorker(unsigned WorkerIndex);
 
   /// Worker thread entry point for compute shaders.
   void runComputeWorker();
 
-  /// Worker thread entry point for triangle rasterization.
-  void runTriangleFragmentWorker(TrianglePrimitive Primitive,
-                                 const PipelineContext &PC,
-                                 const RenderPassInstance &RPI,
-                                 const VkViewport &Viewport);
+  /// Step the invocations in the current workgroup in lockstep until each of
+  /// them has hit a barrier or completed.
+  void runLockstep();
 
-  /// Worker thread entry point for point rasterization.
-  void runPointFragmentWorker(PointPrimitive Primitive,
-                              const RenderPassInstance &RPI);
+  /// Worker thread entry point for rasterization.
+  /// Each item of work is a tile in \p Bins, and \p Rasterize is called with
+  /// the index of each primitive that overlaps the tile (in primitive order)
+  /// and the part of its bounding box that lies within the tile.
+  void runFragmentWorker(
+      const TileBins &Bins,
+      std::function<void(uint32_t, const BoundingBox &)> Rasterize);
 
   /// Worker thread entry point for vertex shaders.
   void runVertexWorker(RenderPipelineState *State, uint32_t InstanceIndex);
@@ -138,24 +174,65 @@ private:
   void initializeVariables(const DescriptorSetMap &DSM,
                            uint64_t PushConstantAddress);
 
-  /// Helper function to build list of pending fragments in a bounding box.
-  void buildPendingFragments(const DrawCommandBase &Cmd, int XMinFB, int XMaxFB,
-                             int YMinFB, int YMaxFB);
-
-  /// Helper function to process a fragment.
-  void processFragment(const Fragment &Frag, const RenderPassInstance &RPI,
-                       std::function<void(uint32_t, uint32_t, const Variable *,
-                                          const Type *, Memory *, uint64_t)>
-                           GenLocData);
-
-  /// Helper function to rasterize a point primitive.
-  void rasterizePoint(const DrawCommandBase &Cmd, const VkViewport &Viewport,
-                      const VertexOutput &Vertex);
-
-  /// Helper function to rasterize a triangle primitive.
-  void rasterizeTriangle(const DrawCommandBase &Cmd, const VkViewport &Viewport,
-                         const VertexOutput &VA, const VertexOutput &VB,
-                         const VertexOutput &VC);
+  /// Helper function to add a primitive to the tiles in \p Bins that overlap
+  /// its framebuffer bounding box \p Box, after clamping \p Box to the
+  /// framebuffer and scissor rectangle.
+  /// Returns false if the clamped bounding box is empty.
+  bool binPrimitive(const DrawCommandBase &Cmd, TileBins &Bins,
+                    BoundingBox &Box);
+
+  /// Helper function to set up a point primitive and bin it into tiles.
+  void binPoint(const DrawCommandBase &Cmd, const VkViewport &Viewport,
+                const VertexOutput &Vertex, TileBins &Bins,
+                std::vector<PointPrimitive> &Points);
+
+  /// Helper function to set up a triangle primitive and bin it into tiles.
+  /// Triangles that are culled are not binned.
+  void binTriangle(const DrawCommandBase &Cmd, const VkViewport &Viewport,
+                   const VertexOutput &VA, const VertexOutput &VB,
+                   const VertexOutput &VC, TileBins &Bins,
+                   std::vector<TrianglePrimitive> &Triangles);
+
+  /// Returns the fragment shader invocation for lane \p Lane of the quad for
+  /// the calling worker thread, ready to execute from the beginning.
+  /// The invocation is created if necessary, or reset otherwise.
+  FragmentInvocation &getFragmentInvocation(uint32_t Lane);
+
+  /// Helper function to process a 2x2 quad of fragments.
+  /// Lane \p i of the quad is \p Frags[i], and is covered by the primitive if
+  /// bit \p i of \p Covered is set. Uncovered fragments are executed as
+  /// helper invocations if the fragment shader uses derivatives, and their
+  /// outputs are discarded. \p GenLocData is called with the lane index to
+  /// generate the data for each location variable.
+  void processQuad(const Fragment Frags[4], uint32_t Covered,
+                   const RenderPassInstance &RPI,
+                   std::function<void(uint32_t, uint32_t, uint32_t,
+                                      const Variable *, const Type *, Memory *,
+                                      uint64_t)>
+                       GenLocData);
+
+  /// Helper function to write the outputs of the fragment shader invocation
+  /// \p FI for fragment \p Frag to the color attachments.
+  void writeFragmentOutputs(FragmentInvocation &FI, const Fragment &Frag,
+                            const RenderPassInstance &RPI);
+
+  /// Helper function to rasterize the part of a point primitive that lies
+  /// within \p Box.
+  void rasterizePoint(const PointPrimitive &Primitive, const BoundingBox &Box,
+                      const RenderPassInstance &RPI);
+
+  /// Helper function to rasterize the part of a triangle primitive that lies
+  /// within \p Box.
+  void rasterizeTriangle(const TrianglePrimitive &Primitive,
+                         const BoundingBox &Box, const RenderPassInstance &RPI);
+
+  /// Helper function to process a quad of fragments of a triangle primitive,
+  /// with its first fragment at framebuffer coordinate (\p X, \p Y).
+  /// \p Bary holds the barycentric coordinates of each fragment in the quad,
+  /// and \p Covered is as for processQuad().
+  void processTriangleQuad(const TrianglePrimitive &Primitive, uint32_t X,
+                           uint32_t Y, const float Bary[4][3],
+                           uint32_t Covered, const RenderPassInstance &RPI);
 
   /// Helper function to get the position from vertex output builtin data.
   static Vec4 getPosition(const VertexOutput &Out);
@@ -175,12 +252,15 @@ private:
   /// The pipeline stage currently being executed.
   const PipelineStage *CurrentStage;
 
-  /// The initial object values for each invocation.
+  /// The initial object values, which are shared by every invocation.
   std::vector<Object> Objects;
 
   /// The number of worker threads currently executing.
   unsigned NumThreads;
 
+  /// True when workgroups are executed in lockstep.
+  bool Lockstep;
+
   /// List of worker threads.
   std::vector<std::thread> WorkerThreads;
 
@@ -193,6 +273,9 @@ private:
   /// ID used to identify the current task.
   uint32_t CurrentTaskID = 0;
 
+  /// Mutex held by the thread that is giving tasks to the worker threads.
+  std::mutex TaskMutex;
+
   /// Mutex used to synchronize with worker threads.
   std::mutex WorkerMutex;
 
@@ -205,17 +288,46 @@ private:
   /// Tally of the number of workers that have finished the current task.
   std::atomic<uint32_t> NumWorkersFinished;
 
+  /// The strategies available for distributing work to worker threads.
+  enum Scheduler
+  {
+    /// Each worker claims one item of work at a time from a shared counter.
+    SHARED_SCHEDULER,
+
+    /// Each worker claims chunks of work from its own queue, and steals work
+    /// from other queues once its own is empty.
+    WORK_STEALING_SCHEDULER
+  };
+
+  /// The scheduler used to distribute work to worker threads.
+  Scheduler CurrentScheduler;
+
+  /// A range of items of work that are queued for a worker thread.
+  struct alignas(64) WorkQueue
+  {
+    std::mutex Mutex; ///< Mutex protecting the range.
+    size_t Begin;     ///< Index of the first item of work in the range.
+    size_t End;       ///< Index one past the last item of work in the range.
+  };
+
+  /// Per-worker queues used by the work stealing scheduler.
+  std::vector<WorkQueue> WorkQueues;
+
   /// Index of next item of work to execute in the current task.
   std::atomic<size_t> NextWorkIndex;
 
+  /// Number of items of work in the current task.
+  size_t NumWorkItems;
+
   /// Pool of group IDs pending creation and execution.
   std::vector<Dim3> PendingGroups;
 
   /// Pool of groups that have begun execution and been suspended.
   std::vector<Workgroup *> RunningGroups;
 
-  /// Pool of framebuffer coordinates pending fragment processing.
-  std::vector<Dim3> PendingFragments;
+  /// Reusable fragment shader invocations for each worker thread.
+  /// These invocations are only valid for the duration of a single task.
+  std::vector<FragmentQuad> FragmentQuads;
 
   /// Create a compute shader workgroup and its work-item invocations.
   Workgroup *createWorkgroup(Dim3 GroupId) const;
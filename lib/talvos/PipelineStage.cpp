@@ -6,19 +6,137 @@
 /// \file PipelineStage.cpp
 /// This file defines the PipelineStage class.
 
-#include "talvos/PipelineStage.h"
+#include <algorithm>
+#include <cassert>
+
+#include <spirv/unified1/spirv.h>
+
+#include "PipelineExecutor.h"
+#include "Utils.h"
+#include "talvos/Block.h"
+#include "talvos/Device.h"
 #include "talvos/EntryPoint.h"
+#include "talvos/Function.h"
 #include "talvos/Instruction.h"
 #include "talvos/Invocation.h"
 #include "talvos/Module.h"
+#include "talvos/PipelineStage.h"
+#include "talvos/Type.h"
+#include "talvos/Variable.h"
 
 namespace talvos
 {
 
+/// Returns the number of ID operands read by \p DI, if it is an instruction
+/// that can be folded when all of those operands are constant. The ID
+/// operands immediately follow the result type and result ID.
+/// Returns 0 if the instruction cannot be folded.
+///
+/// Only instructions that are free of side effects, and that cannot fault or
+/// report an error for any operand values, are folded. This is required since
+/// they may be evaluated even if they are never executed.
+static uint32_t getFoldableOperands(const DecodedInstruction &DI)
+{
+  switch (DI.getOpcode())
+  {
+  case SpvOpCompositeExtract:
+    return 1;
+  case SpvOpCompositeInsert:
+  case SpvOpVectorShuffle:
+    return 2;
+  case SpvOpAll:
+  case SpvOpAny:
+  case SpvOpBitcast:
+  case SpvOpBitwiseAnd:
+  case SpvOpBitwiseOr:
+  case SpvOpBitwiseXor:
+  case SpvOpCompositeConstruct:
+  case SpvOpConvertSToF:
+  case SpvOpConvertUToF:
+  case SpvOpCopyObject:
+  case SpvOpDot:
+  case SpvOpFAdd:
+  case SpvOpFConvert:
+  case SpvOpFDiv:
+  case SpvOpFMul:
+  case SpvOpFNegate:
+  case SpvOpFOrdEqual:
+  case SpvOpFOrdGreaterThan:
+  case SpvOpFOrdGreaterThanEqual:
+  case SpvOpFOrdLessThan:
+  case SpvOpFOrdLessThanEqual:
+  case SpvOpFOrdNotEqual:
+  case SpvOpFSub:
+  case SpvOpFUnordEqual:
+  case SpvOpFUnordGreaterThan:
+  case SpvOpFUnordGreaterThanEqual:
+  case SpvOpFUnordLessThan:
+  case SpvOpFUnordLessThanEqual:
+  case SpvOpFUnordNotEqual:
+  case SpvOpIAdd:
+  case SpvOpIEqual:
+  case SpvOpIMul:
+  case SpvOpINotEqual:
+  case SpvOpISub:
+  case SpvOpIsInf:
+  case SpvOpIsNan:
+  case SpvOpLogicalAnd:
+  case SpvOpLogicalEqual:
+  case SpvOpLogicalNot:
+  case SpvOpLogicalNotEqual:
+  case SpvOpLogicalOr:
+  case SpvOpNot:
+  case SpvOpSConvert:
+  case SpvOpSGreaterThan:
+  case SpvOpSGreaterThanEqual:
+  case SpvOpSLessThan:
+  case SpvOpSLessThanEqual:
+  case SpvOpSNegate:
+  case SpvOpSelect:
+  case SpvOpUConvert:
+  case SpvOpUGreaterThan:
+  case SpvOpUGreaterThanEqual:
+  case SpvOpULessThan:
+  case SpvOpULessThanEqual:
+  case SpvOpVectorTimesScalar:
+    return DI.getNumOperands() - 2;
+  default:
+    return 0;
+  }
+}
+
+/// Returns the branch targets of the terminator instruction \p DI.
+static std::vector<const Block *> getTargets(const DecodedInstruction &DI)
+{
+  switch (DI.getOpcode())
+  {
+  case SpvOpBranch:
+    return {DI.getTarget(0)};
+  case SpvOpBranchConditional:
+    return {DI.getTarget(0), DI.getTarget(1)};
+  case SpvOpSwitch:
+  {
+    std::vector<const Block *> Targets;
+    for (uint32_t i = 0; i < DI.getNumOperands() / 2; i++)
+      Targets.push_back(DI.getTarget(i));
+    return Targets;
+  }
+  default:
+    return {};
+  }
+}
+
 PipelineStage::PipelineStage(Device &D, std::shared_ptr<const Module> M,
                              const EntryPoint *EP, const SpecConstantMap &SM)
     : Mod(M), EP(EP)
 {
+  // Build the functions used by this stage now, rather than when they are
+  // first executed. Functions already built for another stage are skipped,
+  // and the rest are built in parallel on the worker threads of the device.
+  std::vector<uint32_t> Unbuilt = M->getUnbuiltFunctions(EP->getId());
+  D.getPipelineExecutor().parallelFor(
+      Unbuilt.size(), [&](size_t i) { M->getFunction(Unbuilt[i]); });
+
   Objects = M->getObjects();
 
   // Update objects with specialization constant values.
@@ -38,6 +156,44 @@ PipelineStage::PipelineStage(Device &D, std::shared_ptr<const Module> M,
     Objects[Id] = I.getObject(Id);
   }
 
+  // Optimize the code now that the values of specialization constants are
+  // known. Plugins and the interactive debugger observe every instruction that
+  // is executed, so the module is executed as-is when they are in use.
+  if (checkEnv("TALVOS_OPTIMIZE", true) && !D.hasPlugins() &&
+      !D.isInteractive())
+    optimize(I);
+
+  // Results that have been folded to constants do not need a register.
+  for (auto &R : M->getRegisters())
+  {
+    if (!Objects[R.first])
+    {
+      Registers.push_back(R);
+      LocalIds.push_back(R.first);
+    }
+  }
+
+  // Pointers to variables in these storage classes differ between invocations.
+  for (const Variable *V : M->getVariables())
+  {
+    switch (V->getType()->getStorageClass())
+    {
+    case SpvStorageClassInput:
+    case SpvStorageClassOutput:
+    case SpvStorageClassPrivate:
+    case SpvStorageClassWorkgroup:
+      LocalIds.push_back(V->getId());
+      break;
+    default:
+      break;
+    }
+  }
+
+  // All other objects are shared, and are resolved from the object table.
+  LocalSlots.resize(Objects.size());
+  for (size_t i = 0; i < LocalIds.size(); i++)
+    LocalSlots[LocalIds[i]] = i + 1;
+
   // Get local size from execution mode, but override with WorkgroupSize
   // decoration if present.
   this->GroupSize = M->getLocalSize(EP->getId());
@@ -50,4 +206,179 @@ PipelineStage::PipelineStage(Device &D, std::shared_ptr<const Module> M,
   }
 }
 
+PipelineStage::~PipelineStage() {}
+
+const Function *PipelineStage::getFunction(uint32_t Id) const
+{
+  auto Itr = Functions.find(Id);
+  if (Itr != Functions.end())
+    return Itr->second.get();
+  return Mod->getFunction(Id);
+}
+
+void PipelineStage::optimize(Invocation &I)
+{
+  // Optimize the entry point function, and then any functions that it calls.
+  std::vector<uint32_t> Worklist = {EP->getId()};
+  for (size_t i = 0; i < Worklist.size(); i++)
+  {
+    const Function *Func = Mod->getFunction(Worklist[i]);
+    if (!Func)
+      continue;
+
+    std::unique_ptr<Function> Optimized = optimize(Func, I);
+    for (const Block *B : Optimized->getBlocks())
+    {
+      const DecodedInstruction *Code = B->getCode();
+      for (size_t j = 0; j < B->getNumInstructions(); j++)
+      {
+        if (Code[j].getOpcode() != SpvOpFunctionCall)
+          continue;
+        uint32_t Callee = Code[j].getOperand(2);
+        if (std::find(Worklist.begin(), Worklist.end(), Callee) ==
+            Worklist.end())
+          Worklist.push_back(Callee);
+      }
+    }
+    Functions[Func->getId()] = std::move(Optimized);
+  }
+}
+
+std::unique_ptr<Function> PipelineStage::optimize(const Function *Func,
+                                                  Invocation &I)
+{
+  // The optimized code and branch targets for each block.
+  std::map<const Block *, std::vector<DecodedInstruction>> Code;
+  std::map<const Block *, std::vector<const Block *>> Targets;
+
+  // Blocks are visited in the order that they appear in the module, which
+  // guarantees that values are defined before they are used (except by OpPhi
+  // instructions, which are never folded).
+  for (const Block *B : Func->getBlocks())
+  {
+    std::vector<DecodedInstruction> &BlockCode = Code[B];
+    const DecodedInstruction *Original = B->getCode();
+    const DecodedInstruction *LoopMerge = nullptr;
+    for (size_t i = 0; i < B->getNumInstructions(); i++)
+    {
+      const DecodedInstruction &DI = Original[i];
+
+      // Drop instructions that have no effect.
+      if (DI.Handler == &Invocation::executeNop)
+      {
+        if (DI.getOpcode() == SpvOpLoopMerge)
+          LoopMerge = &DI;
+        continue;
+      }
+
+      // Fold instructions whose operands are all constant. The result is
+      // evaluated once and becomes part of the object table for this stage.
+      if (uint32_t NumIds = getFoldableOperands(DI))
+      {
+        bool Constant = true;
+        for (uint32_t j = 2; j < 2 + NumIds; j++)
+          Constant &= (bool)Objects[DI.getOperand(j)];
+        if (Constant)
+        {
+          (I.*DI.Handler)(&DI);
+          uint32_t Id = DI.getOperand(1);
+          Objects[Id] = I.getObject(Id);
+          continue;
+        }
+      }
+
+      BlockCode.push_back(DI);
+    }
+
+    // Replace branches with constant conditions with unconditional branches.
+    DecodedInstruction &Terminator = BlockCode.back();
+    Targets[B] = getTargets(Terminator);
+    int Taken = -1;
+    if (Terminator.getOpcode() == SpvOpBranchConditional)
+    {
+      const Object &Condition = Objects[Terminator.getOperand(0)];
+      if (Condition)
+        Taken = Condition.get<bool>() ? 0 : 1;
+    }
+    else if (Terminator.getOpcode() == SpvOpSwitch)
+    {
+      const Object &Selector = Objects[Terminator.getOperand(0)];
+      if (Selector && Selector.getType()->getBitWidth() == 32)
+      {
+        Taken = 0;
+        for (uint32_t j = 2; j < Terminator.getNumOperands(); j += 2)
+        {
+          if (Selector.get<uint32_t>() == Terminator.getOperand(j))
+          {
+            Taken = j / 2;
+            break;
+          }
+        }
+      }
+    }
+    if (Taken >= 0)
+    {
+      // Point the operand at the label of the target that is taken.
+      uint32_t LabelIndex =
+          Terminator.getOpcode() == SpvOpSwitch ? Taken * 2 + 1 : Taken + 1;
+      Terminator.Handler = &Invocation::executeBranch;
+      Terminator.Opcode = SpvOpBranch;
+      Terminator.Operands += LabelIndex;
+      Terminator.NumOperands = 1;
+      Targets[B] = {Targets[B][Taken]};
+    }
+
+    // Invocation::step() only moves to the next instruction if the current
+    // instruction has not changed, so a block that branches to itself must
+    // not consist of just its terminator. Keep the merge instruction of such
+    // a loop, which every single block loop has in structured control flow.
+    if (BlockCode.size() == 1 &&
+        std::count(Targets[B].begin(), Targets[B].end(), B))
+    {
+      assert(LoopMerge && "single block loop without a merge instruction");
+      BlockCode.insert(BlockCode.begin(), *LoopMerge);
+    }
+  }
+
+  // Find the blocks that are still reachable from the first block.
+  std::vector<const Block *> Reachable = {Func->getFirstBlock()};
+  for (size_t i = 0; i < Reachable.size(); i++)
+  {
+    for (const Block *Target : Targets[Reachable[i]])
+    {
+      if (std::find(Reachable.begin(), Reachable.end(), Target) ==
+          Reachable.end())
+        Reachable.push_back(Target);
+    }
+  }
+
+  // Create the optimized function, with blocks in their original order.
+  std::unique_ptr<Function> Optimized =
+      std::make_unique<Function>(Func->getId(), Func->getType());
+  for (size_t i = 0; i < Func->getNumParams(); i++)
+    Optimized->addParam(Func->getParamId(i));
+  Optimized->setFirstBlock(Func->getFirstBlockId());
+
+  std::map<const Block *, Block *> NewBlocks;
+  std::vector<std::unique_ptr<Block>> Blocks;
+  for (const Block *B : Func->getBlocks())
+  {
+    if (std::find(Reachable.begin(), Reachable.end(), B) == Reachable.end())
+      continue;
+    Blocks.push_back(std::make_unique<Block>(B->getId()));
+    NewBlocks[B] = Blocks.back().get();
+  }
+  for (auto &B : NewBlocks)
+  {
+    std::vector<const Block *> BlockTargets;
+    for (const Block *Target : Targets[B.first])
+      BlockTargets.push_back(NewBlocks.at(Target));
+    B.second->setCode(Code[B.first], BlockTargets);
+  }
+  for (auto &B : Blocks)
+    Optimized->addBlock(std::move(B));
+
+  return Optimized;
+}
+
 } // namespace talvos
@@ -10,6 +10,8 @@
 #include <cstring>
 #include <iostream>
 
+#include "Utils.h"
+
 namespace talvos
 {
 
@@ -48,4 +50,26 @@ unsigned long getEnvUInt(const char *Name, unsigned Default)
   return Value;
 }
 
+unsigned getEnvOption(const char *Name,
+                      std::initializer_list<const char *> Options,
+                      unsigned Default)
+{
+  const char *Value = getenv(Name);
+  if (!Value)
+    return Default;
+
+  unsigned Index = 0;
+  for (const char *Option : Options)
+  {
+    if (!strcmp(Value, Option))
+      return Index;
+    Index++;
+  }
+
+  std::cerr << std::endl
+            << "ERROR: Invalid value for " << Name << " environment variable"
+            << std::endl;
+  abort();
+}
+
 } // namespace talvos
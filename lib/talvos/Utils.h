@@ -9,6 +9,8 @@
 #ifndef TALVOS_UTILS_H
 #define TALVOS_UTILS_H
 
+#include <initializer_list>
+
 namespace talvos
 {
 
@@ -20,6 +22,12 @@ bool checkEnv(const char *Name, bool Default);
 /// \p Default if it is not set.
 unsigned long getEnvUInt(const char *Name, unsigned Default);
 
+/// Returns the index of the value of the environment variable \p Name within
+/// \p Options, or \p Default if it is not set.
+unsigned getEnvOption(const char *Name,
+                      std::initializer_list<const char *> Options,
+                      unsigned Default);
+
 } // namespace talvos
 
 #endif
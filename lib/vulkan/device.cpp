@@ -126,8 +126,7 @@ VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(
   pProperties->vendorID = 0;      // TODO: Register a vendor ID.
   pProperties->deviceID = 0;      // TODO: Something meaningful.
   pProperties->deviceType = VK_PHYSICAL_DEVICE_TYPE_OTHER;
-  memset(pProperties->pipelineCacheUUID, 0,
-         sizeof(pProperties->pipelineCacheUUID));
+  getPipelineCacheUUID(pProperties->pipelineCacheUUID);
   strcpy(pProperties->deviceName, "Talvos");
 
   pProperties->limits.maxImageDimension1D = 4096;
@@ -288,6 +287,14 @@ VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties2(
 
       break;
     }
+    case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT:
+    {
+      VkPhysicalDeviceExternalMemoryHostPropertiesEXT *Properties =
+          (VkPhysicalDeviceExternalMemoryHostPropertiesEXT *)Ext;
+      Properties->minImportedHostPointerAlignment =
+          TALVOS_MIN_IMPORTED_HOST_POINTER_ALIGNMENT;
+      break;
+    }
     case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES:
     {
       VkPhysicalDeviceMaintenance3Properties *Properties =
@@ -18,6 +18,8 @@ const uint32_t NumInstanceExtensions =
 
 // List of supported device extensions.
 const VkExtensionProperties DeviceExtensions[] = {
+    {VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+     VK_EXT_EXTERNAL_MEMORY_HOST_SPEC_VERSION},
     {VK_KHR_8BIT_STORAGE_EXTENSION_NAME, VK_KHR_8BIT_STORAGE_SPEC_VERSION},
     {VK_KHR_BIND_MEMORY_2_EXTENSION_NAME, VK_KHR_BIND_MEMORY_2_SPEC_VERSION},
     {VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME,
@@ -286,6 +286,9 @@ PFN_vkVoidFunction getFunctionPointer(const char *Name)
   CASE(vkTrimCommandPoolKHR);
   CASE(vkUpdateDescriptorSetWithTemplateKHR);
 
+  // EXT functions.
+  CASE(vkGetMemoryHostPointerPropertiesEXT);
+
 #undef CASE
 
   return nullptr;
@@ -8,12 +8,57 @@
 #include "talvos/Device.h"
 #include "talvos/Memory.h"
 
+/// Returns true if \p HostPointer can be imported with handle type \p Type.
+static bool isValidHostPointer(VkExternalMemoryHandleTypeFlagBits Type,
+                               const void *HostPointer)
+{
+  if (Type != VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT &&
+      Type != VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_MAPPED_FOREIGN_MEMORY_BIT_EXT)
+    return false;
+  return ((uintptr_t)HostPointer %
+          TALVOS_MIN_IMPORTED_HOST_POINTER_ALIGNMENT) == 0;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(
     VkDevice device, const VkMemoryAllocateInfo *pAllocateInfo,
     const VkAllocationCallbacks *pAllocator, VkDeviceMemory *pMemory)
 {
-  uint64_t Address =
-      device->Device->getGlobalMemory().allocate(pAllocateInfo->allocationSize);
+  talvos::Memory &GlobalMemory = device->Device->getGlobalMemory();
+
+  // Walk through extensions.
+  void *HostPointer = nullptr;
+  const void *Ext = pAllocateInfo->pNext;
+  while (Ext)
+  {
+    switch (*(VkStructureType *)Ext)
+    {
+    case VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT:
+    {
+      VkImportMemoryHostPointerInfoEXT *ImportInfo =
+          (VkImportMemoryHostPointerInfoEXT *)Ext;
+      if (!isValidHostPointer(ImportInfo->handleType,
+                              ImportInfo->pHostPointer) ||
+          (pAllocateInfo->allocationSize %
+           TALVOS_MIN_IMPORTED_HOST_POINTER_ALIGNMENT))
+        return VK_ERROR_INVALID_EXTERNAL_HANDLE;
+      HostPointer = ImportInfo->pHostPointer;
+      break;
+    }
+    default:
+      break;
+    }
+
+    Ext = ((void **)Ext)[1];
+  }
+
+  // Use the imported host memory directly if provided.
+  uint64_t Address;
+  if (HostPointer)
+    Address = GlobalMemory.import((uint8_t *)HostPointer,
+                                  pAllocateInfo->allocationSize);
+  else
+    Address = GlobalMemory.allocate(pAllocateInfo->allocationSize);
+
   (*pMemory) = new VkDeviceMemory_T;
   (*pMemory)->Address = Address;
   (*pMemory)->NumBytes = pAllocateInfo->allocationSize;
@@ -53,7 +98,8 @@ VKAPI_ATTR void VKAPI_CALL
 vkGetDeviceMemoryCommitment(VkDevice device, VkDeviceMemory memory,
                             VkDeviceSize *pCommittedMemoryInBytes)
 {
-  *pCommittedMemoryInBytes = memory->NumBytes;
+  *pCommittedMemoryInBytes =
+      device->Device->getGlobalMemory().getCommitment(memory->Address);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL vkGetMemoryFdKHR(
@@ -69,6 +115,19 @@ VKAPI_ATTR VkResult VKAPI_CALL vkGetMemoryFdPropertiesKHR(
   TALVOS_ABORT_UNIMPLEMENTED;
 }
 
+VKAPI_ATTR VkResult VKAPI_CALL vkGetMemoryHostPointerPropertiesEXT(
+    VkDevice device, VkExternalMemoryHandleTypeFlagBits handleType,
+    const void *pHostPointer,
+    VkMemoryHostPointerPropertiesEXT *pMemoryHostPointerProperties)
+{
+  if (!isValidHostPointer(handleType, pHostPointer))
+    return VK_ERROR_INVALID_EXTERNAL_HANDLE;
+
+  // Host memory can be imported into the host visible memory type.
+  pMemoryHostPointerProperties->memoryTypeBits = 0x1;
+  return VK_SUCCESS;
+}
+
 VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(
     VkPhysicalDevice physicalDevice,
     VkPhysicalDeviceMemoryProperties *pMemoryProperties)
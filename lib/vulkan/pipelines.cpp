@@ -8,10 +8,15 @@
 #include <cstring>
 
 #include "talvos/ComputePipeline.h"
+#include "talvos/Device.h"
 #include "talvos/GraphicsPipeline.h"
 #include "talvos/Module.h"
 #include "talvos/PipelineStage.h"
 #include "talvos/Type.h"
+#include "version.h"
+
+// Size of the pipeline cache header (VkPipelineCacheHeaderVersionOne).
+#define PIPELINE_CACHE_HEADER_SIZE 32
 
 // Values match SPIR-V spec.
 #define EXEC_MODEL_VERTEX 0
@@ -37,6 +42,17 @@ vkCmdBindPipeline(VkCommandBuffer commandBuffer,
   }
 }
 
+void getPipelineCacheUUID(uint8_t UUID[VK_UUID_SIZE])
+{
+  // Identify the driver, version, and pipeline cache data format.
+  memset(UUID, 0, VK_UUID_SIZE);
+  memcpy(UUID, "talvos", 6);
+  UUID[6] = TALVOS_VERSION_MAJOR;
+  UUID[7] = TALVOS_VERSION_MINOR;
+  UUID[8] = TALVOS_VERSION_PATCH;
+  UUID[9] = talvos::Module::SERIALIZED_VERSION;
+}
+
 // Helper to generate a specialization constant map for a pipeline stage.
 void genSpecConstantMap(const talvos::Module *Mod,
                         const VkSpecializationInfo *SpecInfo,
@@ -76,7 +92,8 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(
   for (uint32_t i = 0; i < createInfoCount; i++)
   {
     const VkPipelineShaderStageCreateInfo &StageInfo = pCreateInfos[i].stage;
-    std::shared_ptr<talvos::Module> Mod = StageInfo.module->Module;
+    std::shared_ptr<talvos::Module> Mod =
+        getModule(device, StageInfo.module, pipelineCache);
 
     // Build specialization constant map.
     talvos::SpecConstantMap SM;
@@ -84,9 +101,9 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(
 
     // Create pipeline.
     pPipelines[i] = new VkPipeline_T;
-    talvos::PipelineStage *Stage = new talvos::PipelineStage(
-        *device->Device, Mod,
-        Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_GLCOMPUTE), SM);
+    std::shared_ptr<const talvos::PipelineStage> Stage =
+        device->Device->getPipelineStage(
+            Mod, Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_GLCOMPUTE), SM);
     pPipelines[i]->ComputePipeline = new talvos::ComputePipeline(Stage);
   }
   return VK_SUCCESS;
@@ -99,13 +116,14 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(
 {
   for (uint32_t i = 0; i < createInfoCount; i++)
   {
-    talvos::PipelineStage *VertexStage = nullptr;
-    talvos::PipelineStage *FragmentStage = nullptr;
+    std::shared_ptr<const talvos::PipelineStage> VertexStage;
+    std::shared_ptr<const talvos::PipelineStage> FragmentStage;
     for (uint32_t s = 0; s < pCreateInfos[i].stageCount; s++)
     {
       const VkPipelineShaderStageCreateInfo &StageInfo =
           pCreateInfos[i].pStages[s];
-      std::shared_ptr<const talvos::Module> Mod = StageInfo.module->Module;
+      std::shared_ptr<const talvos::Module> Mod =
+          getModule(device, StageInfo.module, pipelineCache);
 
       // Build specialization constant map.
       talvos::SpecConstantMap SM;
@@ -115,14 +133,12 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(
       switch (StageInfo.stage)
       {
       case VK_SHADER_STAGE_VERTEX_BIT:
-        VertexStage = new talvos::PipelineStage(
-            *device->Device, Mod,
-            Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_VERTEX), SM);
+        VertexStage = device->Device->getPipelineStage(
+            Mod, Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_VERTEX), SM);
         break;
       case VK_SHADER_STAGE_FRAGMENT_BIT:
-        FragmentStage = new talvos::PipelineStage(
-            *device->Device, Mod,
-            Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_FRAGMENT), SM);
+        FragmentStage = device->Device->getPipelineStage(
+            Mod, Mod->getEntryPoint(StageInfo.pName, EXEC_MODEL_FRAGMENT), SM);
         break;
       default:
         assert(false && "Unhandled pipeline stage");
@@ -185,6 +201,35 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreatePipelineCache(
     const VkAllocationCallbacks *pAllocator, VkPipelineCache *pPipelineCache)
 {
   *pPipelineCache = new VkPipelineCache_T;
+
+  // Check the header of the initial data, ignoring it if incompatible.
+  const uint8_t *Data = (const uint8_t *)pCreateInfo->pInitialData;
+  size_t NumBytes = pCreateInfo->initialDataSize;
+  if (NumBytes < PIPELINE_CACHE_HEADER_SIZE)
+    return VK_SUCCESS;
+  uint8_t UUID[VK_UUID_SIZE];
+  getPipelineCacheUUID(UUID);
+  if (((const uint32_t *)Data)[0] != PIPELINE_CACHE_HEADER_SIZE ||
+      ((const uint32_t *)Data)[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      memcmp(Data + 16, UUID, VK_UUID_SIZE))
+    return VK_SUCCESS;
+
+  // Load each serialized module entry.
+  size_t Offset = PIPELINE_CACHE_HEADER_SIZE;
+  while (NumBytes - Offset >= 16)
+  {
+    uint64_t Hash, EntrySize;
+    memcpy(&Hash, Data + Offset, 8);
+    memcpy(&EntrySize, Data + Offset + 8, 8);
+    Offset += 16;
+    if (EntrySize > NumBytes - Offset)
+      break;
+
+    (*pPipelineCache)->Modules[Hash].assign(Data + Offset,
+                                            Data + Offset + EntrySize);
+    Offset += EntrySize;
+  }
+
   return VK_SUCCESS;
 }
 
@@ -211,31 +256,48 @@ VKAPI_ATTR VkResult VKAPI_CALL
 vkGetPipelineCacheData(VkDevice device, VkPipelineCache pipelineCache,
                        size_t *pDataSize, void *pData)
 {
+  std::lock_guard<std::mutex> Lock(pipelineCache->Mutex);
+
   if (pData == nullptr)
   {
-    *pDataSize = 32;
+    *pDataSize = PIPELINE_CACHE_HEADER_SIZE;
+    for (auto &Entry : pipelineCache->Modules)
+      *pDataSize += 16 + Entry.second.size();
     return VK_SUCCESS;
   }
 
-  if (*pDataSize < 32)
+  if (*pDataSize < PIPELINE_CACHE_HEADER_SIZE)
   {
     *pDataSize = 0;
     return VK_INCOMPLETE;
   }
 
   // Pipeline cache header.
-  ((uint32_t *)pData)[0] = 32;
-  ((uint32_t *)pData)[1] = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
-  ((uint32_t *)pData)[2] = 0;
-  ((uint32_t *)pData)[3] = 0;
+  uint8_t *Data = (uint8_t *)pData;
+  ((uint32_t *)Data)[0] = PIPELINE_CACHE_HEADER_SIZE;
+  ((uint32_t *)Data)[1] = VK_PIPELINE_CACHE_HEADER_VERSION_ONE;
+  ((uint32_t *)Data)[2] = 0;
+  ((uint32_t *)Data)[3] = 0;
+  getPipelineCacheUUID(Data + 16);
+
+  // Write as many complete serialized module entries as will fit.
+  size_t Offset = PIPELINE_CACHE_HEADER_SIZE;
+  for (auto &Entry : pipelineCache->Modules)
+  {
+    uint64_t EntrySize = Entry.second.size();
+    if (*pDataSize - Offset < 16 + EntrySize)
+    {
+      *pDataSize = Offset;
+      return VK_INCOMPLETE;
+    }
 
-  // Pipeline cache UUID.
-  ((uint32_t *)pData)[4] = 0;
-  ((uint32_t *)pData)[5] = 0;
-  ((uint32_t *)pData)[6] = 0;
-  ((uint32_t *)pData)[7] = 0;
+    memcpy(Data + Offset, &Entry.first, 8);
+    memcpy(Data + Offset + 8, &EntrySize, 8);
+    memcpy(Data + Offset + 16, Entry.second.data(), EntrySize);
+    Offset += 16 + EntrySize;
+  }
 
-  *pDataSize = 32;
+  *pDataSize = Offset;
 
   return VK_SUCCESS;
 }
@@ -244,5 +306,12 @@ VKAPI_ATTR VkResult VKAPI_CALL
 vkMergePipelineCaches(VkDevice device, VkPipelineCache dstCache,
                       uint32_t srcCacheCount, const VkPipelineCache *pSrcCaches)
 {
-  TALVOS_ABORT_UNIMPLEMENTED;
+  std::lock_guard<std::mutex> Lock(dstCache->Mutex);
+  for (uint32_t i = 0; i < srcCacheCount; i++)
+  {
+    std::lock_guard<std::mutex> SrcLock(pSrcCaches[i]->Mutex);
+    dstCache->Modules.insert(pSrcCaches[i]->Modules.begin(),
+                             pSrcCaches[i]->Modules.end());
+  }
+  return VK_SUCCESS;
 }
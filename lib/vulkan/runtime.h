@@ -7,7 +7,9 @@
 #include "vulkan/vulkan_core.h"
 
 #include <cassert>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <unordered_set>
 #include <vector>
 
@@ -38,6 +40,10 @@ class Sampler;
             << std::endl;                                                      \
   abort()
 
+/// The minimum alignment of host pointers imported with
+/// VK_EXT_external_memory_host.
+#define TALVOS_MIN_IMPORTED_HOST_POINTER_ALIGNMENT 16
+
 struct VkBuffer_T
 {
   VkDeviceSize NumBytes;
@@ -161,6 +167,9 @@ struct VkPipeline_T
 
 struct VkPipelineCache_T
 {
+  /// Serialized modules, keyed by the hash of their SPIR-V binary.
+  std::map<uint64_t, std::vector<uint8_t>> Modules;
+  std::mutex Mutex;
 };
 
 struct VkPipelineLayout_T
@@ -190,9 +199,27 @@ struct VkSemaphore_T
 
 struct VkShaderModule_T
 {
+  /// The SPIR-V binary, which is only loaded when the module is first used to
+  /// create a pipeline (so that a pipeline cache can be used).
+  /// The binary is shared with the device, which compares it against other
+  /// binaries when interning the module.
+  std::shared_ptr<const std::vector<uint32_t>> Code;
+  uint64_t Hash;
   std::shared_ptr<talvos::Module> Module;
+  std::mutex Mutex;
 };
 
+/// Get the talvos::Module for \p ShaderModule, loading it if necessary.
+/// If \p Cache is not null, it is used to avoid parsing the SPIR-V binary.
+/// The module is interned with \p Device, so that identical shader modules
+/// share a single talvos::Module.
+std::shared_ptr<talvos::Module> getModule(VkDevice Device,
+                                          VkShaderModule ShaderModule,
+                                          VkPipelineCache Cache);
+
+/// Get the UUID that identifies the pipeline cache data format.
+void getPipelineCacheUUID(uint8_t UUID[VK_UUID_SIZE]);
+
 extern const uint32_t NumInstanceExtensions;
 extern const VkExtensionProperties InstanceExtensions[];
 extern const uint32_t NumDeviceExtensions;
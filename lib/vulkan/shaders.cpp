@@ -5,6 +5,7 @@
 
 #include "runtime.h"
 
+#include "talvos/Device.h"
 #include "talvos/Module.h"
 
 VKAPI_ATTR VkResult VKAPI_CALL vkCreateShaderModule(
@@ -12,11 +13,71 @@ VKAPI_ATTR VkResult VKAPI_CALL vkCreateShaderModule(
     const VkAllocationCallbacks *pAllocator, VkShaderModule *pShaderModule)
 {
   *pShaderModule = new VkShaderModule_T;
-  (*pShaderModule)->Module =
-      talvos::Module::load(pCreateInfo->pCode, pCreateInfo->codeSize / 4);
+  (*pShaderModule)->Code = std::make_shared<const std::vector<uint32_t>>(
+      pCreateInfo->pCode, pCreateInfo->pCode + pCreateInfo->codeSize / 4);
+  (*pShaderModule)->Hash = talvos::Module::hash(pCreateInfo->pCode,
+                                                pCreateInfo->codeSize / 4);
   return VK_SUCCESS;
 }
 
+std::shared_ptr<talvos::Module> getModule(VkDevice Device,
+                                          VkShaderModule ShaderModule,
+                                          VkPipelineCache Cache)
+{
+  std::lock_guard<std::mutex> Lock(ShaderModule->Mutex);
+
+  // Try to load the module from the pipeline cache.
+  bool Cached = false;
+  if (!ShaderModule->Module && Cache)
+  {
+    std::lock_guard<std::mutex> CacheLock(Cache->Mutex);
+    auto Entry = Cache->Modules.find(ShaderModule->Hash);
+    if (Entry != Cache->Modules.end())
+    {
+      ShaderModule->Module = talvos::Module::deserialize(
+          Entry->second.data(), Entry->second.size(),
+          ShaderModule->Code->data(), ShaderModule->Code->size());
+      Cached = ShaderModule->Module != nullptr;
+    }
+  }
+
+  // Otherwise, parse the SPIR-V binary.
+  if (!ShaderModule->Module)
+  {
+    ShaderModule->Module = talvos::Module::load(ShaderModule->Code->data(),
+                                                ShaderModule->Code->size());
+    if (!ShaderModule->Module)
+      return nullptr;
+  }
+
+  // Add the module to the pipeline cache, replacing any invalid entry.
+  // This must happen before interning, since a module that is already in use
+  // releases the serialized records of each function as it is built. In that
+  // case, the binary is parsed again to produce the cache entry.
+  if (Cache && !Cached)
+  {
+    std::vector<uint8_t> Data = ShaderModule->Module->serialize();
+    if (Data.empty())
+    {
+      std::shared_ptr<talvos::Module> Copy = talvos::Module::load(
+          ShaderModule->Code->data(), ShaderModule->Code->size());
+      if (Copy)
+        Data = Copy->serialize();
+    }
+    if (!Data.empty())
+    {
+      std::lock_guard<std::mutex> CacheLock(Cache->Mutex);
+      Cache->Modules[ShaderModule->Hash] = std::move(Data);
+    }
+  }
+
+  // Share the module with any identical modules already in use.
+  ShaderModule->Module =
+      Device->Device->internModule(ShaderModule->Module, ShaderModule->Code);
+
+  return ShaderModule->Module;
+}
+
 VKAPI_ATTR void VKAPI_CALL
 vkDestroyShaderModule(VkDevice device, VkShaderModule shaderModule,
                       const VkAllocationCallbacks *pAllocator)
@@ -1,7 +1,9 @@
 #include "common.h"
 
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 void check(VkResult Result, const char *Operation)
 {
@@ -13,6 +15,49 @@ void check(VkResult Result, const char *Operation)
   }
 }
 
+VkShaderModule createShaderModule(VkDevice Device, const char *FileName)
+{
+  // Load SPIR-V shader code.
+  FILE *CodeFile = fopen(FileName, "rb");
+  if (!CodeFile)
+  {
+    std::cerr << "Failed to open SPIR-V file '" << FileName << "'."
+              << std::endl;
+    exit(1);
+  }
+  fseek(CodeFile, 0, SEEK_END);
+  size_t ShaderCodeSize = ftell(CodeFile);
+  std::vector<uint32_t> ShaderCode(ShaderCodeSize / 4);
+  fseek(CodeFile, 0, SEEK_SET);
+  fread(ShaderCode.data(), 1, ShaderCodeSize, CodeFile);
+  fclose(CodeFile);
+
+  // Create shader module.
+  VkShaderModule Module;
+  VkShaderModuleCreateInfo ModuleCreateInfo = {
+      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, NULL, 0, ShaderCodeSize,
+      ShaderCode.data()};
+  VkResult Result =
+      vkCreateShaderModule(Device, &ModuleCreateInfo, NULL, &Module);
+  check(Result, "creating shader module");
+  return Module;
+}
+
+uint32_t findMemoryType(VkPhysicalDevice PhysicalDevice, uint32_t TypeBits,
+                        VkMemoryPropertyFlags Flags)
+{
+  VkPhysicalDeviceMemoryProperties MemProperties;
+  vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &MemProperties);
+  for (uint32_t i = 0; i < MemProperties.memoryTypeCount; i++)
+  {
+    if ((TypeBits & (1 << i)) &&
+        (MemProperties.memoryTypes[i].propertyFlags & Flags) == Flags)
+      return i;
+  }
+  std::cerr << "Failed to find a suitable memory type." << std::endl;
+  exit(1);
+}
+
 TestContext::TestContext(const char *AppName)
 {
   VkResult Result;
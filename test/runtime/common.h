@@ -18,3 +18,11 @@ public:
 
 /// Exit with an error if (Result != VK_SUCCESS).
 void check(VkResult Result, const char *Operation);
+
+/// Create a shader module from the SPIR-V binary in the file \p FileName.
+VkShaderModule createShaderModule(VkDevice Device, const char *FileName);
+
+/// Returns the index of a memory type that is allowed by \p TypeBits and has
+/// all of the properties in \p Flags, or exits with an error if none exist.
+uint32_t findMemoryType(VkPhysicalDevice PhysicalDevice, uint32_t TypeBits,
+                        VkMemoryPropertyFlags Flags);
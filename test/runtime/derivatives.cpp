@@ -0,0 +1,372 @@
+#include "common.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// Draw a triangle that covers the top-left half of a framebuffer, using a
+// fragment shader that computes derivatives of functions of FragCoord.
+// Fragments along the diagonal edge of the triangle belong to quads that are
+// only partially covered, so their derivatives depend on helper invocations.
+
+int main(int argc, char *argv[])
+{
+  VkResult Result;
+  VkImage Image;
+  VkImageView ImageView;
+  VkDeviceMemory ImageMem;
+  VkBuffer Buffer;
+  VkDeviceMemory BufferMem;
+  VkRenderPass RenderPass;
+  VkFramebuffer Framebuffer;
+  VkShaderModule VertexModule;
+  VkShaderModule FragmentModule;
+  VkPipelineLayout PipelineLayout;
+  VkPipeline Pipeline;
+  VkCommandBuffer CommandBuffer;
+  float *Pixels;
+
+  const uint32_t Width = 16;
+  const uint32_t Height = 16;
+  const VkFormat Format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  const VkDeviceSize NumBytes = Width * Height * 4 * sizeof(float);
+
+  // Create test context.
+  TestContext Context("test/derivatives");
+
+  // Create the color attachment image and bind memory to it.
+  VkImageCreateInfo ImageCreateInfo = {
+      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      NULL,
+      0,
+      VK_IMAGE_TYPE_2D,
+      Format,
+      {Width, Height, 1},
+      1,
+      1,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      0,
+      NULL,
+      VK_IMAGE_LAYOUT_UNDEFINED};
+  Result = vkCreateImage(Context.Device, &ImageCreateInfo, NULL, &Image);
+  check(Result, "creating image");
+  VkMemoryRequirements ImageRequirements;
+  vkGetImageMemoryRequirements(Context.Device, Image, &ImageRequirements);
+  VkMemoryAllocateInfo AllocateInfo = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL, ImageRequirements.size,
+      findMemoryType(Context.PhysicalDevice, ImageRequirements.memoryTypeBits,
+                     0)};
+  Result = vkAllocateMemory(Context.Device, &AllocateInfo, NULL, &ImageMem);
+  check(Result, "allocating image memory");
+  Result = vkBindImageMemory(Context.Device, Image, ImageMem, 0);
+  check(Result, "binding image memory");
+
+  // Create image view.
+  VkImageViewCreateInfo ImageViewCreateInfo = {
+      VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      NULL,
+      0,
+      Image,
+      VK_IMAGE_VIEW_TYPE_2D,
+      Format,
+      {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+       VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY},
+      {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
+  Result = vkCreateImageView(Context.Device, &ImageViewCreateInfo, NULL,
+                             &ImageView);
+  check(Result, "creating image view");
+
+  // Create a host-visible buffer to copy the rendered image into.
+  VkBufferCreateInfo BufferCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                         NULL,
+                                         0,
+                                         NumBytes,
+                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_SHARING_MODE_EXCLUSIVE,
+                                         0,
+                                         NULL};
+  Result = vkCreateBuffer(Context.Device, &BufferCreateInfo, NULL, &Buffer);
+  check(Result, "creating buffer");
+  VkMemoryRequirements BufferRequirements;
+  vkGetBufferMemoryRequirements(Context.Device, Buffer, &BufferRequirements);
+  AllocateInfo.allocationSize = BufferRequirements.size;
+  AllocateInfo.memoryTypeIndex =
+      findMemoryType(Context.PhysicalDevice, BufferRequirements.memoryTypeBits,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  Result = vkAllocateMemory(Context.Device, &AllocateInfo, NULL, &BufferMem);
+  check(Result, "allocating buffer memory");
+  Result = vkBindBufferMemory(Context.Device, Buffer, BufferMem, 0);
+  check(Result, "binding buffer memory");
+
+  // Create render pass.
+  VkAttachmentDescription Attachment = {
+      0,
+      Format,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_ATTACHMENT_LOAD_OP_CLEAR,
+      VK_ATTACHMENT_STORE_OP_STORE,
+      VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+  VkAttachmentReference ColorReference = {
+      0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkSubpassDescription Subpass = {0,    VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  0,    NULL,
+                                  1,    &ColorReference,
+                                  NULL, NULL,
+                                  0,    NULL};
+  VkRenderPassCreateInfo RenderPassCreateInfo = {
+      VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+      NULL,
+      0,
+      1,
+      &Attachment,
+      1,
+      &Subpass,
+      0,
+      NULL};
+  Result = vkCreateRenderPass(Context.Device, &RenderPassCreateInfo, NULL,
+                              &RenderPass);
+  check(Result, "creating render pass");
+
+  // Create framebuffer.
+  VkFramebufferCreateInfo FramebufferCreateInfo = {
+      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+      NULL,
+      0,
+      RenderPass,
+      1,
+      &ImageView,
+      Width,
+      Height,
+      1};
+  Result = vkCreateFramebuffer(Context.Device, &FramebufferCreateInfo, NULL,
+                               &Framebuffer);
+  check(Result, "creating framebuffer");
+
+  // Create shader modules.
+  VertexModule = createShaderModule(Context.Device, "derivatives.vert.spv");
+  FragmentModule = createShaderModule(Context.Device, "derivatives.frag.spv");
+
+  // Create pipeline layout.
+  VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, NULL, 0, 0, NULL, 0, NULL};
+  Result = vkCreatePipelineLayout(Context.Device, &PipelineLayoutCreateInfo,
+                                  NULL, &PipelineLayout);
+  check(Result, "creating pipeline layout");
+
+  // Create graphics pipeline.
+  VkPipelineShaderStageCreateInfo StageCreateInfos[2] = {
+      {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, NULL, 0,
+       VK_SHADER_STAGE_VERTEX_BIT, VertexModule, "main", NULL},
+      {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, NULL, 0,
+       VK_SHADER_STAGE_FRAGMENT_BIT, FragmentModule, "main", NULL}};
+  VkPipelineVertexInputStateCreateInfo VertexInputState = {
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      NULL,
+      0,
+      0,
+      NULL,
+      0,
+      NULL};
+  VkPipelineInputAssemblyStateCreateInfo InputAssemblyState = {
+      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO, NULL, 0,
+      VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE};
+  VkViewport Viewport = {0, 0, (float)Width, (float)Height, 0, 1};
+  VkRect2D Scissor = {{0, 0}, {Width, Height}};
+  VkPipelineViewportStateCreateInfo ViewportState = {
+      VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      NULL,
+      0,
+      1,
+      &Viewport,
+      1,
+      &Scissor};
+  VkPipelineRasterizationStateCreateInfo RasterizationState = {
+      VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      NULL,
+      0,
+      VK_FALSE,
+      VK_FALSE,
+      VK_POLYGON_MODE_FILL,
+      VK_CULL_MODE_NONE,
+      VK_FRONT_FACE_COUNTER_CLOCKWISE,
+      VK_FALSE,
+      0,
+      0,
+      0,
+      1};
+  VkPipelineMultisampleStateCreateInfo MultisampleState = {
+      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      NULL,
+      0,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_FALSE,
+      0,
+      NULL,
+      VK_FALSE,
+      VK_FALSE};
+  VkPipelineColorBlendAttachmentState BlendAttachment = {
+      VK_FALSE,
+      VK_BLEND_FACTOR_ONE,
+      VK_BLEND_FACTOR_ZERO,
+      VK_BLEND_OP_ADD,
+      VK_BLEND_FACTOR_ONE,
+      VK_BLEND_FACTOR_ZERO,
+      VK_BLEND_OP_ADD,
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
+  VkPipelineColorBlendStateCreateInfo ColorBlendState = {
+      VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      NULL,
+      0,
+      VK_FALSE,
+      VK_LOGIC_OP_COPY,
+      1,
+      &BlendAttachment,
+      {0, 0, 0, 0}};
+  VkGraphicsPipelineCreateInfo PipelineCreateInfo = {
+      VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      NULL,
+      0,
+      2,
+      StageCreateInfos,
+      &VertexInputState,
+      &InputAssemblyState,
+      NULL,
+      &ViewportState,
+      &RasterizationState,
+      &MultisampleState,
+      NULL,
+      &ColorBlendState,
+      NULL,
+      PipelineLayout,
+      RenderPass,
+      0,
+      VK_NULL_HANDLE,
+      0};
+  Result = vkCreateGraphicsPipelines(Context.Device, VK_NULL_HANDLE, 1,
+                                     &PipelineCreateInfo, NULL, &Pipeline);
+  check(Result, "creating graphics pipeline");
+
+  // Allocate command buffer.
+  VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL, Context.CommandPool,
+      VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+  Result = vkAllocateCommandBuffers(Context.Device, &CommandBufferAllocateInfo,
+                                    &CommandBuffer);
+  check(Result, "creating command buffer");
+
+  // Begin recording commands.
+  VkCommandBufferBeginInfo BeginInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, NULL};
+  Result = vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+  check(Result, "begin command buffer");
+
+  // Draw the triangle, clearing the framebuffer to -1 first.
+  VkClearValue ClearValue;
+  ClearValue.color = {{-1.f, -1.f, -1.f, -1.f}};
+  VkRenderPassBeginInfo RenderPassBeginInfo = {
+      VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      NULL,
+      RenderPass,
+      Framebuffer,
+      {{0, 0}, {Width, Height}},
+      1,
+      &ClearValue};
+  vkCmdBeginRenderPass(CommandBuffer, &RenderPassBeginInfo,
+                       VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+  vkCmdDraw(CommandBuffer, 3, 1, 0, 0);
+  vkCmdEndRenderPass(CommandBuffer);
+
+  // Copy the rendered image to the buffer.
+  VkBufferImageCopy Region = {0,
+                              0,
+                              0,
+                              {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                              {0, 0, 0},
+                              {Width, Height, 1}};
+  vkCmdCopyImageToBuffer(CommandBuffer, Image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, Buffer, 1,
+                         &Region);
+
+  // Finish recording commands.
+  Result = vkEndCommandBuffer(CommandBuffer);
+  check(Result, "end command buffer");
+
+  // Submit command buffer to queue.
+  VkSubmitInfo SubmitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                             NULL,
+                             0,
+                             NULL,
+                             NULL,
+                             1,
+                             &CommandBuffer,
+                             0,
+                             NULL};
+  Result = vkQueueSubmit(Context.Queue, 1, &SubmitInfo, VK_NULL_HANDLE);
+  check(Result, "submitting command");
+
+  // Wait until commands have completed.
+  Result = vkQueueWaitIdle(Context.Queue);
+  check(Result, "waiting for queue to be idle");
+
+  // Check results.
+  // Fragment centers on the diagonal edge of the triangle (where X + Y = 15)
+  // may or may not be covered, so they are not checked.
+  Result = vkMapMemory(Context.Device, BufferMem, 0, NumBytes, 0,
+                       (void **)&Pixels);
+  check(Result, "mapping BufferMem");
+  unsigned NumErrors = 0;
+  for (uint32_t Y = 0; Y < Height; Y++)
+  {
+    for (uint32_t X = 0; X < Width; X++)
+    {
+      if (X + Y == 15)
+        continue;
+
+      // dFdx(2x + 3y) = 2, dFdy(2x + 3y) = 3, and fwidth(2x + 3y) = 5.
+      // dFdyCoarse(x * y) is the x coordinate of the first fragment in the
+      // quad, and dFdyFine(x * y) is the x coordinate of this fragment.
+      float Expected[4] = {2.f, 3.f, 5.f, (X & ~1U) + 0.5f + X + 0.5f};
+      if (X + Y > 15)
+        Expected[0] = Expected[1] = Expected[2] = Expected[3] = -1.f;
+
+      const float *Pixel = Pixels + (X + Y * Width) * 4;
+      for (int c = 0; c < 4; c++)
+      {
+        if (Pixel[c] != Expected[c])
+        {
+          std::cout << "Error at (" << X << "," << Y << ")[" << c
+                    << "]: " << Pixel[c] << " != " << Expected[c] << std::endl;
+          NumErrors++;
+        }
+      }
+    }
+  }
+  vkUnmapMemory(Context.Device, BufferMem);
+  if (NumErrors)
+    exit(1);
+  std::cout << "All results validated correctly." << std::endl;
+
+  // Cleanup.
+  vkFreeCommandBuffers(Context.Device, Context.CommandPool, 1, &CommandBuffer);
+  vkDestroyPipeline(Context.Device, Pipeline, NULL);
+  vkDestroyPipelineLayout(Context.Device, PipelineLayout, NULL);
+  vkDestroyShaderModule(Context.Device, VertexModule, NULL);
+  vkDestroyShaderModule(Context.Device, FragmentModule, NULL);
+  vkDestroyFramebuffer(Context.Device, Framebuffer, NULL);
+  vkDestroyRenderPass(Context.Device, RenderPass, NULL);
+  vkDestroyImageView(Context.Device, ImageView, NULL);
+  vkDestroyImage(Context.Device, Image, NULL);
+  vkDestroyBuffer(Context.Device, Buffer, NULL);
+  vkFreeMemory(Context.Device, ImageMem, NULL);
+  vkFreeMemory(Context.Device, BufferMem, NULL);
+
+  return 0;
+}
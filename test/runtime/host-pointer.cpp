@@ -0,0 +1,194 @@
+#include "common.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// Import host memory with VK_EXT_external_memory_host and check that device
+// commands write to it directly. Then check that the commitment reported for
+// a lazily allocated memory object grows as it is used.
+
+#define NUM_ELEMENTS 1024
+#define LAZY_SIZE (4 << 20)
+
+/// Record \p Commands into a new command buffer, submit it and wait for it.
+template <typename F> void submit(TestContext &Context, F Commands)
+{
+  VkResult Result;
+  VkCommandBuffer CommandBuffer;
+
+  VkCommandBufferAllocateInfo CommandBufferAllocateInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL, Context.CommandPool,
+      VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+  Result = vkAllocateCommandBuffers(Context.Device, &CommandBufferAllocateInfo,
+                                    &CommandBuffer);
+  check(Result, "creating command buffer");
+
+  VkCommandBufferBeginInfo BeginInfo = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, NULL};
+  Result = vkBeginCommandBuffer(CommandBuffer, &BeginInfo);
+  check(Result, "begin command buffer");
+  Commands(CommandBuffer);
+  Result = vkEndCommandBuffer(CommandBuffer);
+  check(Result, "end command buffer");
+
+  VkSubmitInfo SubmitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                             NULL,
+                             0,
+                             NULL,
+                             NULL,
+                             1,
+                             &CommandBuffer,
+                             0,
+                             NULL};
+  Result = vkQueueSubmit(Context.Queue, 1, &SubmitInfo, VK_NULL_HANDLE);
+  check(Result, "submitting command");
+  Result = vkQueueWaitIdle(Context.Queue);
+  check(Result, "waiting for queue to be idle");
+
+  vkFreeCommandBuffers(Context.Device, Context.CommandPool, 1, &CommandBuffer);
+}
+
+int main(int argc, char *argv[])
+{
+  VkResult Result;
+  VkDeviceMemory HostMem;
+  VkBuffer HostBuffer;
+  VkDeviceMemory LazyMem;
+  VkBuffer LazyBuffer;
+
+  alignas(16) static uint32_t HostData[NUM_ELEMENTS];
+
+  // Create test context.
+  TestContext Context("test/host-pointer");
+
+  PFN_vkGetMemoryHostPointerPropertiesEXT GetHostPointerProperties =
+      (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(
+          Context.Device, "vkGetMemoryHostPointerPropertiesEXT");
+  if (!GetHostPointerProperties)
+  {
+    std::cout << "vkGetMemoryHostPointerPropertiesEXT not found" << std::endl;
+    exit(1);
+  }
+
+  // Only suitably aligned host allocations can be imported.
+  VkMemoryHostPointerPropertiesEXT HostPointerProperties = {
+      VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT, NULL, 0};
+  Result = GetHostPointerProperties(
+      Context.Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT, HostData,
+      &HostPointerProperties);
+  if (Result != VK_ERROR_INVALID_EXTERNAL_HANDLE)
+  {
+    std::cout << "Opaque file descriptor handle was not rejected" << std::endl;
+    exit(1);
+  }
+  Result = GetHostPointerProperties(
+      Context.Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+      (uint8_t *)HostData + 4, &HostPointerProperties);
+  if (Result != VK_ERROR_INVALID_EXTERNAL_HANDLE)
+  {
+    std::cout << "Misaligned host pointer was not rejected" << std::endl;
+    exit(1);
+  }
+  Result = GetHostPointerProperties(
+      Context.Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+      HostData, &HostPointerProperties);
+  check(Result, "getting host pointer properties");
+
+  // Import the host data.
+  VkImportMemoryHostPointerInfoEXT ImportInfo = {
+      VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT, NULL,
+      VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, HostData};
+  VkMemoryAllocateInfo AllocateInfo = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, &ImportInfo, sizeof(HostData),
+      findMemoryType(Context.PhysicalDevice,
+                     HostPointerProperties.memoryTypeBits,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)};
+  Result = vkAllocateMemory(Context.Device, &AllocateInfo, NULL, &HostMem);
+  check(Result, "importing host memory");
+
+  // Mapping imported memory must return the host pointer itself.
+  void *Mapped;
+  Result = vkMapMemory(Context.Device, HostMem, 0, VK_WHOLE_SIZE, 0, &Mapped);
+  check(Result, "mapping HostMem");
+  if (Mapped != HostData)
+  {
+    std::cout << "Mapped pointer does not match host pointer" << std::endl;
+    exit(1);
+  }
+  vkUnmapMemory(Context.Device, HostMem);
+
+  // Fill the second half of the imported memory on the device.
+  VkBufferCreateInfo BufferCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                         NULL,
+                                         0,
+                                         sizeof(HostData),
+                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_SHARING_MODE_EXCLUSIVE,
+                                         0,
+                                         NULL};
+  Result = vkCreateBuffer(Context.Device, &BufferCreateInfo, NULL, &HostBuffer);
+  check(Result, "creating host buffer");
+  Result = vkBindBufferMemory(Context.Device, HostBuffer, HostMem, 0);
+  check(Result, "binding host buffer memory");
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+    HostData[i] = i;
+  submit(Context, [&](VkCommandBuffer CommandBuffer) {
+    vkCmdFillBuffer(CommandBuffer, HostBuffer, sizeof(HostData) / 2,
+                    VK_WHOLE_SIZE, 0xDEADBEEF);
+  });
+
+  // Check results.
+  unsigned NumErrors = 0;
+  for (uint32_t i = 0; i < NUM_ELEMENTS; i++)
+  {
+    uint32_t Expected = i < NUM_ELEMENTS / 2 ? i : 0xDEADBEEF;
+    if (HostData[i] != Expected)
+    {
+      std::cout << "Error at index " << i << ": " << HostData[i]
+                << " != " << Expected << std::endl;
+      NumErrors++;
+    }
+  }
+
+  // Allocate a large lazily allocated memory object.
+  AllocateInfo.pNext = NULL;
+  AllocateInfo.allocationSize = LAZY_SIZE;
+  AllocateInfo.memoryTypeIndex =
+      findMemoryType(Context.PhysicalDevice, ~0U,
+                     VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+  Result = vkAllocateMemory(Context.Device, &AllocateInfo, NULL, &LazyMem);
+  check(Result, "allocating lazy memory");
+  BufferCreateInfo.size = LAZY_SIZE;
+  Result = vkCreateBuffer(Context.Device, &BufferCreateInfo, NULL, &LazyBuffer);
+  check(Result, "creating lazy buffer");
+  Result = vkBindBufferMemory(Context.Device, LazyBuffer, LazyMem, 0);
+  check(Result, "binding lazy buffer memory");
+
+  // Touch a single word, and check that the commitment grows accordingly.
+  VkDeviceSize Before, After;
+  vkGetDeviceMemoryCommitment(Context.Device, LazyMem, &Before);
+  submit(Context, [&](VkCommandBuffer CommandBuffer) {
+    vkCmdFillBuffer(CommandBuffer, LazyBuffer, 0, 4, 0);
+  });
+  vkGetDeviceMemoryCommitment(Context.Device, LazyMem, &After);
+  if (After > LAZY_SIZE || After < Before ||
+      (Before < LAZY_SIZE && After == Before))
+  {
+    std::cout << "Unexpected commitment: " << Before << " -> " << After
+              << std::endl;
+    NumErrors++;
+  }
+
+  if (NumErrors)
+    exit(1);
+  std::cout << "All results validated correctly." << std::endl;
+
+  // Cleanup.
+  vkDestroyBuffer(Context.Device, HostBuffer, NULL);
+  vkDestroyBuffer(Context.Device, LazyBuffer, NULL);
+  vkFreeMemory(Context.Device, HostMem, NULL);
+  vkFreeMemory(Context.Device, LazyMem, NULL);
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "talvos/Device.h"
+#include "talvos/Memory.h"
+
+#include <cstdlib>
+#include <iostream>
+
+// Allocate, access and release buffers in workgroup and invocation scope
+// memory, and check the statistics that the device reports for those scopes,
+// both with and without TALVOS_MEMORY_STATS set.
+
+/// Set or clear the TALVOS_MEMORY_STATS environment variable.
+void setMemoryStatsEnv(bool Enabled)
+{
+#if defined(_WIN32)
+  _putenv_s("TALVOS_MEMORY_STATS", Enabled ? "1" : "0");
+#else
+  setenv("TALVOS_MEMORY_STATS", Enabled ? "1" : "0", 1);
+#endif
+}
+
+/// Exit with an error if \p Actual is not equal to \p Expected.
+void checkStat(const char *Name, uint64_t Actual, uint64_t Expected)
+{
+  if (Actual != Expected)
+  {
+    std::cout << Name << " is " << Actual << " (expected " << Expected << ")"
+              << std::endl;
+    exit(1);
+  }
+}
+
+void test(bool Enabled)
+{
+  setMemoryStatsEnv(Enabled);
+  talvos::Device Dev;
+  if (Dev.isMemoryStatsEnabled() != Enabled)
+  {
+    std::cout << "Memory statistics enabled flag is wrong" << std::endl;
+    exit(1);
+  }
+
+  // Peak of 96 bytes, with 80 bytes allocated when the memory is destroyed.
+  {
+    talvos::Memory Group(Dev, talvos::MemoryScope::Workgroup);
+    uint8_t Data[64] = {};
+    uint64_t A = Group.allocate(64);
+    uint64_t B = Group.allocate(32);
+    Group.store(A, 64, Data);
+    Group.load(Data, B, 32);
+    Group.release(B);
+    Group.allocate(16);
+  }
+
+  // Two instances, with a peak of 24 and 8 bytes.
+  for (uint64_t Size : {24, 8})
+  {
+    talvos::Memory Private(Dev, talvos::MemoryScope::Invocation);
+    uint8_t Data[24] = {};
+    uint64_t Address = Private.allocate(Size);
+    Private.store(Address, Size, Data);
+  }
+
+  // Allocation statistics are always available.
+  talvos::MemoryStats Group =
+      Dev.getMemoryStats(talvos::MemoryScope::Workgroup);
+  checkStat("Workgroup allocations", Group.NumAllocations, 3);
+  checkStat("Workgroup peak bytes", Group.PeakBytes, 96);
+  checkStat("Workgroup live bytes", Group.LiveBytes, 0);
+  talvos::MemoryStats Private =
+      Dev.getMemoryStats(talvos::MemoryScope::Invocation);
+  checkStat("Invocation allocations", Private.NumAllocations, 2);
+  checkStat("Invocation peak bytes", Private.PeakBytes, 24);
+  checkStat("Invocation live buffers", Private.LiveBuffers, 0);
+
+  // Accesses are only counted if memory statistics are enabled.
+  if (Group.HasAccessCounts != Enabled || Private.HasAccessCounts != Enabled)
+  {
+    std::cout << "Access counts reported as "
+              << (Enabled ? "unavailable" : "available") << std::endl;
+    exit(1);
+  }
+  checkStat("Workgroup bytes stored", Group.StoreBytes, Enabled ? 64 : 0);
+  checkStat("Workgroup bytes loaded", Group.LoadBytes, Enabled ? 32 : 0);
+  checkStat("Invocation bytes stored", Private.StoreBytes, Enabled ? 32 : 0);
+}
+
+int main()
+{
+  test(false);
+  test(true);
+
+  std::cout << "All results validated correctly." << std::endl;
+
+  return 0;
+}
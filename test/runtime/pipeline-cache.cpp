@@ -0,0 +1,261 @@
+#include "common.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Create a pipeline with a pipeline cache, and check that the cache data can
+// be used to create a new cache that produces the same data. Corrupted cache
+// entries must be ignored and replaced.
+
+// Sizes of the pipeline cache header, the header of each entry in the cache,
+// and the header of a serialized module.
+#define HEADER_SIZE (16 + VK_UUID_SIZE)
+#define ENTRY_HEADER_SIZE 16
+#define MODULE_HEADER_SIZE 40
+
+/// Returns the 64-bit FNV-1a hash of \p NumBytes bytes of \p Data.
+uint64_t hash(const uint8_t *Data, size_t NumBytes)
+{
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < NumBytes; i++)
+  {
+    Hash ^= Data[i];
+    Hash *= 0x100000001b3ULL;
+  }
+  return Hash;
+}
+
+/// Create a compute pipeline for \p Module using \p Cache, and return the data
+/// in the cache afterwards.
+std::vector<uint8_t> createPipeline(TestContext &Context,
+                                    VkPipelineLayout PipelineLayout,
+                                    VkPipelineCache Cache,
+                                    VkShaderModule Module)
+{
+  VkResult Result;
+  VkPipeline Pipeline;
+
+  VkPipelineShaderStageCreateInfo ShaderStageCreateInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      NULL,
+      0,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      Module,
+      "vecadd",
+      NULL};
+  VkComputePipelineCreateInfo PipelineCreateInfo = {
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      NULL,
+      0,
+      ShaderStageCreateInfo,
+      PipelineLayout,
+      NULL,
+      0};
+  Result = vkCreateComputePipelines(Context.Device, Cache, 1,
+                                    &PipelineCreateInfo, NULL, &Pipeline);
+  check(Result, "creating compute pipeline");
+  vkDestroyPipeline(Context.Device, Pipeline, NULL);
+
+  // Get the cache data.
+  size_t DataSize;
+  Result = vkGetPipelineCacheData(Context.Device, Cache, &DataSize, NULL);
+  check(Result, "getting pipeline cache data size");
+  std::vector<uint8_t> Data(DataSize);
+  Result =
+      vkGetPipelineCacheData(Context.Device, Cache, &DataSize, Data.data());
+  check(Result, "getting pipeline cache data");
+  Data.resize(DataSize);
+  return Data;
+}
+
+/// Create a compute pipeline for the vecadd shader using \p Cache, and return
+/// the data in the cache afterwards.
+std::vector<uint8_t> createPipeline(TestContext &Context,
+                                    VkPipelineLayout PipelineLayout,
+                                    VkPipelineCache Cache)
+{
+  // Use a new shader module each time, so that the module is loaded from the
+  // pipeline cache if possible.
+  VkShaderModule Module =
+      createShaderModule(Context.Device, "../misc/vecadd.spv");
+  std::vector<uint8_t> Data =
+      createPipeline(Context, PipelineLayout, Cache, Module);
+  vkDestroyShaderModule(Context.Device, Module, NULL);
+  return Data;
+}
+
+/// Create a pipeline cache with initial data \p Data.
+VkPipelineCache createPipelineCache(TestContext &Context,
+                                    const std::vector<uint8_t> &Data)
+{
+  VkPipelineCache Cache;
+  VkPipelineCacheCreateInfo CacheCreateInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, NULL, 0, Data.size(),
+      Data.data()};
+  VkResult Result =
+      vkCreatePipelineCache(Context.Device, &CacheCreateInfo, NULL, &Cache);
+  check(Result, "creating pipeline cache");
+  return Cache;
+}
+
+int main(int argc, char *argv[])
+{
+  VkResult Result;
+  VkDescriptorSetLayout DescriptorSetLayout;
+  VkPipelineLayout PipelineLayout;
+  VkPipelineCache Cache;
+
+  // Create test context.
+  TestContext Context("test/pipeline-cache");
+
+  // Create descriptor set layout.
+  VkDescriptorSetLayoutBinding DescriptorSetLayoutBindings[3] = {
+      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+       NULL},
+      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+       NULL},
+      {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+       NULL}};
+  VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, NULL, 0, 3,
+      DescriptorSetLayoutBindings};
+  Result = vkCreateDescriptorSetLayout(Context.Device,
+                                       &DescriptorSetLayoutCreateInfo, NULL,
+                                       &DescriptorSetLayout);
+  check(Result, "creating descriptor set layout");
+
+  // Create pipeline layout.
+  VkPipelineLayoutCreateInfo PipelineLayoutCreateInfo = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      NULL,
+      0,
+      1,
+      &DescriptorSetLayout,
+      0,
+      NULL};
+  Result = vkCreatePipelineLayout(Context.Device, &PipelineLayoutCreateInfo,
+                                  NULL, &PipelineLayout);
+  check(Result, "creating pipeline layout");
+
+  // Create a pipeline with an empty cache, which adds the module to it.
+  Cache = createPipelineCache(Context, {});
+  std::vector<uint8_t> Original =
+      createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Original.size() <= HEADER_SIZE + ENTRY_HEADER_SIZE + MODULE_HEADER_SIZE)
+  {
+    std::cout << "Pipeline cache data is empty" << std::endl;
+    exit(1);
+  }
+
+  // Create a pipeline with a cache created from that data, which should load
+  // the module from the cache and leave the data unchanged.
+  Cache = createPipelineCache(Context, Original);
+  std::vector<uint8_t> Reloaded =
+      createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Reloaded != Original)
+  {
+    std::cout << "Pipeline cache data changed after reloading" << std::endl;
+    exit(1);
+  }
+
+  // Corrupt the serialized module, and check that it gets replaced.
+  std::vector<uint8_t> Corrupted = Original;
+  Corrupted.back() ^= 0xFF;
+  Cache = createPipelineCache(Context, Corrupted);
+  std::vector<uint8_t> Repaired =
+      createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Repaired != Original)
+  {
+    std::cout << "Corrupted pipeline cache entry was not replaced" << std::endl;
+    exit(1);
+  }
+
+  // Change the first instruction in the serialized module (OpCapability) to
+  // OpTypeInt, which needs more operands than the record holds, and update
+  // the payload hash to match. The entry must be rejected and replaced.
+  std::vector<uint8_t> Malformed = Original;
+  uint8_t *Module = Malformed.data() + HEADER_SIZE + ENTRY_HEADER_SIZE;
+  uint32_t *Opcode = (uint32_t *)(Module + MODULE_HEADER_SIZE);
+  if ((*Opcode & 0xFFFF) != 17)
+  {
+    std::cout << "Unexpected first instruction in serialized module"
+              << std::endl;
+    exit(1);
+  }
+  *Opcode = (*Opcode & 0xFFFF0000) | 21;
+  uint64_t PayloadHash =
+      hash(Module + MODULE_HEADER_SIZE,
+           Malformed.data() + Malformed.size() - Module - MODULE_HEADER_SIZE);
+  memcpy(Module + 28, &PayloadHash, 8);
+  Cache = createPipelineCache(Context, Malformed);
+  std::vector<uint8_t> Rebuilt = createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Rebuilt != Original)
+  {
+    std::cout << "Malformed pipeline cache entry was not replaced" << std::endl;
+    exit(1);
+  }
+
+  // Change the length of the SPIR-V binary recorded in the module header, as
+  // if the entry was for a different binary with the same hash. The entry
+  // must be rejected and replaced.
+  std::vector<uint8_t> Mismatched = Original;
+  Mismatched[HEADER_SIZE + ENTRY_HEADER_SIZE + 16] ^= 0x01;
+  Cache = createPipelineCache(Context, Mismatched);
+  std::vector<uint8_t> Reparsed =
+      createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Reparsed != Original)
+  {
+    std::cout << "Pipeline cache entry for a different binary was not replaced"
+              << std::endl;
+    exit(1);
+  }
+
+  // Create two pipelines from the same shader module, each with a new cache.
+  // The second cache must still receive the module, even though its functions
+  // have already been built for the first pipeline.
+  VkShaderModule ShaderModule =
+      createShaderModule(Context.Device, "../misc/vecadd.spv");
+  Cache = createPipelineCache(Context, {});
+  createPipeline(Context, PipelineLayout, Cache, ShaderModule);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  Cache = createPipelineCache(Context, {});
+  std::vector<uint8_t> Reused =
+      createPipeline(Context, PipelineLayout, Cache, ShaderModule);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  vkDestroyShaderModule(Context.Device, ShaderModule, NULL);
+  if (Reused != Original)
+  {
+    std::cout << "Pipeline cache data missing for a shader module in use"
+              << std::endl;
+    exit(1);
+  }
+
+  // Data with an unknown header must be ignored.
+  std::vector<uint8_t> Invalid = Original;
+  Invalid[16] ^= 0xFF;
+  Cache = createPipelineCache(Context, Invalid);
+  std::vector<uint8_t> Replaced =
+      createPipeline(Context, PipelineLayout, Cache);
+  vkDestroyPipelineCache(Context.Device, Cache, NULL);
+  if (Replaced != Original)
+  {
+    std::cout << "Pipeline cache with invalid header was not ignored"
+              << std::endl;
+    exit(1);
+  }
+
+  std::cout << "All results validated correctly." << std::endl;
+
+  // Cleanup.
+  vkDestroyPipelineLayout(Context.Device, PipelineLayout, NULL);
+  vkDestroyDescriptorSetLayout(Context.Device, DescriptorSetLayout, NULL);
+
+  return 0;
+}
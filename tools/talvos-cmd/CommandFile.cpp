@@ -215,8 +215,12 @@ void CommandFile::parseDispatch()
   GroupCount.Y = get<uint32_t>("group count Y");
   GroupCount.Z = get<uint32_t>("group count Z");
 
-  talvos::PipelineStage *Stage =
-      new talvos::PipelineStage(*Device, Module, Entry, SpecConstMap);
+  // Get the pipeline stage, keeping it alive so that later dispatches with the
+  // same module, entry point, and specialization constants can reuse it.
+  std::shared_ptr<const talvos::PipelineStage> Stage =
+      Device->getPipelineStage(Module, Entry, SpecConstMap);
+  Stages.insert(Stage);
+
   talvos::ComputePipeline Pipeline(Stage);
   talvos::PipelineContext PC;
   PC.bindComputePipeline(&Pipeline);
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include "talvos/PipelineContext.h"
@@ -50,6 +51,7 @@ private:
   const talvos::EntryPoint *Entry;
   std::map<std::string, std::pair<uint64_t, uint64_t>> Buffers;
   talvos::SpecConstantMap SpecConstMap;
+  std::set<std::shared_ptr<const talvos::PipelineStage>> Stages;
   talvos::DescriptorSetMap DescriptorSets;
   std::vector<std::pair<size_t, std::streampos>> Loops;
 